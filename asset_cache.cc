@@ -0,0 +1,1079 @@
+#include "asset_cache.h"
+
+#include <GL/glew.h>
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <glm/gtc/type_ptr.hpp>
+#include "tiny_obj_loader.h"
+#include "meshbin.h"
+#include "mesh_optimizer.h"
+#include "vertex_format.h"
+#include "sphere_mesh.h"
+#include "bmp_image.h"
+#include "mipmap.h"
+#include "texbin.h"
+#include "texture_compress.h"
+#include "gl_extensions.h"
+#include "gl_state.h"
+#include "timer.h"
+
+#ifndef _WIN32
+#include <climits>
+#endif
+
+// Convert the BMP pixels and make their mipmaps in a mapped pixel buffer object
+// instead of a heap buffer, so the driver can copy them to the texture without
+// touching them.
+#ifndef TEXTURE_PBO_UPLOAD
+#define TEXTURE_PBO_UPLOAD 1
+#endif
+
+// Cook the textures into BC1/BC3 mip chains of texbin.h on the first run, if
+// the GL implementation has S3TC, and upload those instead of the BMP files.
+#ifndef TEXTURE_COMPRESSION
+#define TEXTURE_COMPRESSION 1
+#endif
+
+// Print the vertex cache statistics and the LOD chain of every OBJ mesh when
+// it is loaded.
+#ifndef MESH_STATS
+#define MESH_STATS 0
+#endif
+
+static std::map<std::string, mesh_asset *> meshes;
+static std::map<std::string, texture_asset *> textures;
+
+/* The absolute path of 'filename' with '.', '..' and links resolved, or
+ * 'filename' itself if the file does not exist.
+ */
+static std::string canonical_path(const char *filename)
+{
+#ifndef _WIN32
+	char path[PATH_MAX];
+	if(realpath(filename, path))
+		return path;
+#else
+	char path[_MAX_PATH];
+	if(_fullpath(path, filename, _MAX_PATH))
+		return path;
+#endif
+	return filename;
+}
+
+/* A mesh packed for the GPU, made on any thread and uploaded by upload_mesh(). */
+struct mesh_data {
+	std::vector<unsigned char> vertices;	// packed_vertex or 8 floats per vertex
+	std::vector<unsigned char> indices;	// GLushort or GLuint per index
+	bool compactVertices;
+	unsigned int firstInstanceAttribute, numInstanceAttributes;
+	GLenum indexType;
+	glm::vec3 positionOffset, positionScale;
+	glm::vec3 boundingCenter;
+	float boundingRadius;
+	std::vector<mesh_lod> lods;
+	std::string error;	// Why the file cannot be loaded, empty if it can
+};
+
+/* A mapped and checked BMP file, made on any thread and uploaded by
+ * upload_texture().
+ */
+struct texture_data {
+	std::string filename;
+	bool compress;	// Use or cook the compressed cache
+	bmp_image image;
+	unsigned int width, height;	// Size of level 0, resized from the file if set before decoding
+	bool valid;	// False if the file cannot be read
+	texbin cooked;
+	bool compressed;	// The levels are in 'cooked' instead of the BMP file
+	GLuint staging;	// Pixel buffer of the mip chain, 0 if it is in a heap buffer
+	unsigned char *pixels;	// The mip chain, mapped while it is converted
+	double decodeTime;	// Milliseconds spent in decode_texture() and convert_texture()
+	texture_data(): compress(false), width(0), height(0), valid(false), compressed(false),
+		staging(0), pixels(nullptr), decodeTime(0.0){}
+};
+
+/* Pack interleaved float vertices and the index buffer of all the levels of
+ * detail, and compute the bounding sphere. The caller sets data.lods.
+ */
+static void prepare_mesh(const float *vertices, size_t numVertices,
+		const std::vector<GLuint> &lodIndices, const mesh_options &options, mesh_data &data)
+{
+	data.compactVertices = options.compactVertices;
+	data.firstInstanceAttribute = options.firstInstanceAttribute;
+	data.numInstanceAttributes = options.numInstanceAttributes;
+	data.positionOffset = glm::vec3(0.0f);
+	data.positionScale = glm::vec3(1.0f);
+	if (options.compactVertices)
+	{
+		packed_mesh packed;
+		pack_vertices(vertices, numVertices, packed);
+		data.positionOffset = glm::make_vec3(packed.positionOffset);
+		data.positionScale = glm::make_vec3(packed.positionScale);
+		const unsigned char *bytes = (const unsigned char *)packed.vertices.data();
+		data.vertices.assign(bytes, bytes + sizeof(packed_vertex)*packed.vertices.size());
+	}
+	else
+	{
+		const unsigned char *bytes = (const unsigned char *)vertices;
+		data.vertices.assign(bytes, bytes + sizeof(float)*tinyobj::INTERLEAVED_STRIDE*numVertices);
+	}
+
+	// The bounding sphere around the center of the bounding box, the same
+	// radius the errors of the LOD chain are relative to. A shape without
+	// faces has no vertices.
+	glm::vec3 lower(0.0f), upper(0.0f);
+	if (numVertices > 0)
+		lower = upper = glm::make_vec3(vertices);
+	for (size_t i = 1; i < numVertices; ++i)
+	{
+		glm::vec3 p = glm::make_vec3(vertices + i*tinyobj::INTERLEAVED_STRIDE);
+		lower = glm::min(lower, p);
+		upper = glm::max(upper, p);
+	}
+	data.boundingCenter = (lower + upper)*0.5f;
+	data.boundingRadius = glm::length(upper - lower)*0.5f;
+
+	// 16-bit indices if they fit.
+	std::vector<GLushort> shortIndices;
+	if (pack_indices16(lodIndices.data(), lodIndices.size(), numVertices, shortIndices))
+	{
+		data.indexType = GL_UNSIGNED_SHORT;
+		const unsigned char *bytes = (const unsigned char *)shortIndices.data();
+		data.indices.assign(bytes, bytes + sizeof(GLushort)*shortIndices.size());
+	}
+	else
+	{
+		data.indexType = GL_UNSIGNED_INT;
+		const unsigned char *bytes = (const unsigned char *)lodIndices.data();
+		data.indices.assign(bytes, bytes + sizeof(GLuint)*lodIndices.size());
+	}
+}
+
+void set_vertex_attributes(bool compactVertices)
+{
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+	if (compactVertices)
+	{
+		const GLsizei stride = sizeof(packed_vertex);
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride,
+				(const void *)offsetof(packed_vertex, position));
+		glVertexAttribPointer(1, 2, GL_HALF_FLOAT, GL_FALSE, stride,
+				(const void *)offsetof(packed_vertex, texcoord));
+		glVertexAttribPointer(2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride,
+				(const void *)offsetof(packed_vertex, normal));
+	}
+	else
+	{
+		const GLsizei stride = sizeof(GLfloat)*tinyobj::INTERLEAVED_STRIDE;
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (const void *)0);
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (const void *)(sizeof(GLfloat)*3));
+		glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (const void *)(sizeof(GLfloat)*5));
+	}
+}
+
+/* Create the vertex array of 'asset' from 'data' and mark it ready. */
+static void upload_mesh(const mesh_data &data, mesh_asset &asset)
+{
+	glGenVertexArrays(1, &asset.vao);
+	glGenBuffers(2, asset.vbo);
+	state_bind_vertex_array(asset.vao);
+
+	// Upload the interleaved vertex array: position, texCoord, normal
+	state_bind_buffer(GL_ARRAY_BUFFER, asset.vbo[0]);
+	glBufferData(GL_ARRAY_BUFFER, data.vertices.size(), data.vertices.data(), GL_STATIC_DRAW);
+	set_vertex_attributes(data.compactVertices);
+	for (unsigned int i = 0; i < data.numInstanceAttributes; ++i)
+	{
+		glEnableVertexAttribArray(data.firstInstanceAttribute + i);
+		glVertexAttribDivisor(data.firstInstanceAttribute + i, 1);
+	}
+
+	// Setup index buffer for glDrawElements
+	state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, asset.vbo[1]);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.indices.size(), data.indices.data(), GL_STATIC_DRAW);
+
+	// Unbind the vao of this mesh
+	state_bind_vertex_array(0);
+
+	asset.compactVertices = data.compactVertices;
+	asset.indexType = data.indexType;
+	asset.positionOffset = data.positionOffset;
+	asset.positionScale = data.positionScale;
+	asset.boundingCenter = data.boundingCenter;
+	asset.boundingRadius = data.boundingRadius;
+	asset.lods = data.lods;
+	asset.ready = true;
+}
+
+/* Load the first shape of an OBJ file through its binary cache and pack it,
+ * on any thread. Errors are left in data.error for the GL thread.
+ * Parameter:
+ * - arena: The scratch memory of LoadObj, one per thread.
+ * - parseThreads: The threads LoadObj splits a large file between, 0 for one
+ *   per core.
+ */
+static void decode_mesh(const char *filename, const mesh_options &options,
+		tinyobj::LoadArena &arena, unsigned int parseThreads, mesh_data &data)
+{
+	std::vector<tinyobj::shape_t> shapes;
+	std::vector<tinyobj::material_t> materials;
+
+	// Use the binary cache of the OBJ file if it is up to date. Otherwise parse
+	// the OBJ file and write the cache for the next run.
+	meshbin cache;
+	if (!meshbin_open(filename, cache))
+	{
+		// Large files are split and parsed on 'parseThreads' threads, small
+		// ones serially.
+		std::string err = tinyobj::LoadObj(shapes, materials, filename, NULL, parseThreads,
+				tinyobj::LOAD_INTERLEAVED, &arena);
+
+		if (!err.empty())
+		{
+			data.error = err;
+			return;
+		}
+		// Reorder the triangles and vertices for the GPU caches once, before
+		// they go into the binary cache.
+		for (size_t i = 0; i < shapes.size(); ++i)
+		{
+#if MESH_STATS
+			mesh_cache_stats before = mesh_cache_stats(), after = before;
+			optimize_mesh(shapes[i].mesh, true, &before, &after);
+			std::cout<<filename<<": ACMR "<<before.acmr<<" -> "<<after.acmr
+				<<", ATVR "<<before.atvr<<" -> "<<after.atvr<<std::endl;
+#else
+			optimize_mesh(shapes[i].mesh, true);
+#endif
+		}
+		if (!meshbin_write(filename, cache, shapes))
+			std::cerr<<"Cannot write the mesh cache of "<<filename<<std::endl;
+		meshbin_view(shapes, cache);
+	}
+	if (cache.shapes.size()==0)
+	{
+		data.error = std::string("No shape in ") + filename;
+		meshbin_close(cache);
+		return;
+	}
+	const meshbin_shape &mesh = cache.shapes[0];
+	const size_t numVertices = mesh.numVertices/tinyobj::INTERLEAVED_STRIDE;
+
+	// All the levels of detail share the vertex buffer and one index buffer.
+	std::vector<GLuint> lodIndices;
+	build_lod_chain(mesh.indices, mesh.numIndices, mesh.vertices, numVertices,
+			tinyobj::INTERLEAVED_STRIDE, options.lodLevels, lodIndices, data.lods);
+#if MESH_STATS
+	std::ostringstream log;
+	log<<filename<<": LOD triangles";
+	for (size_t i = 0; i < data.lods.size(); ++i)
+		log<<" "<<data.lods[i].numIndices/3;
+	std::cout<<log.str()<<std::endl;
+#endif
+
+	prepare_mesh(mesh.vertices, numVertices, lodIndices, options, data);
+	meshbin_close(cache);
+}
+
+/* A new asset in the map with one reference, not ready until it is uploaded. */
+static mesh_asset *new_mesh(const std::string &key)
+{
+	mesh_asset *mesh = new mesh_asset;
+	mesh->key = key;
+	mesh->refCount = 1;
+	mesh->ready = false;
+	mesh->vao = 0;
+	mesh->vbo[0] = mesh->vbo[1] = 0;
+	mesh->compactVertices = false;
+	mesh->boundingCenter = glm::vec3(0.0f);
+	mesh->boundingRadius = 0.0f;
+	meshes[key] = mesh;
+	return mesh;
+}
+
+/* The shared mesh of 'key' with one more reference, or nullptr. */
+static mesh_asset *find_mesh(const std::string &key)
+{
+	std::map<std::string, mesh_asset *>::iterator it = meshes.find(key);
+	if(it == meshes.end())
+		return nullptr;
+	++it->second->refCount;
+	return it->second;
+}
+
+static std::string mesh_key(const char *filename, const mesh_options &options)
+{
+	std::ostringstream key;
+	key<<canonical_path(filename)<<"?compact="<<options.compactVertices
+		<<"&lod="<<options.lodLevels<<"&instance="<<options.firstInstanceAttribute
+		<<"+"<<options.numInstanceAttributes;
+	return key.str();
+}
+
+mesh_asset *acquire_mesh(const char *filename, const mesh_options &options)
+{
+	std::string key = mesh_key(filename, options);
+	mesh_asset *mesh = find_mesh(key);
+	if(mesh)
+		return mesh;
+
+	mesh = new_mesh(key);
+	static tinyobj::LoadArena arena;
+	mesh_data data;
+	// Nothing else is loading, so LoadObj may use every core.
+	decode_mesh(filename, options, arena, 0, data);
+	if (!data.error.empty())
+	{
+		std::cerr<<data.error<<std::endl;
+		exit(1);
+	}
+	upload_mesh(data, *mesh);
+	return mesh;
+}
+
+mesh_asset *acquire_sphere(const sphere_options &sphere, const mesh_options &options)
+{
+	std::ostringstream key;
+	key<<(sphere.type == SPHERE_UV? "sphere:uv": "sphere:ico")<<"?radius="<<sphere.radius
+		<<"&tessellation="<<sphere.tessellation
+		<<"&compact="<<options.compactVertices<<"&lod="<<options.lodLevels
+		<<"&instance="<<options.firstInstanceAttribute<<"+"<<options.numInstanceAttributes;
+	mesh_asset *asset = find_mesh(key.str());
+	if(asset)
+		return asset;
+	asset = new_mesh(key.str());
+
+	// Every level of detail is a sphere with half the segments, or one
+	// subdivision less, of the previous level. They are all in one vertex buffer.
+	sphere_mesh mesh;
+	mesh_data data;
+	std::vector<float> errors;
+	unsigned int tessellation = sphere.tessellation;
+	for(unsigned int level = 0; level < options.lodLevels; ++level){
+		mesh_lod lod;
+		lod.firstIndex = mesh.indices.size();
+		if(sphere.type == SPHERE_UV){
+			generate_uv_sphere(sphere.radius, tessellation/2, tessellation, mesh);
+			errors.push_back(uv_sphere_error(tessellation/2, tessellation));
+		}else{
+			generate_icosphere(sphere.radius, tessellation, mesh);
+			errors.push_back(icosphere_error(tessellation));
+		}
+		lod.numIndices = mesh.indices.size() - lod.firstIndex;
+		lod.error = 0.0f;
+		data.lods.push_back(lod);
+		if(sphere.type == SPHERE_UV? tessellation/2 < 8: tessellation == 0)
+			break;
+		tessellation = sphere.type == SPHERE_UV? tessellation/2: tessellation - 1;
+	}
+	for(size_t i = 0; i < data.lods.size(); ++i)
+		optimize_vertex_cache(&mesh.indices[data.lods[i].firstIndex], data.lods[i].numIndices,
+				mesh.vertices.size()/tinyobj::INTERLEAVED_STRIDE);
+
+	prepare_mesh(mesh.vertices.data(), mesh.vertices.size()/tinyobj::INTERLEAVED_STRIDE,
+			mesh.indices, options, data);
+	// The errors are relative to the sphere radius, the LOD chain wants them
+	// relative to the bounding radius. The full mesh is the reference, so
+	// subtract its own error.
+	for(size_t i = 1; i < data.lods.size(); ++i)
+		data.lods[i].error = (errors[i] - errors[0])*sphere.radius/data.boundingRadius;
+	upload_mesh(data, *asset);
+	return asset;
+}
+
+void release_mesh(mesh_asset *mesh)
+{
+	if(!mesh || --mesh->refCount > 0)
+		return;
+	meshes.erase(mesh->key);
+	state_delete_vertex_arrays(1, &mesh->vao);
+	state_delete_buffers(2, mesh->vbo);
+	delete mesh;
+}
+
+/* Whether textures are compressed, checked on the GL thread. */
+static bool compress_textures()
+{
+	static const bool s3tc = has_extension("GL_EXT_texture_compression_s3tc");
+	return TEXTURE_COMPRESSION && s3tc;
+}
+
+/* Convert the mapped BMP into level 0 of a chain, resized to the size of
+ * 'data', and unmap it.
+ */
+static void read_level0(texture_data &data, unsigned char *rgba)
+{
+	if(data.width == data.image.width && data.height == data.image.height){
+		bmp_to_rgba(data.image, rgba);
+	}else{
+		std::vector<unsigned char> image(size_t(data.image.width)*data.image.height*4);
+		bmp_to_rgba(data.image, image.data());
+		resize_image(image.data(), data.image.width, data.image.height, rgba, data.width,
+				data.height);
+	}
+	bmp_close(data.image);
+}
+
+/* Map and check the BMP file, on any thread. With 'data.compress' map its
+ * compressed cache instead, cooking the cache first if it is out of date.
+ */
+static void decode_texture(const char *bmpfile, texture_data &data)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	data.filename = bmpfile;
+	if(data.compress && texbin_open(bmpfile, data.width, data.height, data.cooked)){
+		data.valid = data.compressed = true;
+		data.width = data.cooked.width;
+		data.height = data.cooked.height;
+		data.decodeTime += elapsed_ms(start);
+		return;
+	}
+	data.valid = bmp_open(bmpfile, data.image);
+	if(data.valid && data.width == 0){
+		data.width = data.image.width;
+		data.height = data.image.height;
+	}
+	if(!data.valid){
+		std::cerr<<"Cannot read the BMP file "<<bmpfile<<std::endl;
+	}else if(data.compress){
+		// The compressor reads the mip chain back, so it is made in a heap
+		// buffer instead of a write-only pixel buffer.
+		std::vector<unsigned char> chain(mip_chain_size(data.width, data.height));
+		read_level0(data, chain.data());
+		generate_mips(chain.data(), data.width, data.height);
+		if(!texbin_cook(chain.data(), data.width, data.height, data.cooked))
+			std::cerr<<"Cannot write the texture cache of "<<bmpfile<<std::endl;
+		data.compressed = true;
+	}
+	data.decodeTime += elapsed_ms(start);
+}
+
+/* Bytes which upload_texture() sends to GL. */
+static size_t texture_bytes(const texture_data &data)
+{
+	if(!data.valid)
+		return 0;
+	if(!data.compressed)
+		return mip_chain_size(data.width, data.height);
+	size_t bytes = 0;
+	for(size_t i = 0; i < data.cooked.levelSizes.size(); ++i)
+		bytes += data.cooked.levelSizes[i];
+	return bytes;
+}
+
+/* Allocate the memory of the mip chain on the GL thread: a mapped pixel buffer,
+ * which the driver can copy to the texture without touching the pixels, or a
+ * heap buffer.
+ */
+static void stage_texture(texture_data &data)
+{
+	const size_t size = mip_chain_size(data.width, data.height);
+	if(TEXTURE_PBO_UPLOAD){
+		glGenBuffers(1, &data.staging);
+		state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, data.staging);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+		data.pixels = static_cast<unsigned char *>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+				GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+		state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		if(data.pixels)
+			return;
+		state_delete_buffers(1, &data.staging);
+		data.staging = 0;
+	}
+	data.pixels = new unsigned char[size];
+}
+
+/* Convert the file into level 0 of the chain and make the other levels, on any
+ * thread. The file is unmapped.
+ */
+static void convert_texture(texture_data &data)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	read_level0(data, data.pixels);
+	generate_mips(data.pixels, data.width, data.height);
+	data.decodeTime += elapsed_ms(start);
+}
+
+/* Unmap the chain of stage_texture() for glTexImage2D and friends.
+ * Return:
+ * - The address of the chain, an offset into the bound pixel buffer if it is
+ *   one.
+ */
+static const unsigned char *bind_staged(texture_data &data)
+{
+	if(!data.staging)
+		return data.pixels;
+	state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, data.staging);
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	return nullptr;
+}
+
+/* Free the memory of stage_texture() after bind_staged() and the upload. */
+static void free_staged(texture_data &data)
+{
+	if(data.staging){
+		state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		state_delete_buffers(1, &data.staging);
+	}else{
+		delete [] data.pixels;
+	}
+	data.staging = 0;
+	data.pixels = nullptr;
+}
+
+/* Free the memory of stage_texture() without uploading it. */
+static void unstage_texture(texture_data &data)
+{
+	if(data.staging){
+		state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, data.staging);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		state_delete_buffers(1, &data.staging);
+	}else{
+		delete [] data.pixels;
+	}
+	data.staging = 0;
+	data.pixels = nullptr;
+}
+
+/* Replace the image of 'asset' with the compressed levels of 'data' straight
+ * from the mapped cache, one glCompressedTexImage2D per level.
+ */
+static void upload_compressed_texture(texture_data &data, texture_asset &asset)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	const texbin &tex = data.cooked;
+	state_bind_texture(0, GL_TEXTURE_2D, asset.texture);
+	for(size_t level = 0; level < tex.levels.size(); ++level){
+		glCompressedTexImage2D(GL_TEXTURE_2D, level, tex.format, std::max(1u, tex.width >> level),
+				std::max(1u, tex.height >> level), 0, tex.levelSizes[level], tex.levels[level]);
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, tex.levels.size() - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
+	asset.ready = true;
+	std::cout<<data.filename<<": "<<tex.width<<"x"<<tex.height
+		<<(tex.format == TEXBIN_BC1? " BC1": " BC3")<<", "<<texture_bytes(data)/1024
+		<<" KB, decoded in "<<data.decodeTime<<" ms, uploaded in "<<elapsed_ms(start)
+		<<" ms"<<std::endl;
+	texbin_close(data.cooked);
+}
+
+/* Replace the image of 'asset' with the converted mip chain of 'data', one
+ * glTexImage2D per level, free the chain and mark the asset ready.
+ */
+static void upload_texture(texture_data &data, texture_asset &asset)
+{
+	if(data.compressed){
+		upload_compressed_texture(data, asset);
+		return;
+	}
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	state_bind_texture(0, GL_TEXTURE_2D, asset.texture);
+	const unsigned int width = data.valid? data.width: 0;
+	const unsigned int height = data.valid? data.height: 0;
+	const unsigned int levels = data.valid? mip_levels(width, height): 1;
+	const unsigned char *base = bind_staged(data);
+	for(unsigned int level = 0; level < levels; ++level){
+		glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, std::max(1u, width >> level),
+				std::max(1u, height >> level), 0, GL_RGBA, GL_UNSIGNED_BYTE,
+				data.valid? base + mip_offset(width, height, level): nullptr);
+	}
+	free_staged(data);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
+	asset.ready = true;
+	if(data.valid)
+		std::cout<<data.filename<<": "<<width<<"x"<<height<<" RGBA, "<<texture_bytes(data)/1024
+			<<" KB, decoded in "<<data.decodeTime<<" ms, uploaded in "<<elapsed_ms(start)
+			<<" ms"<<std::endl;
+}
+
+/* Replace the image of 'asset', a GL_TEXTURE_2D_ARRAY, with a layer per
+ * texture of 'layers', all width x height. The compressed layers are all in
+ * the format of the first one with alpha, BC1 layers widened if it is BC3.
+ */
+static void upload_texture_array(const std::vector<texture_data *> &layers, unsigned int width,
+		unsigned int height, bool compressed, texture_asset &asset)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	bool alpha = false;
+	size_t bytes = 0;
+	for(size_t i = 0; i < layers.size(); ++i){
+		alpha = alpha || (layers[i]->compressed && layers[i]->cooked.format == TEXBIN_BC3);
+		bytes += texture_bytes(*layers[i]);
+	}
+	const GLenum format = alpha? TEXBIN_BC3: TEXBIN_BC1;
+	const GLsizei depth = layers.size();
+	const unsigned int levels = mip_levels(width, height);
+
+	state_bind_texture(0, GL_TEXTURE_2D_ARRAY, asset.texture);
+	std::vector<const unsigned char *> bases(layers.size());
+	if(!compressed){
+		for(size_t i = 0; i < layers.size(); ++i)
+			bases[i] = bind_staged(*layers[i]);
+	}
+	std::vector<unsigned char> widened;
+	for(unsigned int level = 0; level < levels; ++level){
+		const unsigned int w = std::max(1u, width >> level), h = std::max(1u, height >> level);
+		// Unreadable layers are left undefined.
+		if(compressed){
+			glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, format, w, h, depth, 0,
+					bc_size(w, h, alpha)*depth, nullptr);
+		}else{
+			state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA, w, h, depth, 0, GL_RGBA,
+					GL_UNSIGNED_BYTE, nullptr);
+		}
+		for(GLsizei layer = 0; layer < depth; ++layer){
+			texture_data &data = *layers[layer];
+			if(!data.valid)
+				continue;
+			if(compressed){
+				const unsigned char *blocks = data.cooked.levels[level];
+				size_t size = data.cooked.levelSizes[level];
+				if(alpha && data.cooked.format == TEXBIN_BC1){
+					widened.resize(size*2);
+					bc1_to_bc3(blocks, size, widened.data());
+					blocks = widened.data();
+					size = widened.size();
+				}
+				glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, w, h, 1,
+						format, size, blocks);
+			}else{
+				state_bind_buffer(GL_PIXEL_UNPACK_BUFFER, data.staging);
+				glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, w, h, 1, GL_RGBA,
+						GL_UNSIGNED_BYTE, bases[layer] + mip_offset(width, height, level));
+			}
+		}
+	}
+	if(!compressed){
+		for(size_t i = 0; i < layers.size(); ++i)
+			free_staged(*layers[i]);
+	}
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
+	asset.ready = true;
+	for(size_t i = 0; i < layers.size(); ++i){
+		const texture_data &data = *layers[i];
+		if(data.valid)
+			std::cout<<data.filename<<": layer "<<i<<", "<<data.width<<"x"<<data.height
+				<<(!data.compressed? " RGBA": data.cooked.format == TEXBIN_BC1? " BC1": " BC3")
+				<<", "<<texture_bytes(data)/1024<<" KB, decoded in "<<data.decodeTime<<" ms"
+				<<std::endl;
+	}
+	std::cout<<layers.size()<<" layers of "<<width<<"x"<<height
+		<<(!compressed? " RGBA": alpha? " BC3": " BC1")<<", "<<bytes/1024
+		<<" KB, uploaded in "<<elapsed_ms(start)<<" ms"<<std::endl;
+}
+
+/* A new asset in the map with one reference and an empty texture. */
+static texture_asset *new_texture(const std::string &key, GLenum target)
+{
+	texture_asset *texture = new texture_asset;
+	texture->key = key;
+	texture->refCount = 1;
+	texture->ready = false;
+	texture->target = target;
+	glGenTextures(1, &texture->texture);
+	textures[key] = texture;
+	return texture;
+}
+
+/* The shared texture of 'key' with one more reference, or nullptr. */
+static texture_asset *find_texture(const std::string &key)
+{
+	std::map<std::string, texture_asset *>::iterator it = textures.find(key);
+	if(it == textures.end())
+		return nullptr;
+	++it->second->refCount;
+	return it->second;
+}
+
+texture_asset *acquire_texture(const char *bmpfile)
+{
+	std::string key = canonical_path(bmpfile);
+	texture_asset *texture = find_texture(key);
+	if(texture)
+		return texture;
+
+	texture = new_texture(key, GL_TEXTURE_2D);
+	texture_data data;
+	data.compress = compress_textures();
+	decode_texture(bmpfile, data);
+	if(data.valid && !data.compressed){
+		stage_texture(data);
+		convert_texture(data);
+	}
+	upload_texture(data, *texture);
+	return texture;
+}
+
+/* The key of an array: its size and the canonical paths of its layers. */
+static std::string texture_array_key(const std::vector<std::string> &bmpfiles,
+		unsigned int width, unsigned int height)
+{
+	std::ostringstream key;
+	key<<"array "<<width<<"x"<<height;
+	for(size_t i = 0; i < bmpfiles.size(); ++i)
+		key<<"\n"<<canonical_path(bmpfiles[i].c_str());
+	return key.str();
+}
+
+texture_asset *acquire_texture_array(const std::vector<std::string> &bmpfiles,
+		unsigned int width, unsigned int height)
+{
+	std::string key = texture_array_key(bmpfiles, width, height);
+	texture_asset *texture = find_texture(key);
+	if(texture)
+		return texture;
+
+	texture = new_texture(key, GL_TEXTURE_2D_ARRAY);
+	const bool compressed = compress_textures();
+	std::vector<texture_data> data(bmpfiles.size());
+	std::vector<texture_data *> layers;
+	for(size_t i = 0; i < data.size(); ++i){
+		data[i].compress = compressed;
+		data[i].width = width;
+		data[i].height = height;
+		decode_texture(bmpfiles[i].c_str(), data[i]);
+		if(data[i].valid && !data[i].compressed){
+			stage_texture(data[i]);
+			convert_texture(data[i]);
+		}
+		layers.push_back(&data[i]);
+	}
+	upload_texture_array(layers, width, height, compressed, *texture);
+	for(size_t i = 0; i < data.size(); ++i)
+		texbin_close(data[i].cooked);
+	return texture;
+}
+
+void release_texture(texture_asset *texture)
+{
+	if(!texture || --texture->refCount > 0)
+		return;
+	textures.erase(texture->key);
+	state_delete_textures(1, &texture->texture);
+	delete texture;
+}
+
+struct texture_array_build;
+
+/* The decoding of one asset of acquire_*_async(), or of one layer of an
+ * array. The job holds a reference to its asset, so the asset outlives it even
+ * if every object releases it; the layers share the reference of their array.
+ */
+struct load_job {
+	mesh_asset *mesh;	// Either the mesh, the texture or the array
+	texture_asset *texture;
+	texture_array_build *array;
+	unsigned int layer;
+	std::string filename;
+	mesh_options options;
+	mesh_data meshData;
+	texture_data textureData;
+	size_t bytes;	// Bytes to upload
+};
+
+static std::vector<std::thread> loaderThreads;
+static std::mutex loaderMutex;
+static std::condition_variable loaderWake;
+static std::deque<load_job *> decodeQueue;	// Waiting for a thread, guarded by loaderMutex
+static std::deque<load_job *> uploadQueue;	// Decoded, guarded by loaderMutex
+static bool loaderStopping = false;
+static size_t loadingAssets = 0;	// Jobs not uploaded yet, GL thread only
+
+/* An array of acquire_texture_array_async(). Its decoded layers wait here and
+ * are uploaded together once the last one is decoded.
+ */
+struct texture_array_build {
+	texture_asset *texture;
+	unsigned int width, height;
+	bool compressed;
+	std::vector<load_job *> layers;	// nullptr while decoding
+	size_t decoding;	// Layers not decoded yet
+};
+static std::vector<texture_array_build *> arrayBuilds;	// GL thread only
+
+static void loader_thread()
+{
+	tinyobj::LoadArena arena;
+	std::unique_lock<std::mutex> lock(loaderMutex);
+	for(;;){
+		while(decodeQueue.empty() && !loaderStopping)
+			loaderWake.wait(lock);
+		if(loaderStopping)
+			return;
+		load_job *job = decodeQueue.front();
+		decodeQueue.pop_front();
+
+		lock.unlock();
+		if(job->mesh){
+			// The other loader threads already keep the cores busy.
+			decode_mesh(job->filename.c_str(), job->options, arena, 1, job->meshData);
+			job->bytes = job->meshData.vertices.size() + job->meshData.indices.size();
+		}else if(!job->textureData.pixels){
+			decode_texture(job->filename.c_str(), job->textureData);
+			job->bytes = texture_bytes(job->textureData);
+		}else{
+			convert_texture(job->textureData);
+		}
+		lock.lock();
+		uploadQueue.push_back(job);
+	}
+}
+
+void start_asset_loader(unsigned int numThreads)
+{
+	if(!loaderThreads.empty())
+		return;
+	if(numThreads == 0)
+		numThreads = std::max(1u, std::thread::hardware_concurrency());
+	loaderStopping = false;
+	for(unsigned int i = 0; i < numThreads; ++i)
+		loaderThreads.push_back(std::thread(loader_thread));
+}
+
+static void queue_job(load_job *job)
+{
+	++loadingAssets;
+	std::lock_guard<std::mutex> lock(loaderMutex);
+	decodeQueue.push_back(job);
+	loaderWake.notify_one();
+}
+
+mesh_asset *acquire_mesh_async(const char *filename, const mesh_options &options)
+{
+	if(loaderThreads.empty())
+		return acquire_mesh(filename, options);
+	std::string key = mesh_key(filename, options);
+	mesh_asset *mesh = find_mesh(key);
+	if(mesh)
+		return mesh;
+
+	mesh = new_mesh(key);
+	load_job *job = new load_job;
+	job->mesh = mesh;
+	job->texture = nullptr;
+	job->array = nullptr;
+	job->filename = filename;
+	job->options = options;
+	++mesh->refCount;
+	queue_job(job);
+	return mesh;
+}
+
+/* A new texture of a grey texel until the image is uploaded. An array has one
+ * layer, which the shaders also get for the layers it does not have yet.
+ */
+static texture_asset *new_placeholder_texture(const std::string &key, GLenum target)
+{
+	texture_asset *texture = new_texture(key, target);
+	const unsigned char grey[4] = { 128, 128, 128, 255 };
+	state_bind_texture(0, target, texture->texture);
+	if(target == GL_TEXTURE_2D_ARRAY)
+		glTexImage3D(target, 0, GL_RGBA, 1, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+	else
+		glTexImage2D(target, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	return texture;
+}
+
+texture_asset *acquire_texture_async(const char *bmpfile)
+{
+	if(loaderThreads.empty())
+		return acquire_texture(bmpfile);
+	std::string key = canonical_path(bmpfile);
+	texture_asset *texture = find_texture(key);
+	if(texture)
+		return texture;
+
+	texture = new_placeholder_texture(key, GL_TEXTURE_2D);
+	load_job *job = new load_job;
+	job->mesh = nullptr;
+	job->texture = texture;
+	job->array = nullptr;
+	job->filename = bmpfile;
+	job->textureData.compress = compress_textures();
+	++texture->refCount;
+	queue_job(job);
+	return texture;
+}
+
+texture_asset *acquire_texture_array_async(const std::vector<std::string> &bmpfiles,
+		unsigned int width, unsigned int height)
+{
+	if(loaderThreads.empty())
+		return acquire_texture_array(bmpfiles, width, height);
+	std::string key = texture_array_key(bmpfiles, width, height);
+	texture_asset *texture = find_texture(key);
+	if(texture)
+		return texture;
+
+	texture = new_placeholder_texture(key, GL_TEXTURE_2D_ARRAY);
+	texture_array_build *array = new texture_array_build;
+	array->texture = texture;
+	array->width = width;
+	array->height = height;
+	array->compressed = compress_textures();
+	array->layers.assign(bmpfiles.size(), nullptr);
+	array->decoding = bmpfiles.size();
+	++texture->refCount;
+	arrayBuilds.push_back(array);
+	for(size_t i = 0; i < bmpfiles.size(); ++i){
+		load_job *job = new load_job;
+		job->mesh = nullptr;
+		job->texture = nullptr;
+		job->array = array;
+		job->layer = i;
+		job->filename = bmpfiles[i];
+		job->textureData.compress = array->compressed;
+		job->textureData.width = width;
+		job->textureData.height = height;
+		queue_job(job);
+	}
+	return texture;
+}
+
+/* Drop the reference of 'job' to its asset and delete it. */
+static void finish_job(load_job *job)
+{
+	--loadingAssets;
+	if(job->textureData.valid)
+		bmp_close(job->textureData.image);
+	if(job->textureData.pixels)
+		unstage_texture(job->textureData);
+	texbin_close(job->textureData.cooked);
+	release_mesh(job->mesh);
+	release_texture(job->texture);
+	delete job;
+}
+
+/* Finish the decoded layers of 'array', drop its reference and delete it. */
+static void finish_array(texture_array_build *array)
+{
+	for(size_t i = 0; i < array->layers.size(); ++i){
+		if(array->layers[i])
+			finish_job(array->layers[i]);
+	}
+	arrayBuilds.erase(std::find(arrayBuilds.begin(), arrayBuilds.end(), array));
+	release_texture(array->texture);
+	delete array;
+}
+
+/* Upload the array of a decoded layer if that was its last layer. */
+static size_t upload_array_layer(load_job *job)
+{
+	texture_array_build *array = job->array;
+	array->layers[job->layer] = job;
+	if(--array->decoding > 0)
+		return 0;
+
+	size_t bytes = 0;
+	std::vector<texture_data *> layers;
+	for(size_t i = 0; i < array->layers.size(); ++i){
+		layers.push_back(&array->layers[i]->textureData);
+		bytes += array->layers[i]->bytes;
+	}
+	if(array->texture->refCount > 1)
+		upload_texture_array(layers, array->width, array->height, array->compressed,
+				*array->texture);
+	finish_array(array);
+	return bytes;
+}
+
+size_t upload_loaded_assets(size_t budget)
+{
+	size_t uploaded = 0;
+	for(size_t count = 0; count == 0 || uploaded < budget; ++count){
+		load_job *job;
+		{
+			std::lock_guard<std::mutex> lock(loaderMutex);
+			if(uploadQueue.empty())
+				break;
+			job = uploadQueue.front();
+			uploadQueue.pop_front();
+		}
+		// A texture goes back to the loader threads once its mip chain has
+		// memory, which must be mapped here. The staged memory counts against
+		// the budget too, so the textures in flight stay bounded.
+		texture_data &textureData = job->textureData;
+		texture_asset *texture = job->array? job->array->texture: job->texture;
+		if(texture && texture->refCount > 1 && textureData.valid &&
+				!textureData.compressed && !textureData.pixels){
+			stage_texture(textureData);
+			uploaded += job->bytes;
+			std::lock_guard<std::mutex> lock(loaderMutex);
+			decodeQueue.push_back(job);
+			loaderWake.notify_one();
+			continue;
+		}
+
+		if(job->array){
+			uploaded += upload_array_layer(job);
+			continue;
+		}
+
+		// Nothing to upload if every object released the asset meanwhile. A
+		// mesh which cannot be loaded keeps its placeholder.
+		if(job->mesh && !job->meshData.error.empty())
+			std::cerr<<job->meshData.error<<std::endl;
+		else if(job->mesh && job->mesh->refCount > 1)
+			upload_mesh(job->meshData, *job->mesh);
+		else if(job->texture && job->texture->refCount > 1)
+			upload_texture(job->textureData, *job->texture);
+		uploaded += job->bytes;
+		finish_job(job);
+	}
+	return loadingAssets;
+}
+
+void stop_asset_loader()
+{
+	{
+		std::lock_guard<std::mutex> lock(loaderMutex);
+		loaderStopping = true;
+		loaderWake.notify_all();
+	}
+	for(size_t i = 0; i < loaderThreads.size(); ++i)
+		loaderThreads[i].join();
+	loaderThreads.clear();
+
+	// The assets of the jobs left keep their placeholders.
+	while(!decodeQueue.empty()){
+		finish_job(decodeQueue.front());
+		decodeQueue.pop_front();
+	}
+	while(!uploadQueue.empty()){
+		finish_job(uploadQueue.front());
+		uploadQueue.pop_front();
+	}
+	while(!arrayBuilds.empty())
+		finish_array(arrayBuilds.back());
+}
+
+size_t loaded_meshes()
+{
+	return meshes.size();
+}
+
+size_t loaded_textures()
+{
+	return textures.size();
+}
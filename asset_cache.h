@@ -0,0 +1,130 @@
+#ifndef _ASSET_CACHE_H
+#define _ASSET_CACHE_H
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "mesh_simplify.h"
+
+/* Shared GPU meshes and textures.
+ *
+ * Assets are keyed by the canonical path of their file plus the options they
+ * are loaded with, so loading the same file twice, even through another
+ * relative path, returns the same asset. Every acquire_* must be paired with a
+ * release_*; the GL objects are deleted when the last user releases the asset.
+ *
+ * The acquire_*_async functions return at once and leave the decoding of the
+ * file to the threads of start_asset_loader(). The GL thread uploads the
+ * decoded assets in upload_loaded_assets(), a few per frame, and the assets
+ * are not ready until then. Textures make their mipmaps on the loader
+ * threads, in a pixel buffer the GL thread maps for them. The layers of an
+ * array are decoded in parallel and uploaded together.
+ */
+
+struct mesh_options {
+	bool compactVertices;	// The 16-byte vertex format of vertex_format.h
+	unsigned int lodLevels;	// Levels of build_lod_chain, 1 for the full mesh only
+	// Locations enabled with divisor 1 when the vertex array is made. The
+	// caller points them at its instances before drawing.
+	unsigned int firstInstanceAttribute, numInstanceAttributes;
+};
+
+struct mesh_asset {
+	std::string key;
+	int refCount;
+	bool ready;	// False while it loads asynchronously
+	unsigned int vao;
+	unsigned int vbo[2];	// Vertex buffer and index buffer
+	bool compactVertices;	// The vertex format of vbo[0], see set_vertex_attributes()
+	unsigned int indexType;	// GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+	glm::vec3 positionOffset, positionScale;	// Dequantization of the positions
+	glm::vec3 boundingCenter;	// Bounding sphere in object space
+	float boundingRadius;
+	std::vector<mesh_lod> lods;	// Ranges of the index buffer, lods[0] is the full mesh
+};
+
+struct texture_asset {
+	std::string key;
+	int refCount;
+	bool ready;	// False while it loads asynchronously, then it is a grey texel
+	unsigned int target;	// GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY
+	unsigned int texture;
+};
+
+/* Return the shared mesh of the first shape in an OBJ file, loading it if no
+ * one holds it yet. Exit if the file cannot be loaded.
+ */
+mesh_asset *acquire_mesh(const char *filename, const mesh_options &options);
+
+enum sphere_type {
+	SPHERE_UV,	// Latitude-longitude sphere, 'tessellation' segments and half as many rings
+	SPHERE_ICO	// Icosphere, 'tessellation' subdivisions
+};
+
+struct sphere_options {
+	sphere_type type;
+	float radius;
+	unsigned int tessellation;
+};
+
+/* Return a shared procedural sphere of sphere_mesh.h. Its levels of detail
+ * are coarser tessellations of the same sphere instead of simplified meshes.
+ */
+mesh_asset *acquire_sphere(const sphere_options &sphere, const mesh_options &options);
+
+/* Drop one reference to 'mesh' and delete it if that was the last one. */
+void release_mesh(mesh_asset *mesh);
+
+/* Enable and point the position, texcoord and normal attributes, locations 0
+ * to 2, of the bound vertex array at the bound GL_ARRAY_BUFFER: packed_vertex
+ * of vertex_format.h if 'compactVertices', interleaved floats otherwise.
+ */
+void set_vertex_attributes(bool compactVertices);
+
+/* Return the shared mipmapped texture of a BMP file, loading it if no one
+ * holds it yet. A file which cannot be read gives an empty texture.
+ */
+texture_asset *acquire_texture(const char *bmpfile);
+
+/* Return the shared GL_TEXTURE_2D_ARRAY with a layer per BMP file, in order,
+ * every layer resized to width x height, so objects with different images can
+ * be drawn without binding another texture. Compressed layers are all BC1, or
+ * all BC3 if any of them has alpha. A file which cannot be read gives an
+ * undefined layer.
+ */
+texture_asset *acquire_texture_array(const std::vector<std::string> &bmpfiles,
+		unsigned int width, unsigned int height);
+
+/* Drop one reference to 'texture' and delete it if that was the last one. */
+void release_texture(texture_asset *texture);
+
+/* Start 'numThreads' threads which decode the files of the acquire_*_async
+ * functions, 0 for one per core.
+ */
+void start_asset_loader(unsigned int numThreads);
+
+/* Like acquire_mesh() and acquire_texture(), but the files are decoded by the
+ * loader threads. Load synchronously if the loader is not started. A mesh
+ * which cannot be loaded is reported on the GL thread and never gets ready.
+ */
+mesh_asset *acquire_mesh_async(const char *filename, const mesh_options &options);
+texture_asset *acquire_texture_async(const char *bmpfile);
+texture_asset *acquire_texture_array_async(const std::vector<std::string> &bmpfiles,
+		unsigned int width, unsigned int height);
+
+/* Upload decoded assets to GL until about 'budget' bytes are uploaded or
+ * staged for the loader threads, at least one asset if any is decoded. Call it
+ * from the GL thread once a frame.
+ * Return:
+ * - The number of assets still loading.
+ */
+size_t upload_loaded_assets(size_t budget);
+
+/* Stop the loader threads. Assets which are not loaded yet stay not ready. */
+void stop_asset_loader();
+
+/* Number of meshes and textures currently loaded. */
+size_t loaded_meshes();
+size_t loaded_textures();
+
+#endif // _ASSET_CACHE_H
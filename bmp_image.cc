@@ -0,0 +1,136 @@
+#include "bmp_image.h"
+
+#include "mapped_file.h"
+
+// BGR to RGBA with SSSE3, chosen at run time so the Makefile needs no -mssse3.
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__)) \
+	&& !defined(BMP_IMAGE_NO_SIMD)
+#include <tmmintrin.h>
+#define BMP_IMAGE_SSSE3
+#endif
+
+#define BMP_FILE_HEADER_SIZE 14
+#define BMP_INFO_HEADER_SIZE 40
+#define BMP_RGB 0
+#define BMP_BITFIELDS 3
+
+static unsigned int read_u16(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static unsigned int read_u32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+bool bmp_open(const char *filename, bmp_image &image)
+{
+	image.file = map_file(filename, &image.fileSize);
+	if(!image.file)
+		return false;
+	const unsigned char *data = static_cast<const unsigned char *>(image.file);
+
+	bool valid = image.fileSize >= BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE &&
+		data[0] == 'B' && data[1] == 'M';
+	if(valid){
+		const unsigned char *info = data + BMP_FILE_HEADER_SIZE;
+		size_t offset = read_u32(data + 10);
+		int width = (int)read_u32(info + 4);
+		int height = (int)read_u32(info + 8);
+		unsigned int compression = read_u32(info + 16);
+		image.bits = read_u16(info + 14);
+		image.topDown = height < 0;
+		image.width = width;
+		image.height = height < 0? 0u - (unsigned int)height: height;
+		image.rowStride = ((size_t)image.bits*image.width + 31)/32*4;
+
+		// Bit fields are only accepted with the masks of BGRA.
+		bool bitfields = compression == BMP_BITFIELDS && image.bits == 32 &&
+			read_u32(info) >= BMP_INFO_HEADER_SIZE + 12 &&
+			image.fileSize >= BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE + 12 &&
+			read_u32(info + 40) == 0x00ff0000 && read_u32(info + 44) == 0x0000ff00 &&
+			read_u32(info + 48) == 0x000000ff;
+		valid = read_u32(info) >= BMP_INFO_HEADER_SIZE && read_u16(info + 12) == 1 &&
+			width > 0 && height != 0 && width <= 65536 && image.height <= 65536 &&
+			(image.bits == 24 || image.bits == 32) &&
+			(compression == BMP_RGB || bitfields) &&
+			offset <= image.fileSize &&
+			image.rowStride*image.height <= image.fileSize - offset;
+		image.pixels = data + offset;
+	}
+	if(!valid){
+		bmp_close(image);
+		return false;
+	}
+	return true;
+}
+
+void bmp_close(bmp_image &image)
+{
+	if(image.file)
+		unmap_file(image.file, image.fileSize);
+	image.file = nullptr;
+}
+
+static void convert_row(const unsigned char *in, unsigned char *out, unsigned int width,
+		unsigned int bits)
+{
+	if(bits == 24){
+		for(unsigned int x = 0; x < width; ++x, in += 3, out += 4){
+			out[0] = in[2];
+			out[1] = in[1];
+			out[2] = in[0];
+			out[3] = 255;
+		}
+	}else{
+		for(unsigned int x = 0; x < width; ++x, in += 4, out += 4){
+			out[0] = in[2];
+			out[1] = in[1];
+			out[2] = in[0];
+			out[3] = in[3];
+		}
+	}
+}
+
+#ifdef BMP_IMAGE_SSSE3
+/* convert_row() four pixels at a time. The loads never go past the row. */
+__attribute__((target("ssse3")))
+static void convert_row_ssse3(const unsigned char *in, unsigned char *out, unsigned int width,
+		unsigned int bits)
+{
+	unsigned int x = 0;
+	if(bits == 24){
+		const __m128i shuffle = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+		const __m128i alpha = _mm_set1_epi32(0xff000000);
+		// 16 bytes are loaded for 12 bytes of pixels.
+		for(; x + 6 <= width; x += 4, in += 12, out += 16){
+			__m128i bgr = _mm_loadu_si128((const __m128i *)in);
+			_mm_storeu_si128((__m128i *)out, _mm_or_si128(_mm_shuffle_epi8(bgr, shuffle), alpha));
+		}
+	}else{
+		const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+		for(; x + 4 <= width; x += 4, in += 16, out += 16){
+			__m128i bgra = _mm_loadu_si128((const __m128i *)in);
+			_mm_storeu_si128((__m128i *)out, _mm_shuffle_epi8(bgra, shuffle));
+		}
+	}
+	convert_row(in, out, width - x, bits);
+}
+#endif
+
+void bmp_to_rgba(const bmp_image &image, unsigned char *rgba)
+{
+	void (*convert)(const unsigned char *, unsigned char *, unsigned int, unsigned int) = convert_row;
+#ifdef BMP_IMAGE_SSSE3
+	static const bool ssse3 = __builtin_cpu_supports("ssse3");
+	if(ssse3)
+		convert = convert_row_ssse3;
+#endif
+	const size_t outStride = (size_t)image.width*4;
+	for(unsigned int y = 0; y < image.height; ++y){
+		// Rows go bottom up, so a top-down file is flipped.
+		unsigned int row = image.topDown? image.height - 1 - y: y;
+		convert(image.pixels + row*image.rowStride, rgba + y*outStride, image.width, image.bits);
+	}
+}
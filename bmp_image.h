@@ -0,0 +1,38 @@
+#ifndef _BMP_IMAGE_H
+#define _BMP_IMAGE_H
+
+#include <cstddef>
+
+/* Uncompressed 24-bit and 32-bit BMP files, mapped instead of read.
+ *
+ * bmp_open() checks the headers and that every row lies inside the file, so
+ * bmp_to_rgba() can convert straight from the mapping into the destination,
+ * usually a mapped pixel buffer object.
+ */
+
+struct bmp_image {
+	void *file;	// The mapping of map_file()
+	size_t fileSize;
+	const unsigned char *pixels;	// The first row in the file
+	unsigned int width, height;
+	unsigned int bits;	// 24 or 32
+	size_t rowStride;	// Bytes from one row to the next in the file, with the padding
+	bool topDown;	// The first row in the file is the top of the image
+	bmp_image(): file(nullptr), fileSize(0), pixels(nullptr), width(0), height(0), bits(0),
+		rowStride(0), topDown(false) {}
+};
+
+/* Map and check a BMP file.
+ * Return:
+ * - False if the file cannot be read or is not an uncompressed 24/32-bit BMP.
+ */
+bool bmp_open(const char *filename, bmp_image &image);
+
+void bmp_close(bmp_image &image);
+
+/* Convert to width*height tightly packed RGBA pixels, the bottom row first as
+ * glTexImage2D expects. The alpha of 24-bit images is 255.
+ */
+void bmp_to_rgba(const bmp_image &image, unsigned char *rgba);
+
+#endif // _BMP_IMAGE_H
@@ -0,0 +1,232 @@
+/* Checks that bmp_open() rejects broken BMP files and that bmp_to_rgba()
+ * converts the accepted ones to the right pixels.
+ *
+ * Usage: bmp_image_test
+ *
+ * The test file is written to the working directory and removed again. Build
+ * with -DBMP_IMAGE_NO_SIMD to test the scalar conversion instead of SSSE3.
+ */
+
+#include <climits>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "bmp_image.h"
+#include "mapped_file.h"
+
+#define TEST_BMP "bmp_image_test.bmp"
+
+static int failures = 0;
+
+static void fail(const std::string &what)
+{
+	failures++;
+	std::cerr << "FAIL: " << what << std::endl;
+}
+
+static void write_u16(std::vector<unsigned char> &file, size_t at, unsigned int value)
+{
+	file[at] = value & 0xff;
+	file[at + 1] = (value >> 8) & 0xff;
+}
+
+static void write_u32(std::vector<unsigned char> &file, size_t at, unsigned int value)
+{
+	write_u16(file, at, value & 0xffff);
+	write_u16(file, at + 2, value >> 16);
+}
+
+/* The RGBA of pixel (x, y), y counting from the bottom row. */
+static void pixel(unsigned int x, unsigned int y, unsigned char rgba[4])
+{
+	rgba[0] = (unsigned char)(x*37 + y*11);
+	rgba[1] = (unsigned char)(x*5 + y*71 + 3);
+	rgba[2] = (unsigned char)(x*x + y*13 + 7);
+	rgba[3] = (unsigned char)(x*97 + y*29 + 1);
+}
+
+/* A BMP file of 'width' x |height| pixels of pixel(), top-down if 'height' is
+ * negative. 32-bit files with BMP_BITFIELDS get the masks of BGRA.
+ */
+static std::vector<unsigned char> make_bmp(int width, int height, unsigned int bits,
+		unsigned int compression)
+{
+	const bool bitfields = compression == 3;
+	const size_t headers = 14 + 40 + (bitfields? 12: 0);
+	const unsigned int rows = height < 0? 0u - (unsigned int)height: height;
+	const size_t rowStride = ((size_t)bits*width + 31)/32*4;
+	std::vector<unsigned char> file(headers + rowStride*rows, 0);
+
+	file[0] = 'B';
+	file[1] = 'M';
+	write_u32(file, 2, file.size());
+	write_u32(file, 10, headers);
+	write_u32(file, 14, 40 + (bitfields? 12: 0));
+	write_u32(file, 18, width);
+	write_u32(file, 22, height);
+	write_u16(file, 26, 1);
+	write_u16(file, 28, bits);
+	write_u32(file, 30, compression);
+	if(bitfields){
+		write_u32(file, 54, 0x00ff0000);
+		write_u32(file, 58, 0x0000ff00);
+		write_u32(file, 62, 0x000000ff);
+	}
+
+	for(unsigned int row = 0; row < rows; ++row){
+		unsigned int y = height < 0? rows - 1 - row: row;
+		for(int x = 0; x < width; ++x){
+			unsigned char rgba[4];
+			pixel(x, y, rgba);
+			unsigned char *p = &file[headers + row*rowStride + x*bits/8];
+			p[0] = rgba[2];
+			p[1] = rgba[1];
+			p[2] = rgba[0];
+			if(bits == 32)
+				p[3] = rgba[3];
+		}
+	}
+	return file;
+}
+
+/* Open 'file' with bmp_open(). */
+static bool opens(const std::vector<unsigned char> &file, bmp_image &image)
+{
+	if(!replace_file(TEST_BMP, file.data(), file.size())){
+		fail("cannot write " TEST_BMP);
+		return false;
+	}
+	return bmp_open(TEST_BMP, image);
+}
+
+static void expect_pixels(const std::vector<unsigned char> &file, const std::string &name)
+{
+	bmp_image image;
+	if(!opens(file, image)){
+		fail(name + " is rejected");
+		return;
+	}
+	std::vector<unsigned char> rgba((size_t)image.width*image.height*4);
+	bmp_to_rgba(image, rgba.data());
+	bmp_close(image);
+
+	for(unsigned int y = 0; y < image.height; ++y)
+		for(unsigned int x = 0; x < image.width; ++x){
+			unsigned char expected[4];
+			pixel(x, y, expected);
+			if(image.bits == 24)
+				expected[3] = 255;
+			const unsigned char *p = &rgba[((size_t)y*image.width + x)*4];
+			if(p[0] != expected[0] || p[1] != expected[1] || p[2] != expected[2] ||
+					p[3] != expected[3]){
+				fail(name + ": pixel " + std::to_string(x) + ", " + std::to_string(y));
+				return;
+			}
+		}
+}
+
+static void expect_rejected(const std::vector<unsigned char> &file, const std::string &name)
+{
+	bmp_image image;
+	if(opens(file, image)){
+		fail(name + " is accepted");
+		bmp_close(image);
+	}
+}
+
+static void test_pixels()
+{
+	// Widths around the four pixels of the SSSE3 loop, with and without row padding.
+	for(int width = 1; width <= 13; ++width){
+		std::string size = std::to_string(width) + "x3";
+		expect_pixels(make_bmp(width, 3, 24, 0), size + " 24-bit");
+		expect_pixels(make_bmp(width, -3, 24, 0), size + " 24-bit top-down");
+		expect_pixels(make_bmp(width, 3, 32, 0), size + " 32-bit");
+		expect_pixels(make_bmp(width, -3, 32, 3), size + " 32-bit top-down bit fields");
+	}
+}
+
+static void test_rejected()
+{
+	const std::vector<unsigned char> good = make_bmp(7, 5, 24, 0);
+	std::vector<unsigned char> file;
+
+	// Truncated files.
+	expect_rejected(std::vector<unsigned char>(good.begin(), good.end() - 1), "a file without its last byte");
+	expect_rejected(std::vector<unsigned char>(good.begin(), good.begin() + 53), "a file shorter than the headers");
+	expect_rejected(std::vector<unsigned char>(good.begin(), good.begin() + 2), "a file of only the magic");
+
+	// Junk headers.
+	file = good;
+	file[1] = 'A';
+	expect_rejected(file, "a file without the magic");
+	file = good;
+	write_u32(file, 14, 12);
+	expect_rejected(file, "an OS/2 info header");
+	file = good;
+	write_u16(file, 26, 2);
+	expect_rejected(file, "two planes");
+	file = good;
+	write_u16(file, 28, 16);
+	expect_rejected(file, "16 bits per pixel");
+	file = good;
+	write_u16(file, 28, 8);
+	expect_rejected(file, "8 bits per pixel");
+	file = good;
+	write_u32(file, 30, 1);
+	expect_rejected(file, "RLE compression");
+	file = good;
+	write_u32(file, 30, 3);
+	expect_rejected(file, "24-bit bit fields");
+	file = make_bmp(7, 5, 32, 3);
+	write_u32(file, 54, 0x000000ff);
+	write_u32(file, 62, 0x00ff0000);
+	expect_rejected(file, "bit fields of RGBA");
+	file = good;
+	write_u32(file, 18, 0);
+	expect_rejected(file, "a width of 0");
+	file = good;
+	write_u32(file, 18, -7);
+	expect_rejected(file, "a negative width");
+	file = good;
+	write_u32(file, 18, 1 << 20);
+	expect_rejected(file, "a width of 2^20");
+	file = good;
+	write_u32(file, 22, 0);
+	expect_rejected(file, "a height of 0");
+	file = good;
+	write_u32(file, 22, INT_MIN);
+	expect_rejected(file, "a height of INT_MIN");
+	file = good;
+	write_u32(file, 22, 6);
+	expect_rejected(file, "a height beyond the pixels");
+	file = good;
+	write_u32(file, 22, -6);
+	expect_rejected(file, "a top-down height beyond the pixels");
+
+	// Bad offsets of the pixels.
+	file = good;
+	write_u32(file, 10, good.size() + 1);
+	expect_rejected(file, "an offset past the end");
+	file = good;
+	write_u32(file, 10, 0xffffffff);
+	expect_rejected(file, "an offset of 2^32 - 1");
+	file = good;
+	write_u32(file, 10, 14 + 40 + 4);
+	expect_rejected(file, "an offset leaving too few pixels");
+}
+
+int main()
+{
+	test_pixels();
+	test_rejected();
+	std::remove(TEST_BMP);
+
+	if(failures){
+		std::cerr << failures << " failures" << std::endl;
+		return 1;
+	}
+	std::cout << "bmp_image_test: all passed" << std::endl;
+	return 0;
+}
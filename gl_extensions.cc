@@ -0,0 +1,24 @@
+#include "gl_extensions.h"
+
+#include <GL/glew.h>
+#include <cstring>
+
+bool has_extension(const char *name)
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for(GLint i = 0; i < count; ++i){
+		const char *extension = (const char *)glGetStringi(GL_EXTENSIONS, i);
+		if(extension && strcmp(extension, name) == 0)
+			return true;
+	}
+	return false;
+}
+
+bool has_version(int major, int minor)
+{
+	GLint contextMajor = 0, contextMinor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &contextMajor);
+	glGetIntegerv(GL_MINOR_VERSION, &contextMinor);
+	return contextMajor > major || (contextMajor == major && contextMinor >= minor);
+}
@@ -0,0 +1,16 @@
+#ifndef _GL_EXTENSIONS_H
+#define _GL_EXTENSIONS_H
+
+/* What the current GL context supports, asked on the GL thread.
+ *
+ * The GLEW_* flags of GLEW 1.13 are all false in a core profile, which has no
+ * GL_EXTENSIONS string, so these ask glGetStringi and GL_MAJOR_VERSION.
+ */
+
+/* Whether the context has the extension 'name'. */
+bool has_extension(const char *name);
+
+/* Whether the context is at least version major.minor. */
+bool has_version(int major, int minor);
+
+#endif // _GL_EXTENSIONS_H
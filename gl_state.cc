@@ -0,0 +1,315 @@
+#include "gl_state.h"
+
+#include <GL/glew.h>
+#include <iostream>
+
+// Compare the mirror with glGet* on every dropped call and in check_gl_state().
+#ifndef GL_STATE_DEBUG
+#define GL_STATE_DEBUG 0
+#endif
+
+/* A value of the mirror, unknown until it is set through this module. */
+struct mirrored {
+	bool known;
+	GLuint value;
+};
+
+/* A binding point or a texture target, and its glGetIntegerv query. */
+struct mirrored_target {
+	GLenum target;
+	GLenum query;
+};
+
+static const mirrored_target bufferTargets[] = {
+	{GL_ARRAY_BUFFER, GL_ARRAY_BUFFER_BINDING},
+	{GL_ELEMENT_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER_BINDING},
+	{GL_UNIFORM_BUFFER, GL_UNIFORM_BUFFER_BINDING},
+	{GL_PIXEL_UNPACK_BUFFER, GL_PIXEL_UNPACK_BUFFER_BINDING},
+	{GL_PIXEL_PACK_BUFFER, GL_PIXEL_PACK_BUFFER_BINDING},
+	{GL_COPY_READ_BUFFER, GL_COPY_READ_BUFFER_BINDING},
+	{GL_COPY_WRITE_BUFFER, GL_COPY_WRITE_BUFFER_BINDING},
+	{GL_SHADER_STORAGE_BUFFER, GL_SHADER_STORAGE_BUFFER_BINDING},
+	{GL_DRAW_INDIRECT_BUFFER, GL_DRAW_INDIRECT_BUFFER_BINDING},
+	{GL_PARAMETER_BUFFER_ARB, GL_PARAMETER_BUFFER_BINDING_ARB}
+};
+#define NUM_BUFFER_TARGETS (sizeof(bufferTargets)/sizeof(bufferTargets[0]))
+#define ELEMENT_ARRAY_INDEX 1	// Of GL_ELEMENT_ARRAY_BUFFER in bufferTargets
+
+static const mirrored_target textureTargets[] = {
+	{GL_TEXTURE_2D, GL_TEXTURE_BINDING_2D},
+	{GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BINDING_2D_ARRAY},
+	{GL_TEXTURE_3D, GL_TEXTURE_BINDING_3D},
+	{GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BINDING_CUBE_MAP}
+};
+#define NUM_TEXTURE_TARGETS (sizeof(textureTargets)/sizeof(textureTargets[0]))
+#define TEXTURE_UNITS 16	// GL 3.3 has at least 48, the others are not mirrored
+
+static const GLenum capabilities[] = {GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND};
+#define NUM_CAPABILITIES (sizeof(capabilities)/sizeof(capabilities[0]))
+
+static mirrored currentProgram, boundVertexArray, activeUnit;
+static mirrored boundBuffers[NUM_BUFFER_TARGETS];
+static mirrored boundTextures[TEXTURE_UNITS][NUM_TEXTURE_TARGETS];
+static mirrored enabled[NUM_CAPABILITIES];
+static mirrored blendSource, blendDestination;
+static gl_state_counters counters;
+
+/* The index of 'target' in 'targets', -1 if it is not mirrored. */
+static int find_target(const mirrored_target *targets, size_t count, GLenum target)
+{
+	for(size_t i = 0; i < count; ++i)
+		if(targets[i].target == target)
+			return i;
+	return -1;
+}
+
+static int find_capability(GLenum capability)
+{
+	for(size_t i = 0; i < NUM_CAPABILITIES; ++i)
+		if(capabilities[i] == capability)
+			return i;
+	return -1;
+}
+
+/* Set 'mirror' to 'value' and count the call.
+ * Return:
+ * - false if it already had the value and the call is dropped.
+ */
+static bool update(mirrored &mirror, GLuint value)
+{
+	if(mirror.known && mirror.value == value){
+		++counters.callsDropped;
+		return false;
+	}
+	mirror.known = true;
+	mirror.value = value;
+	++counters.callsIssued;
+	return true;
+}
+
+#if GL_STATE_DEBUG
+/* Report a difference between the mirror and what GL returns. */
+static void verify(const char *what, GLenum target, const mirrored &mirror, GLint actual)
+{
+	if(mirror.known && GLuint(actual) != mirror.value)
+		std::cerr<<"GL state: "<<what<<" 0x"<<std::hex<<target<<std::dec<<" is "<<actual
+			<<", the mirror has "<<mirror.value<<std::endl;
+}
+
+static void verify_integer(const char *what, GLenum query, const mirrored &mirror)
+{
+	GLint actual = 0;
+	glGetIntegerv(query, &actual);
+	verify(what, query, mirror, actual);
+}
+
+static void verify_capability(size_t i)
+{
+	verify("capability", capabilities[i], enabled[i], glIsEnabled(capabilities[i]));
+}
+
+/* Query the binding of a unit, selecting it for the query only. */
+static void verify_texture(size_t unit, size_t target)
+{
+	GLint active = 0, actual = 0;
+	glGetIntegerv(GL_ACTIVE_TEXTURE, &active);
+	glActiveTexture(GL_TEXTURE0 + unit);
+	glGetIntegerv(textureTargets[target].query, &actual);
+	glActiveTexture(active);
+	verify("texture binding", textureTargets[target].query, boundTextures[unit][target], actual);
+}
+#else
+// The checks compile away with their arguments.
+#define verify_integer(...) ((void)0)
+#define verify_capability(...) ((void)0)
+#define verify_texture(...) ((void)0)
+#endif
+
+bool state_use_program(unsigned int program)
+{
+	if(!update(currentProgram, program)){
+		verify_integer("program", GL_CURRENT_PROGRAM, currentProgram);
+		return false;
+	}
+	glUseProgram(program);
+	return true;
+}
+
+bool state_bind_vertex_array(unsigned int vao)
+{
+	if(!update(boundVertexArray, vao)){
+		verify_integer("vertex array", GL_VERTEX_ARRAY_BINDING, boundVertexArray);
+		return false;
+	}
+	glBindVertexArray(vao);
+	boundBuffers[ELEMENT_ARRAY_INDEX].known = false;
+	return true;
+}
+
+/* glActiveTexture unless 'unit' is active. */
+static void select_unit(unsigned int unit)
+{
+	if(update(activeUnit, unit))
+		glActiveTexture(GL_TEXTURE0 + unit);
+	else
+		verify_integer("active texture", GL_ACTIVE_TEXTURE, mirrored{true, GL_TEXTURE0 + unit});
+}
+
+bool state_bind_texture(unsigned int unit, unsigned int target, unsigned int texture)
+{
+	int i = find_target(textureTargets, NUM_TEXTURE_TARGETS, target);
+	if(unit < TEXTURE_UNITS && i != -1){
+		if(!update(boundTextures[unit][i], texture)){
+			verify_texture(unit, i);
+			return false;
+		}
+	}else
+		++counters.callsIssued;
+	select_unit(unit);
+	glBindTexture(target, texture);
+	return true;
+}
+
+bool state_bind_buffer(unsigned int target, unsigned int buffer)
+{
+	int i = find_target(bufferTargets, NUM_BUFFER_TARGETS, target);
+	if(i == -1)
+		++counters.callsIssued;
+	else if(!update(boundBuffers[i], buffer)){
+		verify_integer("buffer binding", bufferTargets[i].query, boundBuffers[i]);
+		return false;
+	}
+	glBindBuffer(target, buffer);
+	return true;
+}
+
+/* The generic binding point changed by an indexed bind. */
+static void bind_generic(GLenum target, GLuint buffer)
+{
+	int i = find_target(bufferTargets, NUM_BUFFER_TARGETS, target);
+	if(i != -1){
+		boundBuffers[i].known = true;
+		boundBuffers[i].value = buffer;
+	}
+	++counters.callsIssued;
+}
+
+void state_bind_buffer_base(unsigned int target, unsigned int index, unsigned int buffer)
+{
+	bind_generic(target, buffer);
+	glBindBufferBase(target, index, buffer);
+}
+
+void state_bind_buffer_range(unsigned int target, unsigned int index, unsigned int buffer,
+		size_t offset, size_t size)
+{
+	bind_generic(target, buffer);
+	glBindBufferRange(target, index, buffer, offset, size);
+}
+
+bool state_enable(unsigned int capability, bool enable)
+{
+	int i = find_capability(capability);
+	if(i == -1)
+		++counters.callsIssued;
+	else if(!update(enabled[i], enable)){
+		verify_capability(i);
+		return false;
+	}
+	if(enable)
+		glEnable(capability);
+	else
+		glDisable(capability);
+	return true;
+}
+
+bool state_blend_func(unsigned int source, unsigned int destination)
+{
+	if(blendSource.known && blendSource.value == source &&
+			blendDestination.known && blendDestination.value == destination){
+		++counters.callsDropped;
+		verify_integer("blend source", GL_BLEND_SRC_RGB, blendSource);
+		verify_integer("blend destination", GL_BLEND_DST_RGB, blendDestination);
+		return false;
+	}
+	blendSource.known = blendDestination.known = true;
+	blendSource.value = source;
+	blendDestination.value = destination;
+	++counters.callsIssued;
+	glBlendFunc(source, destination);
+	return true;
+}
+
+/* Bindings of a deleted object fall back to 0. */
+static void unbind(mirrored &mirror, GLuint name)
+{
+	if(name != 0 && mirror.known && mirror.value == name)
+		mirror.value = 0;
+}
+
+void state_delete_program(unsigned int program)
+{
+	// A current program stays in use until another is, but its name may be
+	// given out again after that, so the next state_use_program() must not be
+	// dropped.
+	if(currentProgram.known && currentProgram.value == program)
+		currentProgram.known = false;
+	glDeleteProgram(program);
+}
+
+void state_delete_vertex_arrays(int n, const unsigned int *vaos)
+{
+	for(int i = 0; i < n; ++i)
+		if(vaos[i] != 0 && boundVertexArray.known && boundVertexArray.value == vaos[i]){
+			boundVertexArray.value = 0;
+			boundBuffers[ELEMENT_ARRAY_INDEX].known = false;
+		}
+	glDeleteVertexArrays(n, vaos);
+}
+
+void state_delete_textures(int n, const unsigned int *textures)
+{
+	for(int i = 0; i < n; ++i)
+		for(size_t unit = 0; unit < TEXTURE_UNITS; ++unit)
+			for(size_t target = 0; target < NUM_TEXTURE_TARGETS; ++target)
+				unbind(boundTextures[unit][target], textures[i]);
+	glDeleteTextures(n, textures);
+}
+
+void state_delete_buffers(int n, const unsigned int *buffers)
+{
+	for(int i = 0; i < n; ++i)
+		for(size_t target = 0; target < NUM_BUFFER_TARGETS; ++target)
+			unbind(boundBuffers[target], buffers[i]);
+	glDeleteBuffers(n, buffers);
+}
+
+void check_gl_state()
+{
+#if GL_STATE_DEBUG
+	verify_integer("program", GL_CURRENT_PROGRAM, currentProgram);
+	verify_integer("vertex array", GL_VERTEX_ARRAY_BINDING, boundVertexArray);
+	if(activeUnit.known)
+		verify_integer("active texture", GL_ACTIVE_TEXTURE, mirrored{true, GL_TEXTURE0 + activeUnit.value});
+	for(size_t i = 0; i < NUM_BUFFER_TARGETS; ++i)
+		verify_integer("buffer binding", bufferTargets[i].query, boundBuffers[i]);
+	for(size_t unit = 0; unit < TEXTURE_UNITS; ++unit)
+		for(size_t target = 0; target < NUM_TEXTURE_TARGETS; ++target)
+			if(boundTextures[unit][target].known)
+				verify_texture(unit, target);
+	for(size_t i = 0; i < NUM_CAPABILITIES; ++i)
+		verify_capability(i);
+	verify_integer("blend source", GL_BLEND_SRC_RGB, blendSource);
+	verify_integer("blend destination", GL_BLEND_DST_RGB, blendDestination);
+#endif
+}
+
+const gl_state_counters &get_gl_state_counters()
+{
+	return counters;
+}
+
+void reset_gl_state_counters()
+{
+	counters = gl_state_counters();
+}
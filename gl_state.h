@@ -0,0 +1,63 @@
+#ifndef _GL_STATE_H
+#define _GL_STATE_H
+
+#include <cstddef>
+
+/* A CPU mirror of the GL state the program binds, which drops the calls that
+ * would not change it.
+ *
+ * Every module binds the program, the vertex array, the textures of each
+ * unit and the buffer of each binding point, and sets the enable bits and the
+ * blend function, through these functions. Nothing is known at first, so the
+ * first call of each reaches GL. The element array buffer belongs to the
+ * vertex array, so binding another vertex array forgets it. The delete_*
+ * functions unbind the deleted objects from the mirror as GL does. Targets,
+ * units and capabilities the mirror does not keep are always passed on.
+ *
+ * Build with -DGL_STATE_DEBUG=1 to compare the mirror with glGet* on every
+ * dropped call and in check_gl_state(), reporting the differences.
+ */
+
+/* glUseProgram, glBindVertexArray, glActiveTexture with glBindTexture, and
+ * glBindBuffer.
+ * Return:
+ * - false if the call is dropped.
+ */
+bool state_use_program(unsigned int program);
+bool state_bind_vertex_array(unsigned int vao);
+bool state_bind_texture(unsigned int unit, unsigned int target, unsigned int texture);
+bool state_bind_buffer(unsigned int target, unsigned int buffer);
+
+/* glBindBufferBase and glBindBufferRange, which also bind the generic binding
+ * point of 'target'. Indexed bindings are not mirrored, so they are always
+ * called.
+ */
+void state_bind_buffer_base(unsigned int target, unsigned int index, unsigned int buffer);
+void state_bind_buffer_range(unsigned int target, unsigned int index, unsigned int buffer,
+		size_t offset, size_t size);
+
+/* glEnable or glDisable, and glBlendFunc. */
+bool state_enable(unsigned int capability, bool enabled);
+bool state_blend_func(unsigned int source, unsigned int destination);
+
+/* glDelete* of the objects, unbinding them from the mirror. */
+void state_delete_program(unsigned int program);
+void state_delete_vertex_arrays(int n, const unsigned int *vaos);
+void state_delete_textures(int n, const unsigned int *textures);
+void state_delete_buffers(int n, const unsigned int *buffers);
+
+/* Compare the whole mirror with GL in GL_STATE_DEBUG builds, otherwise do
+ * nothing. Call it once a frame.
+ */
+void check_gl_state();
+
+/* Calls of this module since the last reset_gl_state_counters(). */
+struct gl_state_counters {
+	unsigned long callsIssued;
+	unsigned long callsDropped;
+};
+
+const gl_state_counters &get_gl_state_counters();
+void reset_gl_state_counters();
+
+#endif // _GL_STATE_H
@@ -0,0 +1,301 @@
+#include "indirect_draw.h"
+
+#include <GL/glew.h>
+#include <cstring>
+#include <iostream>
+#include "gl_extensions.h"
+#include "gl_state.h"
+#include "shader_uniforms.h"
+#include "tiny_obj_loader.h"
+#include "vertex_format.h"
+
+/* The std430 structs of cull.glsl. */
+struct mesh_entry {
+	glm::vec4 boundingSphere;	// Center in object space and radius
+	GLuint firstLod;	// Into the lod table
+	GLuint numLods;
+	GLint baseVertex;	// Of the mesh in the merged vertex buffer
+	GLuint padding;
+};
+
+struct lod_entry {
+	GLuint numIndices;
+	GLuint firstIndex;	// In the merged index buffer
+	float error;
+	GLuint padding;
+};
+
+/* DrawElementsIndirectCommand of glMultiDrawElementsIndirect. */
+struct draw_command {
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// The shader storage bindings of cull.glsl.
+enum {
+	INSTANCE_BINDING,
+	OBJECT_BINDING,
+	MESH_BINDING,
+	LOD_BINDING,
+	GROUP_BINDING,
+	COMMAND_BINDING,
+	DRAW_COUNT_BINDING,
+	OBJECT_LOD_BINDING
+};
+
+#define CULL_GROUP_SIZE 64	// local_size_x of cull.glsl
+
+static unsigned int cullProgram = 0;
+static uniform<int> numObjectsUniform;
+static uniform<glm::vec3> cameraEyeUniform;
+static uniform<float> pixelScaleUniform, pixelErrorUniform, hysteresisUniform;
+
+static GLuint commandBuffer = 0, drawCountBuffer = 0;
+static GLuint objectLodBuffer = 0;	// The level of detail of every object, kept between frames
+static size_t objectLodCount = 0;
+static std::vector<indirect_group> culledGroups;	// Of the last cull_objects()
+
+/* Whether the draw counts are read by glMultiDrawElementsIndirectCountARB. */
+static bool drawCountParameter = false;
+
+bool indirect_draw_supported()
+{
+	// Besides compute shaders and storage buffers, cull.glsl is #version 430
+	// and the draw buffers are reset with glClearBufferData and synchronized
+	// with glMemoryBarrier, so the ARB extensions of an older context are not
+	// enough.
+	return has_version(4, 3);
+}
+
+/* The size of the buffer bound to 'target'. */
+static GLint buffer_size(GLenum target)
+{
+	GLint size = 0;
+	glGetBufferParameteriv(target, GL_BUFFER_SIZE, &size);
+	return size;
+}
+
+void merge_meshes(const std::vector<const mesh_asset *> &meshes, merged_meshes &merged)
+{
+	release_merged_meshes(merged);
+	merged.meshes = meshes;
+	if(meshes.empty())
+		return;
+
+	merged.indexType = GL_UNSIGNED_SHORT;
+	GLint vertexBytes = 0, indexCount = 0;
+	for(size_t i = 0; i < meshes.size(); ++i){
+		if(meshes[i]->indexType == GL_UNSIGNED_INT)
+			merged.indexType = GL_UNSIGNED_INT;
+		state_bind_buffer(GL_COPY_READ_BUFFER, meshes[i]->vbo[0]);
+		vertexBytes += buffer_size(GL_COPY_READ_BUFFER);
+		state_bind_buffer(GL_COPY_READ_BUFFER, meshes[i]->vbo[1]);
+		indexCount += buffer_size(GL_COPY_READ_BUFFER)/
+			(meshes[i]->indexType == GL_UNSIGNED_SHORT? sizeof(GLushort): sizeof(GLuint));
+	}
+	const size_t vertexSize = meshes[0]->compactVertices? sizeof(packed_vertex):
+		sizeof(GLfloat)*tinyobj::INTERLEAVED_STRIDE;
+	const size_t indexSize = merged.indexType == GL_UNSIGNED_SHORT? sizeof(GLushort): sizeof(GLuint);
+
+	glGenVertexArrays(1, &merged.vao);
+	glGenBuffers(2, merged.vbo);
+	state_bind_vertex_array(merged.vao);
+	state_bind_buffer(GL_ARRAY_BUFFER, merged.vbo[0]);
+	glBufferData(GL_ARRAY_BUFFER, vertexBytes, nullptr, GL_STATIC_DRAW);
+	state_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, merged.vbo[1]);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount*indexSize, nullptr, GL_STATIC_DRAW);
+
+	// The indices stay relative to their mesh, the commands add baseVertex.
+	std::vector<mesh_entry> meshTable(meshes.size());
+	std::vector<lod_entry> lodTable;
+	size_t firstVertex = 0, firstIndex = 0;
+	for(size_t i = 0; i < meshes.size(); ++i){
+		const mesh_asset &mesh = *meshes[i];
+		state_bind_buffer(GL_COPY_READ_BUFFER, mesh.vbo[0]);
+		GLint bytes = buffer_size(GL_COPY_READ_BUFFER);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_ARRAY_BUFFER, 0, firstVertex*vertexSize, bytes);
+		mesh_entry &entry = meshTable[i];
+		entry.boundingSphere = glm::vec4(mesh.boundingCenter, mesh.boundingRadius);
+		entry.firstLod = lodTable.size();
+		entry.numLods = mesh.lods.size();
+		entry.baseVertex = firstVertex;
+		entry.padding = 0;
+		firstVertex += bytes/vertexSize;
+
+		state_bind_buffer(GL_COPY_READ_BUFFER, mesh.vbo[1]);
+		bytes = buffer_size(GL_COPY_READ_BUFFER);
+		size_t numIndices;
+		if(mesh.indexType == merged.indexType){
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_ELEMENT_ARRAY_BUFFER, 0,
+					firstIndex*indexSize, bytes);
+			numIndices = bytes/indexSize;
+		}else{
+			// 16-bit indices among 32-bit ones, widened once on the CPU.
+			std::vector<GLushort> shortIndices(bytes/sizeof(GLushort));
+			glGetBufferSubData(GL_COPY_READ_BUFFER, 0, bytes, shortIndices.data());
+			std::vector<GLuint> indices(shortIndices.begin(), shortIndices.end());
+			glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, firstIndex*indexSize,
+					indices.size()*sizeof(GLuint), indices.data());
+			numIndices = indices.size();
+		}
+		for(size_t level = 0; level < mesh.lods.size(); ++level){
+			lod_entry lod;
+			lod.numIndices = mesh.lods[level].numIndices;
+			lod.firstIndex = firstIndex + mesh.lods[level].firstIndex;
+			lod.error = mesh.lods[level].error;
+			lod.padding = 0;
+			lodTable.push_back(lod);
+		}
+		firstIndex += numIndices;
+	}
+	set_vertex_attributes(meshes[0]->compactVertices);
+	state_bind_vertex_array(0);
+
+	glGenBuffers(1, &merged.meshTable);
+	state_bind_buffer(GL_SHADER_STORAGE_BUFFER, merged.meshTable);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(mesh_entry)*meshTable.size(), meshTable.data(),
+			GL_STATIC_DRAW);
+	glGenBuffers(1, &merged.lodTable);
+	state_bind_buffer(GL_SHADER_STORAGE_BUFFER, merged.lodTable);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(lod_entry)*lodTable.size(), lodTable.data(),
+			GL_STATIC_DRAW);
+}
+
+void release_merged_meshes(merged_meshes &merged)
+{
+	state_delete_vertex_arrays(1, &merged.vao);
+	state_delete_buffers(2, merged.vbo);
+	state_delete_buffers(1, &merged.meshTable);
+	state_delete_buffers(1, &merged.lodTable);
+	merged = merged_meshes();
+}
+
+bool start_indirect_draw(unsigned int program)
+{
+	cullProgram = program;
+	numObjectsUniform = find_uniform<int>(program, "numObjects");
+	cameraEyeUniform = find_uniform<glm::vec3>(program, "cameraEye");
+	pixelScaleUniform = find_uniform<float>(program, "pixelScale");
+	pixelErrorUniform = find_uniform<float>(program, "pixelError");
+	hysteresisUniform = find_uniform<float>(program, "hysteresis");
+	if(numObjectsUniform.location == -1 || cameraEyeUniform.location == -1 ||
+			pixelScaleUniform.location == -1 || pixelErrorUniform.location == -1 ||
+			hysteresisUniform.location == -1){
+		std::cerr<<"The culling program lacks the uniforms of cull.glsl"<<std::endl;
+		return false;
+	}
+
+	drawCountParameter = has_version(4, 6) || has_extension("GL_ARB_indirect_parameters");
+	glGenBuffers(1, &commandBuffer);
+	glGenBuffers(1, &drawCountBuffer);
+	glGenBuffers(1, &objectLodBuffer);
+	objectLodCount = 0;
+	return true;
+}
+
+void stop_indirect_draw()
+{
+	state_delete_buffers(1, &commandBuffer);
+	state_delete_buffers(1, &drawCountBuffer);
+	state_delete_buffers(1, &objectLodBuffer);
+	commandBuffer = drawCountBuffer = objectLodBuffer = 0;
+	cullProgram = 0;
+	culledGroups.clear();
+}
+
+/* Fill the buffer bound to GL_SHADER_STORAGE_BUFFER with zeros. */
+static void clear_storage_buffer()
+{
+	GLuint zero = 0;
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+}
+
+void cull_objects(const merged_meshes &merged, const stream_allocation &instances,
+		const std::vector<indirect_object> &objects, const std::vector<indirect_group> &groups,
+		const cull_view &view)
+{
+	culledGroups = groups;
+	if(objects.empty())
+		return;
+
+	// The objects and the first object of every group go through the stream
+	// buffer with the instances.
+	stream_allocation objectRange = stream_alloc(sizeof(indirect_object)*objects.size());
+	memcpy(objectRange.data, objects.data(), objectRange.size);
+	stream_allocation groupRange = stream_alloc(sizeof(GLuint)*groups.size());
+	for(size_t i = 0; i < groups.size(); ++i)
+		static_cast<GLuint *>(groupRange.data)[i] = groups[i].first;
+	flush_stream_buffer();
+	state_bind_buffer(GL_SHADER_STORAGE_BUFFER, drawCountBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint)*groups.size(), nullptr, GL_STREAM_DRAW);
+	clear_storage_buffer();
+	state_bind_buffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(draw_command)*objects.size(), nullptr,
+			GL_STREAM_DRAW);
+	// Without the draw counts the commands past them must draw nothing.
+	if(!drawCountParameter)
+		clear_storage_buffer();
+	// New objects start at the full mesh.
+	if(objectLodCount != objects.size()){
+		objectLodCount = objects.size();
+		state_bind_buffer(GL_SHADER_STORAGE_BUFFER, objectLodBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint)*objectLodCount, nullptr,
+				GL_DYNAMIC_COPY);
+		clear_storage_buffer();
+	}
+
+	state_bind_buffer_range(GL_SHADER_STORAGE_BUFFER, INSTANCE_BINDING, instances.buffer,
+			instances.offset, instances.size);
+	state_bind_buffer_range(GL_SHADER_STORAGE_BUFFER, OBJECT_BINDING, objectRange.buffer,
+			objectRange.offset, objectRange.size);
+	state_bind_buffer_base(GL_SHADER_STORAGE_BUFFER, MESH_BINDING, merged.meshTable);
+	state_bind_buffer_base(GL_SHADER_STORAGE_BUFFER, LOD_BINDING, merged.lodTable);
+	state_bind_buffer_range(GL_SHADER_STORAGE_BUFFER, GROUP_BINDING, groupRange.buffer,
+			groupRange.offset, groupRange.size);
+	state_bind_buffer_base(GL_SHADER_STORAGE_BUFFER, COMMAND_BINDING, commandBuffer);
+	state_bind_buffer_base(GL_SHADER_STORAGE_BUFFER, DRAW_COUNT_BINDING, drawCountBuffer);
+	state_bind_buffer_base(GL_SHADER_STORAGE_BUFFER, OBJECT_LOD_BINDING, objectLodBuffer);
+
+	set_uniform(numObjectsUniform, (int)objects.size());
+	set_uniform(cameraEyeUniform, view.eye);
+	set_uniform(pixelScaleUniform, view.pixelScale);
+	set_uniform(pixelErrorUniform, view.pixelError);
+	set_uniform(hysteresisUniform, view.hysteresis);
+	use_program(cullProgram);
+	glDispatchCompute((objects.size() + CULL_GROUP_SIZE - 1)/CULL_GROUP_SIZE, 1, 1);
+	// The commands and counts are read by the draws, the levels of detail by
+	// the next dispatch.
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void draw_indirect_group(const merged_meshes &merged, size_t group)
+{
+	const indirect_group &range = culledGroups[group];
+	if(range.count == 0)
+		return;
+	state_bind_buffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+	const void *commands = (const void *)(range.first*sizeof(draw_command));
+	if(drawCountParameter){
+		state_bind_buffer(GL_PARAMETER_BUFFER_ARB, drawCountBuffer);
+		glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, merged.indexType, commands,
+				group*sizeof(GLuint), range.count, 0);
+	}else
+		glMultiDrawElementsIndirect(GL_TRIANGLES, merged.indexType, commands, range.count, 0);
+}
+
+size_t visible_objects()
+{
+	if(culledGroups.empty())
+		return 0;
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	std::vector<GLuint> counts(culledGroups.size());
+	state_bind_buffer(GL_COPY_READ_BUFFER, drawCountBuffer);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(GLuint)*counts.size(), counts.data());
+	size_t visible = 0;
+	for(size_t i = 0; i < counts.size(); ++i)
+		visible += counts[i];
+	return visible;
+}
@@ -0,0 +1,97 @@
+#ifndef _INDIRECT_DRAW_H
+#define _INDIRECT_DRAW_H
+
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+#include "asset_cache.h"
+#include "stream_buffer.h"
+
+/* GPU-driven drawing with glMultiDrawElementsIndirect.
+ *
+ * The meshes are copied into one vertex buffer and one index buffer, so a
+ * single vertex array draws all of them. A compute shader, shader/cull.glsl,
+ * culls every object against the view frustum, selects its level of detail
+ * and writes a DrawElementsIndirectCommand for each visible one, so the CPU
+ * neither tests nor sorts the objects. The objects are drawn in groups which
+ * share a program and a texture; every command is one instance whose base
+ * instance is the index of the object in the instance buffer. The commands
+ * of a group are packed at its start and their number is written to a
+ * parameter buffer for glMultiDrawElementsIndirectCountARB. Without
+ * GL_ARB_indirect_parameters the unused commands are cleared to no
+ * instances and the whole group is drawn.
+ */
+
+/* Whether the context has compute shaders, shader storage buffers and
+ * glMultiDrawElementsIndirect, which means GL 4.3.
+ */
+bool indirect_draw_supported();
+
+/* Meshes sharing one vertex array. */
+struct merged_meshes {
+	unsigned int vao;
+	unsigned int vbo[2];	// Vertex buffer and index buffer
+	unsigned int indexType;	// GL_UNSIGNED_SHORT if all meshes have it, else GL_UNSIGNED_INT
+	unsigned int meshTable;	// Shader storage buffers of the bounding spheres and
+	unsigned int lodTable;	// the index ranges of the levels of detail
+	std::vector<const mesh_asset *> meshes;	// The object meshes index this
+	merged_meshes(): vao(0), indexType(0), meshTable(0), lodTable(0){ vbo[0] = vbo[1] = 0; }
+};
+
+/* Copy 'meshes', all ready and with the same vertex format, into 'merged',
+ * replacing what it held. The vertex array has the attributes of
+ * set_vertex_attributes() and the index buffer, nothing else.
+ */
+void merge_meshes(const std::vector<const mesh_asset *> &meshes, merged_meshes &merged);
+
+void release_merged_meshes(merged_meshes &merged);
+
+/* What cull.glsl knows of an object besides its instance data. */
+struct indirect_object {
+	unsigned int mesh;	// Index into merged_meshes::meshes
+	unsigned int group;	// Index into the groups of cull_objects()
+	unsigned int object;	// Stable index which keeps the level of detail between frames
+};
+
+/* A range of objects drawn with the same program and texture. */
+struct indirect_group {
+	unsigned int first;	// The first object of the group in the instance buffer
+	unsigned int count;
+};
+
+/* The camera for the levels of detail, the view frustum is the one of the
+ * Frame block.
+ */
+struct cull_view {
+	glm::vec3 eye;
+	float pixelScale;	// Pixels per unit of radius / distance
+	float pixelError;	// LOD_PIXEL_ERROR and LOD_HYSTERESIS of main.cpp
+	float hysteresis;
+};
+
+/* Set up the culling with the linked compute program of cull.glsl, whose
+ * Frame block is already bound.
+ * Return:
+ * - false, reported, if the program does not have the uniforms of cull.glsl.
+ */
+bool start_indirect_draw(unsigned int cullProgram);
+
+void stop_indirect_draw();
+
+/* Write the draw commands of 'objects'. The objects and 'instances', flushed
+ * stream buffer data, are in the order of the groups. The objects and groups
+ * are allocated from the stream buffer of this frame.
+ */
+void cull_objects(const merged_meshes &merged, const stream_allocation &instances,
+		const std::vector<indirect_object> &objects, const std::vector<indirect_group> &groups,
+		const cull_view &view);
+
+/* Draw group 'group' of the last cull_objects() with the vertex array of
+ * 'merged' bound.
+ */
+void draw_indirect_group(const merged_meshes &merged, size_t group);
+
+/* The objects the last cull_objects() found visible. Waits for the GPU. */
+size_t visible_objects();
+
+#endif // _INDIRECT_DRAW_H
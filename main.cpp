@@ -4,28 +4,162 @@
 #include <cstdlib>
 #include <string>
 #include <fstream>
+#include <cstddef>
+#include <cstring>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/rotate_vector.hpp>
 #include <vector>
-#include "tiny_obj_loader.h"
+#include <algorithm>
+#include "asset_cache.h"
+#include "shader_uniforms.h"
+#include "gl_state.h"
+#include "stream_buffer.h"
+#include "indirect_draw.h"
+#include "render_queue.h"
 
 #define GLM_FORCE_RADIANS
 
+// Upload meshes in the 16-byte vertex format of vertex_format.h instead of
+// 32-byte float vertices. Build with -DCOMPACT_VERTICES=0 to compare.
+#ifndef COMPACT_VERTICES
+#define COMPACT_VERTICES 1
+#endif
+
+// Level of detail: every mesh gets up to LOD_LEVELS levels, each with half the
+// triangles of the previous one. render() uses the coarsest level whose error
+// projects to less than LOD_PIXEL_ERROR pixels, and only switches once the
+// error is LOD_HYSTERESIS beyond that, so objects do not flicker between levels.
+#define LOD_LEVELS 5
+#define LOD_PIXEL_ERROR 1.0f
+#define LOD_HYSTERESIS 0.2f
+
+// Generate the spheres of the planets with sphere_mesh.h instead of loading
+// sun.obj and earth.obj. Their radii match the OBJ files.
+#ifndef PROCEDURAL_PLANETS
+#define PROCEDURAL_PLANETS 1
+#endif
+#define PLANET_SEGMENTS 64
+
+// Decode the OBJ and BMP files on LOADER_THREADS threads (0 for one per core)
+// while the window is already drawing. Every frame uploads up to UPLOAD_BUDGET
+// bytes of them; the objects show a grey sphere until theirs are uploaded.
+#ifndef ASYNC_LOADING
+#define ASYNC_LOADING 1
+#endif
+#define LOADER_THREADS 0
+#define UPLOAD_BUDGET (4 << 20)
+#define PLACEHOLDER_SEGMENTS 16
+
+// Put the textures of all the planets in the layers of one GL_TEXTURE_2D_ARRAY
+// of TEXTURE_ARRAY_WIDTH x TEXTURE_ARRAY_HEIGHT, resizing the images of other
+// sizes, so render() binds one texture for all of them.
+#ifndef TEXTURE_ARRAY
+#define TEXTURE_ARRAY 1
+#endif
+#define TEXTURE_ARRAY_WIDTH 1024
+#define TEXTURE_ARRAY_HEIGHT 512
+
+// The camera and the light are in the std140 Frame block of the shaders, and
+// the objects are instances with their own attributes, both written once a
+// frame. The draws are sorted by the keys of render_queue.h, and objects with
+// the same program, mesh, level of detail and texture are drawn with one
+// glDrawElementsInstanced; build with -DINSTANCED_DRAWS=0 for a draw per object.
+#define FRAME_BLOCK_BINDING 0
+#ifndef INSTANCED_DRAWS
+#define INSTANCED_DRAWS 1
+#endif
+
+// Both are written into the ring of stream_buffer.h, which starts with regions
+// of STREAM_REGION_SIZE bytes per frame and grows if a frame needs more.
+#define STREAM_REGION_SIZE (256 << 10)
+
+// Where the context has compute shaders and multi-draw indirect, cull the
+// objects and select their levels of detail on the GPU with shader/cull.glsl,
+// and draw all the meshes from shared buffers with one glMultiDrawElementsIndirect
+// per program and texture. Build with -DINDIRECT_DRAWS=0 for the draws above.
+#ifndef INDIRECT_DRAWS
+#define INDIRECT_DRAWS 1
+#endif
+
+// The camera, also needed to project the objects for the level of detail.
+#define CAMERA_FOVY 45.0f
+#define CAMERA_FAR 200.0f
+static const glm::vec3 cameraEye(30.0f);
+static int framebufferHeight = 600;
+
+// Drawn for the objects whose meshes are still loading.
+static mesh_asset *placeholderMesh = nullptr;
+
 struct object_struct{
 	unsigned int program;
-	unsigned int vao;
-	unsigned int vbo[4];
-	unsigned int texture;
+	mesh_asset *mesh;	// Shared with the other objects of the same OBJ file
+	texture_asset *texture;
+	int textureLayer;	// The layer of an array texture
 	glm::vec4 materialEmission;
+	int lod;	// The level of detail drawn in the last frame
 	glm::mat4 model;
-	object_struct(): model(glm::mat4(1.0f)){}
+	object_struct(): mesh(nullptr), texture(nullptr), textureLayer(0), lod(0), model(glm::mat4(1.0f)){}
 };
 
 std::vector<object_struct> objects;//vertex array object,vertex buffer object and texture(color) for objs
 unsigned int program, program2;
-std::vector<int> indicesCount;//Number of indice of objs
+
+/* The Frame block of the shaders. */
+struct frame_block {
+	glm::mat4 vp;	// View Projection matrix
+	glm::vec4 sunPosition;
+	glm::vec4 sunLightColor;
+	glm::vec4 planetAmbient;
+	glm::vec4 planetDiffuse;
+};
+
+/* The instance attributes of an object, locations 3 and up in vs.glsl. */
+#define FIRST_INSTANCE_ATTRIBUTE 3
+#define NUM_INSTANCE_ATTRIBUTES 9
+struct instance_data {
+	glm::mat4 model;
+	glm::vec4 planetEmission;
+	// Dequantization of the positions of the mesh. Ordered as cull.glsl reads
+	// the struct from a std430 buffer, where a vec3 is aligned to 16 bytes.
+	glm::vec3 positionOffset;
+	float rotateDeg;
+	glm::vec3 positionScale;
+	int textureLayer;
+};
+
+/* What an object draws in render(). */
+struct draw_item {
+	unsigned int program;
+	const mesh_asset *mesh;	// Its own or the placeholder
+	const texture_asset *texture;
+	int lod;
+};
+
+static frame_block frameData;
+static std::vector<draw_item> drawItems;	// Of objects[i] at i
+static std::vector<render_item> renderQueue;
+// The ranks of the keys in this frame.
+static std::vector<unsigned int> queuedPrograms;
+static std::vector<const mesh_asset *> queuedMeshes;
+static std::vector<const texture_asset *> queuedTextures;
+static unsigned long drawCalls = 0;	// Since the last fps output
+
+/* The objects drawn by one glMultiDrawElementsIndirect. */
+struct indirect_key {
+	unsigned int program;
+	const texture_asset *texture;
+};
+
+static bool indirectDraws = false;	// INDIRECT_DRAWS and the context has it
+static unsigned int cullProgram = 0;
+static merged_meshes mergedMeshes;
+static std::vector<const mesh_asset *> drawnMeshes;
+static std::vector<indirect_key> indirectKeys;
+static std::vector<indirect_group> indirectGroups;
+static std::vector<indirect_object> indirectObjects;
+static std::vector<unsigned int> objectGroups, objectMeshes;
 
 #include "planets.h"
 
@@ -36,6 +170,18 @@ std::vector<int> indicesCount;//Number of indice of objs
 static float planetRotDeg[NUM_OF_PLANETS];
 static float planetRevDeg[NUM_OF_PLANETS];
 
+static const char *planetTextures[NUM_OF_PLANETS] = {
+	"texture/sun.bmp",
+	"texture/mercury.bmp",
+	"texture/venus.bmp",
+	"texture/earth.bmp",
+	"texture/mars.bmp",
+	"texture/jupiter.bmp",
+	"texture/saturn.bmp",
+	"texture/uruans.bmp",
+	"texture/neptune.bmp",
+};
+
 /* Initialize the revolution radius, revolution period, rotate period, and radius ratio of
  * the planets to the earth, which you perfer to use in this program.
  * Therefore, the values set here are not equal to the real ratio in the solar system!
@@ -148,6 +294,48 @@ static unsigned int setup_shader(const char *vertex_shader, const char *fragment
 		delete [] infoLog;
 		return 0;
 	}
+	reflect_program(program);
+	return program;
+}
+
+/* Compile and link a compute shader. Return 0 on errors, like setup_shader(). */
+static unsigned int setup_compute_shader(const char *compute_shader)
+{
+	GLuint cs=glCreateShader(GL_COMPUTE_SHADER);
+	glShaderSource(cs, 1, (const GLchar**)&compute_shader, nullptr);
+	glCompileShader(cs);
+
+	int status, maxLength;
+	char *infoLog=nullptr;
+	glGetShaderiv(cs, GL_COMPILE_STATUS, &status);
+	if(status==GL_FALSE)
+	{
+		glGetShaderiv(cs, GL_INFO_LOG_LENGTH, &maxLength);
+		infoLog = new char[maxLength];
+		glGetShaderInfoLog(cs, maxLength, &maxLength, infoLog);
+		fprintf(stderr, "Compute Shader Error: %s\n", infoLog);
+		delete [] infoLog;
+		glDeleteShader(cs);
+		return 0;
+	}
+
+	unsigned int program=glCreateProgram();
+	glAttachShader(program, cs);
+	glLinkProgram(program);
+	glDeleteShader(cs);
+
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if(status==GL_FALSE)
+	{
+		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &maxLength);
+		infoLog = new char[maxLength];
+		glGetProgramInfoLog(program, maxLength, &maxLength, infoLog);
+		fprintf(stderr, "Link Error: %s\n", infoLog);
+		delete [] infoLog;
+		state_delete_program(program);
+		return 0;
+	}
+	reflect_program(program);
 	return program;
 }
 
@@ -163,118 +351,64 @@ static std::string readfile(const char *filename)
 			(std::istreambuf_iterator<char>()));
 }
 
-// mini bmp loader written by HSU YOU-LUN
-static unsigned char *load_bmp(const char *bmp, unsigned int *width, unsigned int *height, unsigned short int *bits)
+/* The same as readfile but for a shader: the options of this program which
+ * change the shaders are defined after its #version line.
+ */
+static std::string readshader(const char *filename)
 {
-	unsigned char *result=nullptr;
-	FILE *fp = fopen(bmp, "rb");
-	if(!fp)
-		return nullptr;
-	char type[2];
-	unsigned int size, offset;
-	// check for magic signature	
-	fread(type, sizeof(type), 1, fp);
-	if(type[0]==0x42 || type[1]==0x4d){
-		fread(&size, sizeof(size), 1, fp);
-		// ignore 2 two-byte reversed fields
-		fseek(fp, 4, SEEK_CUR);
-		fread(&offset, sizeof(offset), 1, fp);
-		// ignore size of bmpinfoheader field
-		fseek(fp, 4, SEEK_CUR);
-		fread(width, sizeof(*width), 1, fp);
-		fread(height, sizeof(*height), 1, fp);
-		// ignore planes field
-		fseek(fp, 2, SEEK_CUR);
-		fread(bits, sizeof(*bits), 1, fp);
-		unsigned char *pos = result = new unsigned char[size-offset];
-		fseek(fp, offset, SEEK_SET);
-		while(size-ftell(fp)>0)
-			pos+=fread(pos, 1, size-ftell(fp), fp);
-	}
-	fclose(fp);
-	return result;
+	std::string source = readfile(filename);
+#if TEXTURE_ARRAY
+	source.insert(source.find('\n') + 1, "#define TEXTURE_ARRAY\n");
+#endif
+	return source;
+}
+
+/* The options of the meshes of all objects. */
+static mesh_options meshOptions()
+{
+	mesh_options options;
+	options.compactVertices = COMPACT_VERTICES;
+	options.lodLevels = LOD_LEVELS;
+	options.firstInstanceAttribute = FIRST_INSTANCE_ATTRIBUTE;
+	options.numInstanceAttributes = NUM_INSTANCE_ATTRIBUTES;
+	return options;
 }
 
 /* Add a object to rendering list.
  * Parameters:
  * - program: Which shader program this object should use
- * - filename: The object file of this object
+ * - mesh: The mesh of this object
  * - texbmp: The texture file for this object
  * - emission: The emission material color of this object
  * Return:
  * - The index of this obejct in the rendering list.
  */
-static int add_obj(unsigned int program, const char *filename, const char *texbmp,
+static int add_mesh(unsigned int program, mesh_asset *mesh, const char *texbmp,
 		glm::vec4 emission)
 {
 	object_struct new_node;
 	new_node.materialEmission = emission;
 
-	std::vector<tinyobj::shape_t> shapes;
-	std::vector<tinyobj::material_t> materials;
-
-	std::string err = tinyobj::LoadObj(shapes, materials, filename);
-
-	if (!err.empty()||shapes.size()==0)
+	// Objects of the same files share the meshes and textures.
+	new_node.mesh = mesh;
+#if TEXTURE_ARRAY
+	std::vector<std::string> layers(planetTextures, planetTextures + NUM_OF_PLANETS);
+	new_node.textureLayer = std::find(layers.begin(), layers.end(), texbmp) - layers.begin();
+	if (new_node.textureLayer == NUM_OF_PLANETS)
 	{
-		std::cerr<<err<<std::endl;
-		exit(1);
-	}
-
-	// Create spaces for vertex array object, vertex buffer objects, and texture object.
-	glGenVertexArrays(1, &new_node.vao);
-	glGenBuffers(4, new_node.vbo);
-	glGenTextures(1, &new_node.texture);
-
-	glBindVertexArray(new_node.vao);
-
-	// Upload postion array
-	glBindBuffer(GL_ARRAY_BUFFER, new_node.vbo[0]);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)*shapes[0].mesh.positions.size(),
-			shapes[0].mesh.positions.data(), GL_STATIC_DRAW);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-
-	// Upload texCoord array and texture arary
-	if(shapes[0].mesh.texcoords.size()>0)
-	{
-		glBindBuffer(GL_ARRAY_BUFFER, new_node.vbo[1]);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)*shapes[0].mesh.texcoords.size(),
-				shapes[0].mesh.texcoords.data(), GL_STATIC_DRAW);
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, 0);
-
-		glBindTexture(GL_TEXTURE_2D, new_node.texture);
-		unsigned int width, height;
-		unsigned short int bits;
-		unsigned char *bgr=load_bmp(texbmp, &width, &height, &bits);
-		GLenum format = (bits == 24? GL_BGR: GL_BGRA);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, format, GL_UNSIGNED_BYTE, bgr);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
-		glGenerateMipmap(GL_TEXTURE_2D);
-		delete [] bgr;
-	}
-
-	// Upload normal array
-	if(shapes[0].mesh.normals.size()>0)
-	{
-		glBindBuffer(GL_ARRAY_BUFFER, new_node.vbo[2]);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat)*shapes[0].mesh.normals.size(),
-				shapes[0].mesh.normals.data(), GL_STATIC_DRAW);
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
+		std::cerr<<texbmp<<" is not in the texture array"<<std::endl;
+		exit(EXIT_FAILURE);
 	}
-
-	// Setup index buffer for glDrawElements
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, new_node.vbo[3]);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint)*shapes[0].mesh.indices.size(),
-			shapes[0].mesh.indices.data(), GL_STATIC_DRAW);
-
-	indicesCount.push_back(shapes[0].mesh.indices.size());
-
-	// Unbind the vao of this object
-	glBindVertexArray(0);
+#if ASYNC_LOADING
+	new_node.texture = acquire_texture_array_async(layers, TEXTURE_ARRAY_WIDTH, TEXTURE_ARRAY_HEIGHT);
+#else
+	new_node.texture = acquire_texture_array(layers, TEXTURE_ARRAY_WIDTH, TEXTURE_ARRAY_HEIGHT);
+#endif
+#elif ASYNC_LOADING
+	new_node.texture = acquire_texture_async(texbmp);
+#else
+	new_node.texture = acquire_texture(texbmp);
+#endif
 
 	new_node.program = program;
 
@@ -282,78 +416,289 @@ static int add_obj(unsigned int program, const char *filename, const char *texbm
 	return objects.size()-1;
 }
 
+#if PROCEDURAL_PLANETS
+/* The same as add_mesh but for a procedural sphere of 'radius'. */
+static int add_sphere(unsigned int program, float radius, const char *texbmp,
+		glm::vec4 emission)
+{
+	sphere_options sphere;
+	sphere.type = SPHERE_UV;
+	sphere.radius = radius;
+	sphere.tessellation = PLANET_SEGMENTS;
+	return add_mesh(program, acquire_sphere(sphere, meshOptions()), texbmp, emission);
+}
+#else
+/* The same as add_mesh but for the mesh in the object file 'filename'. */
+static int add_obj(unsigned int program, const char *filename, const char *texbmp,
+		glm::vec4 emission)
+{
+#if ASYNC_LOADING
+	return add_mesh(program, acquire_mesh_async(filename, meshOptions()), texbmp, emission);
+#else
+	return add_mesh(program, acquire_mesh(filename, meshOptions()), texbmp, emission);
+#endif
+}
+#endif
+
 /* Delete all information of all objects in the rendering list.
  */
 static void releaseObjects()
 {
 	for(int i=0;i<objects.size();i++){
-		glDeleteVertexArrays(1, &objects[i].vao);
-		glDeleteTextures(1, &objects[i].texture);
-		glDeleteBuffers(4, objects[i].vbo);
+		release_mesh(objects[i].mesh);
+		release_texture(objects[i].texture);
+	}
+	objects.clear();
+	release_mesh(placeholderMesh);
+	placeholderMesh = nullptr;
+	forget_program(program);
+	state_delete_program(program);
+	stop_stream_buffer();
+	if (cullProgram)
+	{
+		release_merged_meshes(mergedMeshes);
+		stop_indirect_draw();
+		forget_program(cullProgram);
+		state_delete_program(cullProgram);
 	}
-	glDeleteProgram(program);
 }
 
-/* Assign a new value to the mat4 variable of the specified shader program.
- * Parameter:
- * - program: At which shader program the mat4 variable that you want to assign is.
- * - name: The name of that variable
- * - mat: The new value
+/* Enable the instance attributes on the bound vertex array. The vertex arrays
+ * of the meshes have them from asset_cache, see meshOptions().
  */
-static void setUniformMat4(unsigned int program, const std::string &name, const glm::mat4 &mat)
+static void enableInstanceAttributes()
 {
-	// This line can be ignore. But, if you have multiple shader program
-	// You must check if currect binding is the one you want
-	glUseProgram(program);
-	GLint loc=glGetUniformLocation(program, name.c_str());
-	if(loc==-1) return;
-
-	// mat4 of glm is column major, same as opengl
-	// we don't need to transpose it. so..GL_FALSE
-	glUniformMatrix4fv(loc, 1, GL_FALSE, glm::value_ptr(mat));
+	for (GLuint location = FIRST_INSTANCE_ATTRIBUTE;
+			location < FIRST_INSTANCE_ATTRIBUTE + NUM_INSTANCE_ATTRIBUTES; ++location)
+	{
+		glEnableVertexAttribArray(location);
+		glVertexAttribDivisor(location, 1);
+	}
 }
 
-/* The same as setUniformMat4 but set a float value.
- * Parameter:
- * - f: The new float value
+/* Point the instance attributes of the bound vertex array at the instances
+ * from byte 'offset' on in the GL_ARRAY_BUFFER. Without
+ * glDrawElementsInstancedBaseInstance of GL 4.2, this is how a draw starts at
+ * another instance.
  */
-static void setUniformFloat(unsigned int program, const std::string &name, const float f)
+static void setInstanceAttributes(size_t offset)
 {
-	glUseProgram(program);
-	GLint loc = glGetUniformLocation(program, name.c_str());
-	if (loc == -1) return;
+	const char *base = (const char *)offset;
+	const GLsizei stride = sizeof(instance_data);
+	const GLuint first = FIRST_INSTANCE_ATTRIBUTE;
+	for (GLuint column = 0; column < 4; ++column)
+		glVertexAttribPointer(first + column, 4, GL_FLOAT, GL_FALSE, stride,
+				base + offsetof(instance_data, model) + column*sizeof(glm::vec4));
+	glVertexAttribPointer(first + 4, 4, GL_FLOAT, GL_FALSE, stride, base + offsetof(instance_data, planetEmission));
+	glVertexAttribPointer(first + 5, 3, GL_FLOAT, GL_FALSE, stride, base + offsetof(instance_data, positionOffset));
+	glVertexAttribPointer(first + 6, 3, GL_FLOAT, GL_FALSE, stride, base + offsetof(instance_data, positionScale));
+	glVertexAttribPointer(first + 7, 1, GL_FLOAT, GL_FALSE, stride, base + offsetof(instance_data, rotateDeg));
+	// The last one, so the enabled range of NUM_INSTANCE_ATTRIBUTES ends here.
+	glVertexAttribIPointer(first + NUM_INSTANCE_ATTRIBUTES - 1, 1, GL_INT, stride,
+			base + offsetof(instance_data, textureLayer));
+}
 
-	glUniform1f(loc, f);
+static bool sameDraw(const draw_item &a, const draw_item &b)
+{
+	return a.program == b.program && a.mesh == b.mesh && a.lod == b.lod && a.texture == b.texture;
 }
 
-/* The same as setUniformMat4 but set a vec4 value.
+/* Pick the level of detail of an object from the radius of its bounding sphere
+ * on the screen.
  * Parameter:
- * - vec: The new vec4 value
+ * - mesh: The mesh drawn for the object, its own or the placeholder.
+ * Return:
+ * - The index into 'mesh.lods'.
  */
-static void setUniformVec4(unsigned int program, const std::string &name, const glm::vec4 &vec)
+static int select_lod(const object_struct &object, const mesh_asset &mesh)
+{
+	glm::vec3 center = glm::vec3(object.model*glm::vec4(mesh.boundingCenter, 1.0f));
+	float scale = glm::max(glm::length(glm::vec3(object.model[0])),
+			glm::max(glm::length(glm::vec3(object.model[1])), glm::length(glm::vec3(object.model[2]))));
+	float radius = mesh.boundingRadius*scale;
+	float distance = glm::length(center - cameraEye);
+	if (distance <= radius)
+		return 0;
+	float radiusPx = radius/(distance*glm::tan(glm::radians(CAMERA_FOVY)*0.5f))*framebufferHeight*0.5f;
+
+	// Finer while the current level is visibly wrong, coarser while the next
+	// one would still look right.
+	int lod = glm::min(object.lod, (int)mesh.lods.size() - 1);
+	while (lod > 0 && mesh.lods[lod].error*radiusPx > LOD_PIXEL_ERROR*(1.0f + LOD_HYSTERESIS))
+		--lod;
+	while (lod + 1 < (int)mesh.lods.size() &&
+			mesh.lods[lod + 1].error*radiusPx < LOD_PIXEL_ERROR*(1.0f - LOD_HYSTERESIS))
+		++lod;
+	return lod;
+}
+
+static bool operator==(const indirect_key &a, const indirect_key &b)
 {
-	glUseProgram(program);
-	GLint loc = glGetUniformLocation(program, name.c_str());
-	if (loc == -1) return;
+	return a.program == b.program && a.texture == b.texture;
+}
 
-	glUniform4fv(loc, 1, glm::value_ptr(vec));
+/* Index of 'value' in 'values', added at the end if it is not there. */
+template<typename T> static unsigned int findOrAdd(std::vector<T> &values, const T &value)
+{
+	unsigned int i = 0;
+	while (i < values.size() && !(values[i] == value))
+		++i;
+	if (i == values.size())
+		values.push_back(value);
+	return i;
 }
 
-static void render()
+/* Draw the objects with glDrawElementsInstanced, choosing their levels of
+ * detail on the CPU.
+ */
+static void renderInstanced()
 {
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	// What every object draws, and the order of the draws: front to back
+	// within the runs of the same state.
+	drawItems.resize(objects.size());
+	renderQueue.resize(objects.size());
+	queuedPrograms.clear();
+	queuedMeshes.clear();
+	queuedTextures.clear();
 	for(int i=0;i<objects.size();i++){
-		glUseProgram(objects[i].program);
-		glBindVertexArray(objects[i].vao);
-		glBindTexture(GL_TEXTURE_2D, objects[i].texture);
+		const mesh_asset &mesh = objects[i].mesh->ready? *objects[i].mesh: *placeholderMesh;
+		objects[i].lod = select_lod(objects[i], mesh);
+		draw_item &item = drawItems[i];
+		item.program = objects[i].program;
+		item.mesh = &mesh;
+		item.texture = objects[i].texture;
+		item.lod = objects[i].lod;
+		float depth = glm::length(glm::vec3(objects[i].model[3]) - cameraEye)/CAMERA_FAR;
+		renderQueue[i].key = make_render_key(PASS_OPAQUE, findOrAdd(queuedPrograms, item.program),
+				findOrAdd(queuedMeshes, item.mesh), findOrAdd(queuedTextures, item.texture),
+				item.lod, depth);
+		renderQueue[i].index = i;
+	}
+	sort_render_queue(renderQueue);
+
+	// The instances of the whole frame, written into the stream buffer.
+	stream_allocation instances = stream_alloc(sizeof(instance_data)*renderQueue.size());
+	for(size_t i=0;i<renderQueue.size();i++){
+		const object_struct &object = objects[renderQueue[i].index];
+		const draw_item &item = drawItems[renderQueue[i].index];
+		instance_data &instance = static_cast<instance_data *>(instances.data)[i];
+		instance.model = object.model;
+		instance.planetEmission = object.materialEmission;
+		instance.positionOffset = item.mesh->positionOffset;
+		instance.positionScale = item.mesh->positionScale;
+		instance.rotateDeg = planetRotDeg[renderQueue[i].index];
+		instance.textureLayer = object.textureLayer;
+	}
+	flush_stream_buffer();
+
+	for(size_t first=0, last;first<renderQueue.size();first=last){
+		const draw_item &item = drawItems[renderQueue[first].index];
+		for(last=first+1;INSTANCED_DRAWS && last<renderQueue.size() &&
+				sameDraw(item, drawItems[renderQueue[last].index]);)
+			++last;
+
+		queue_use_program(item.program);
+		queue_bind_vertex_array(item.mesh->vao);
+		// Objects sharing an array texture only change the layer.
+		queue_bind_texture(item.texture->target, item.texture->texture);
+		state_bind_buffer(GL_ARRAY_BUFFER, instances.buffer);
+		setInstanceAttributes(instances.offset + first*sizeof(instance_data));
+
+		const mesh_lod &lod = item.mesh->lods[item.lod];
+		size_t indexSize = item.mesh->indexType == GL_UNSIGNED_SHORT? sizeof(GLushort): sizeof(GLuint);
+		glDrawElementsInstanced(GL_TRIANGLES, lod.numIndices, item.mesh->indexType,
+				(const void *)(lod.firstIndex*indexSize), last - first);
+		++drawCalls;
+	}
+}
 
-		setUniformMat4(program, "model", objects[i].model);
-		setUniformFloat(program, "rotateDeg", planetRotDeg[i]);
-		setUniformVec4(program, "planetEmission", objects[i].materialEmission);
+/* Draw the objects with glMultiDrawElementsIndirect after culling them on the
+ * GPU. The CPU only writes the instances, grouped by program and texture.
+ */
+static void renderIndirect()
+{
+	// The group and mesh of every object. There are few of both.
+	drawnMeshes.clear();
+	indirectKeys.clear();
+	objectGroups.resize(objects.size());
+	objectMeshes.resize(objects.size());
+	for(size_t i=0;i<objects.size();i++){
+		const mesh_asset *mesh = objects[i].mesh->ready? objects[i].mesh: placeholderMesh;
+		objectMeshes[i] = findOrAdd(drawnMeshes, mesh);
+		indirect_key key = {objects[i].program, objects[i].texture};
+		objectGroups[i] = findOrAdd(indirectKeys, key);
+	}
+	// Merge again once a mesh has loaded.
+	if (drawnMeshes != mergedMeshes.meshes)
+	{
+		merge_meshes(drawnMeshes, mergedMeshes);
+		state_bind_vertex_array(mergedMeshes.vao);
+		enableInstanceAttributes();
+	}
 
-		glDrawElements(GL_TRIANGLES, indicesCount[i], GL_UNSIGNED_INT, nullptr);
+	// The instances of a group are next to each other.
+	indirectGroups.assign(indirectKeys.size(), indirect_group());
+	for(size_t i=0;i<objects.size();i++)
+		++indirectGroups[objectGroups[i]].count;
+	for(size_t g=1;g<indirectGroups.size();g++)
+		indirectGroups[g].first = indirectGroups[g - 1].first + indirectGroups[g - 1].count;
+	stream_allocation instances = stream_alloc(sizeof(instance_data)*objects.size());
+	indirectObjects.resize(objects.size());
+	for(size_t g=0;g<indirectGroups.size();g++)
+		indirectGroups[g].count = 0;
+	for(size_t i=0;i<objects.size();i++){
+		indirect_group &group = indirectGroups[objectGroups[i]];
+		size_t slot = group.first + group.count++;
+		const mesh_asset &mesh = *drawnMeshes[objectMeshes[i]];
+		instance_data &instance = static_cast<instance_data *>(instances.data)[slot];
+		instance.model = objects[i].model;
+		instance.planetEmission = objects[i].materialEmission;
+		instance.positionOffset = mesh.positionOffset;
+		instance.positionScale = mesh.positionScale;
+		instance.rotateDeg = planetRotDeg[i];
+		instance.textureLayer = objects[i].textureLayer;
+		indirect_object &object = indirectObjects[slot];
+		object.mesh = objectMeshes[i];
+		object.group = objectGroups[i];
+		object.object = i;
+	}
+	flush_stream_buffer();
+
+	cull_view view;
+	view.eye = cameraEye;
+	view.pixelScale = framebufferHeight*0.5f/glm::tan(glm::radians(CAMERA_FOVY)*0.5f);
+	view.pixelError = LOD_PIXEL_ERROR;
+	view.hysteresis = LOD_HYSTERESIS;
+	cull_objects(mergedMeshes, instances, indirectObjects, indirectGroups, view);
+
+	// The base instance of every command selects its object.
+	queue_bind_vertex_array(mergedMeshes.vao);
+	state_bind_buffer(GL_ARRAY_BUFFER, instances.buffer);
+	setInstanceAttributes(instances.offset);
+	for(size_t g=0;g<indirectKeys.size();g++){
+		queue_use_program(indirectKeys[g].program);
+		queue_bind_texture(indirectKeys[g].texture->target, indirectKeys[g].texture->texture);
+		draw_indirect_group(mergedMeshes, g);
+		++drawCalls;
 	}
-	glBindVertexArray(0);
+}
+
+static void render()
+{
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	// Wait until the GPU is done with the frame which used this region.
+	begin_stream_frame();
+	stream_allocation frame = stream_alloc(sizeof(frame_block));
+	memcpy(frame.data, &frameData, sizeof(frame_block));
+	state_bind_buffer_range(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, frame.buffer, frame.offset,
+			sizeof(frame_block));
+	if (indirectDraws)
+		renderIndirect();
+	else
+		renderInstanced();
+	state_bind_vertex_array(0);
+	end_stream_frame();
 }
 
 /* Add planets to the rendering list and initialize the model matrix of the sun.
@@ -362,23 +707,23 @@ static void render()
 void initalPlanets()
 {
 	// Add planets to the rendering list
-	add_obj(program, "sun.obj", "texture/sun.bmp", glm::vec4(0.9f));
-	add_obj(program, "earth.obj", "texture/mercury.bmp", glm::vec4(0.0f));
-	add_obj(program, "earth.obj", "texture/venus.bmp", glm::vec4(0.0f));
-	add_obj(program, "earth.obj", "texture/earth.bmp", glm::vec4(0.0f));
-	add_obj(program, "earth.obj", "texture/mars.bmp", glm::vec4(0.0f));
-	add_obj(program, "earth.obj", "texture/jupiter.bmp", glm::vec4(0.0f));
-	add_obj(program, "earth.obj", "texture/saturn.bmp", glm::vec4(0.0f));
-	add_obj(program, "earth.obj", "texture/uruans.bmp", glm::vec4(0.0f));
-	add_obj(program, "earth.obj", "texture/neptune.bmp", glm::vec4(0.0f));
+#if PROCEDURAL_PLANETS
+	add_sphere(program, 4.8f, planetTextures[SUN], glm::vec4(0.9f));
+	for (int i = MERCURY; i < NUM_OF_PLANETS; ++i)
+		add_sphere(program, 1.1f, planetTextures[i], glm::vec4(0.0f));
+#else
+	add_obj(program, "sun.obj", planetTextures[SUN], glm::vec4(0.9f));
+	for (int i = MERCURY; i < NUM_OF_PLANETS; ++i)
+		add_obj(program, "earth.obj", planetTextures[i], glm::vec4(0.0f));
+#endif
 
 	// Initialize the model matrix, the position, and the light color of the SUN.
 	objects[SUN].model = glm::scale(glm::mat4(1.0f), glm::vec3(0.5f));
-	setUniformVec4(program, "sunPosition", glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-	setUniformVec4(program, "sunLightColor", glm::vec4(1.0f));
+	frameData.sunPosition = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+	frameData.sunLightColor = glm::vec4(1.0f);
 	// All planets use the same amibent and diffuse color.
-	setUniformVec4(program, "planetAmbient", glm::vec4(0.1f, 0.1f, 0.1f, 1.0f));
-	setUniformVec4(program, "planetDiffuse", glm::vec4(1.1f));
+	frameData.planetAmbient = glm::vec4(0.1f, 0.1f, 0.1f, 1.0f);
+	frameData.planetDiffuse = glm::vec4(1.1f);
 
 	// Initialize the control variables
 	for (int i = 0; i < NUM_OF_PLANETS; ++i)
@@ -434,30 +779,61 @@ int main(int argc, char *argv[])
 	glfwSetKeyCallback(window, key_callback);
 
 	// load shader program
-	program = setup_shader(readfile("shader/vs.glsl").c_str(), readfile("shader/fs.glsl").c_str());
-	program2 = setup_shader(readfile("shader/vs.glsl").c_str(), readfile("shader/fs.glsl").c_str());
+	program = setup_shader(readshader("shader/vs.glsl").c_str(), readshader("shader/fs.glsl").c_str());
+	program2 = setup_shader(readshader("shader/vs.glsl").c_str(), readshader("shader/fs.glsl").c_str());
+	bind_uniform_block(program, "Frame", FRAME_BLOCK_BINDING, sizeof(frame_block));
+	bind_uniform_block(program2, "Frame", FRAME_BLOCK_BINDING, sizeof(frame_block));
+	start_stream_buffer(STREAM_REGION_SIZE);
+#if INDIRECT_DRAWS
+	if (indirect_draw_supported())
+	{
+		cullProgram = setup_compute_shader(readfile("shader/cull.glsl").c_str());
+		indirectDraws = cullProgram &&
+			bind_uniform_block(cullProgram, "Frame", FRAME_BLOCK_BINDING, sizeof(frame_block)) &&
+			start_indirect_draw(cullProgram);
+	}
+	std::cout<<(indirectDraws? "Culling on the GPU with multi-draw indirect":
+			"No compute shaders, drawing instanced")<<std::endl;
+#endif
 
-	glEnable(GL_DEPTH_TEST);
+	state_enable(GL_DEPTH_TEST, true);
 	glCullFace(GL_BACK);
 	// Enable blend mode for billboard
-	//glEnable(GL_BLEND);
-	//glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	//state_enable(GL_BLEND, true);
+	//state_blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 	// Matrix for transform pipeline of 'program': M_pers * M_camera * M_model
 	// - Model translation: orignal, no scale, no rotation.
 	// - Camera: eye @ ( 30, 30, 30 ), look @ ( 0, 0, 0 ), Vup = ( 0, 1, 0 ).
 	// - Perspective volume: fovy = 45 deg, aspect( x = 640, y = 480 ), zNear = 1, zFar = 200.
-	setUniformMat4(program, "vp", glm::perspective(glm::radians(45.0f), 640.0f/480, 1.0f, 200.f)*
-			glm::lookAt(glm::vec3(30.0f), glm::vec3(), glm::vec3(0, 1, 0))*glm::mat4(1.0f));
-	// camera for 'program2': orthogonal volume
-	setUniformMat4(program2, "vp", glm::mat4(1.0));
+	frameData.vp = glm::perspective(glm::radians(CAMERA_FOVY), 640.0f/480, 1.0f, CAMERA_FAR)*
+			glm::lookAt(cameraEye, glm::vec3(), glm::vec3(0, 1, 0))*glm::mat4(1.0f);
+	// 'program2' shares the Frame block and with it this camera.
+
+	// The assets are timed from the first acquire_* call to the last upload.
+	double loadStart = glfwGetTime();
+
+	// The placeholder is a unit sphere without levels of detail.
+	sphere_options placeholder;
+	placeholder.type = SPHERE_UV;
+	placeholder.radius = 1.0f;
+	placeholder.tessellation = PLACEHOLDER_SEGMENTS;
+	mesh_options placeholderOptions = meshOptions();
+	placeholderOptions.lodLevels = 1;
+	placeholderMesh = acquire_sphere(placeholder, placeholderOptions);
 
 	// Initialize the plantes
+#if ASYNC_LOADING
+	start_asset_loader(LOADER_THREADS);
+#endif
 	initalPlanets();
+	std::cout<<objects.size()<<" objects share "<<loaded_meshes()<<" meshes and "
+		<<loaded_textures()<<" textures"<<std::endl;
 
 	float last, start;
 	last = start = glfwGetTime();
 	int fps=0;
+	bool loading = true;
 	while (!glfwWindowShouldClose(window))
 	{//program will keep draw here until you close the window
 		float delta = glfwGetTime() - start;
@@ -469,18 +845,46 @@ int main(int argc, char *argv[])
 			if (planetRotDeg[i] > 360.0f ) planetRotDeg[i] -= 360.0f;
 		}
 		updatePlanets();
+		if (loading && upload_loaded_assets(UPLOAD_BUDGET) == 0)
+		{
+			loading = false;
+			std::cout<<"Assets loaded after "<<glfwGetTime() - loadStart<<" s"<<std::endl;
+		}
+		int framebufferWidth;
+		glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
 		render();
+		check_gl_state();
 		glfwSwapBuffers(window);
 		glfwPollEvents();
 		fps++;
 		if(glfwGetTime() - last > 1.0)
 		{
-			std::cout<<(double)fps/(glfwGetTime()-last)<<std::endl;
+			const uniform_counters &uniforms = get_uniform_counters();
+			const render_counters &binds = get_render_counters();
+			const gl_state_counters &state = get_gl_state_counters();
+			const stream_counters &stream = get_stream_counters();
+			std::cout<<(double)fps/(glfwGetTime()-last)<<" fps, per frame "
+				<<(double)drawCalls/fps<<" draws, "
+				<<(indirectDraws? visible_objects(): objects.size())<<" of "<<objects.size()<<" objects, "
+				<<(double)uniforms.uniformCalls/fps<<" uniforms, "
+				<<(double)uniforms.programBinds/fps<<" glUseProgram, "
+				<<(double)uniforms.callsSaved/fps<<" GL calls saved, "
+				<<(double)binds.bindsIssued/fps<<" binds, "
+				<<(double)binds.bindsSkipped/fps<<" binds skipped, "
+				<<(double)state.callsDropped/fps<<" of "
+				<<(double)(state.callsIssued + state.callsDropped)/fps<<" state calls dropped, "
+				<<stream.waits<<" frames waited "<<stream.waitTime<<" ms for the GPU"<<std::endl;
+			reset_uniform_counters();
+			reset_render_counters();
+			reset_gl_state_counters();
+			reset_stream_counters();
+			drawCalls = 0;
 			fps = 0;
 			last = glfwGetTime();
 		}
 	}
 
+	stop_asset_loader();
 	releaseObjects();
 	glfwDestroyWindow(window);
 	glfwTerminate();
@@ -0,0 +1,86 @@
+#include "mapped_file.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+void *map_file(const char *filename, size_t *size)
+{
+#ifndef _WIN32
+	int fd = open(filename, O_RDONLY);
+	if(fd < 0)
+		return nullptr;
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size == 0){
+		close(fd);
+		return nullptr;
+	}
+	*size = st.st_size;
+	void *addr = mmap(nullptr, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	return addr == MAP_FAILED? nullptr: addr;
+#else
+	std::ifstream ifs(filename, std::ios::binary | std::ios::ate);
+	if(!ifs || ifs.tellg() <= 0)
+		return nullptr;
+	*size = ifs.tellg();
+	char *addr = new char[*size];
+	ifs.seekg(0);
+	ifs.read(addr, *size);
+	return addr;
+#endif
+}
+
+void unmap_file(void *addr, size_t size)
+{
+#ifndef _WIN32
+	munmap(addr, size);
+#else
+	delete [] static_cast<char *>(addr);
+#endif
+}
+
+unsigned long long hash_bytes(const unsigned char *data, size_t size)
+{
+	const unsigned long long prime = 0x100000001b3ULL;
+	unsigned long long h = 0xcbf29ce484222325ULL ^ size;
+	size_t i = 0;
+	for(; i + 8 <= size; i += 8){
+		unsigned long long word;
+		memcpy(&word, data + i, sizeof(word));
+		h = (h ^ word) * prime;
+		h ^= h >> 29;
+	}
+	for(; i < size; ++i)
+		h = (h ^ data[i]) * prime;
+	return h ^ (h >> 32);
+}
+
+bool replace_file(const char *filename, const void *data, size_t size)
+{
+	std::string tmpfile = std::string(filename) + ".tmp";
+	{
+		std::ofstream ofs(tmpfile.c_str(), std::ios::binary | std::ios::trunc);
+		if(!ofs)
+			return false;
+		ofs.write(static_cast<const char *>(data), size);
+		if(!ofs){
+			ofs.close();
+			remove(tmpfile.c_str());
+			return false;
+		}
+	}
+#ifdef _WIN32
+	// rename() does not replace an existing file on Windows.
+	remove(filename);
+#endif
+	return rename(tmpfile.c_str(), filename) == 0;
+}
@@ -0,0 +1,26 @@
+#ifndef _MAPPED_FILE_H
+#define _MAPPED_FILE_H
+
+#include <cstddef>
+
+/* Map a whole file read-only. Where mmap is not available the file is read
+ * into a heap buffer instead.
+ * Return:
+ * - The address of the contents, or nullptr if the file cannot be read or is empty.
+ */
+void *map_file(const char *filename, size_t *size);
+
+/* Unmap a file of map_file(). */
+void unmap_file(void *addr, size_t size);
+
+/* 64-bit hash of a byte array, consuming 8 bytes per step.
+ * It only has to tell the versions of one file apart, not resist attacks.
+ */
+unsigned long long hash_bytes(const unsigned char *data, size_t size);
+
+/* Write a whole file through a temporary file, so a reader never maps a
+ * half-written file. Return false if it cannot be written.
+ */
+bool replace_file(const char *filename, const void *data, size_t size);
+
+#endif // _MAPPED_FILE_H
@@ -0,0 +1,298 @@
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+mesh_cache_stats analyze_vertex_cache(const unsigned int *indices, size_t numIndices,
+		size_t numVertices, unsigned int cacheSize)
+{
+	// A vertex is in the cache if fewer than 'cacheSize' misses happened since
+	// it was loaded, which is what a FIFO cache does.
+	std::vector<size_t> loadedAt(numVertices, 0);
+	std::vector<char> used(numVertices, 0);
+	size_t misses = 0, numUsed = 0;
+	for(size_t i = 0; i < numIndices; ++i){
+		unsigned int v = indices[i];
+		if(!used[v]){
+			used[v] = 1;
+			++numUsed;
+		}
+		if(loadedAt[v] == 0 || misses - loadedAt[v] >= cacheSize){
+			++misses;
+			loadedAt[v] = misses;
+		}
+	}
+
+	mesh_cache_stats stats;
+	stats.acmr = numIndices? float(misses)/(numIndices/3): 0.0f;
+	stats.atvr = numUsed? float(misses)/numUsed: 0.0f;
+	return stats;
+}
+
+/* Triangles around every vertex, in compressed row form. */
+struct vertex_adjacency {
+	std::vector<unsigned int> offsets;	// numVertices + 1 entries
+	std::vector<unsigned int> triangles;
+	std::vector<unsigned int> live;	// Triangles not emitted yet
+
+	vertex_adjacency(const unsigned int *indices, size_t numIndices, size_t numVertices):
+		offsets(numVertices + 1, 0), triangles(numIndices), live(numVertices, 0)
+	{
+		for(size_t i = 0; i < numIndices; ++i)
+			++live[indices[i]];
+		for(size_t v = 0; v < numVertices; ++v)
+			offsets[v + 1] = offsets[v] + live[v];
+		std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+		for(size_t i = 0; i < numIndices; ++i)
+			triangles[fill[indices[i]]++] = i/3;
+	}
+};
+
+/* Pick the next fanning vertex after a dead end: the most recent vertex with
+ * triangles left, or else the next such vertex in input order.
+ * Return:
+ * - The vertex, or -1 if all triangles are emitted.
+ */
+static long skip_dead_end(const vertex_adjacency &adj, std::vector<unsigned int> &deadEnd,
+		size_t &cursor)
+{
+	while(!deadEnd.empty()){
+		unsigned int v = deadEnd.back();
+		deadEnd.pop_back();
+		if(adj.live[v] > 0)
+			return v;
+	}
+	for(; cursor < adj.live.size(); ++cursor){
+		if(adj.live[cursor] > 0)
+			return cursor;
+	}
+	return -1;
+}
+
+void optimize_vertex_cache(unsigned int *indices, size_t numIndices, size_t numVertices,
+		unsigned int cacheSize, std::vector<unsigned int> *clusters,
+		std::vector<unsigned int> *triangles)
+{
+	if(clusters)
+		clusters->clear();
+	if(triangles){
+		triangles->resize(numIndices/3);
+		for(size_t t = 0; t < triangles->size(); ++t)
+			(*triangles)[t] = t;
+	}
+	if(numIndices < 3)
+		return;
+
+	vertex_adjacency adj(indices, numIndices, numVertices);
+	std::vector<unsigned int> output;
+	output.reserve(numIndices);
+	std::vector<size_t> cacheTime(numVertices, 0);
+	std::vector<char> emitted(numIndices/3, 0);
+	std::vector<unsigned int> deadEnd, candidates;
+	size_t timestamp = cacheSize + 1;
+	size_t cursor = 0;
+
+	long fanning = skip_dead_end(adj, deadEnd, cursor);
+	if(clusters)
+		clusters->push_back(0);
+	while(fanning >= 0){
+		// Emit all the triangles around the fanning vertex.
+		candidates.clear();
+		for(unsigned int i = adj.offsets[fanning]; i < adj.offsets[fanning + 1]; ++i){
+			unsigned int t = adj.triangles[i];
+			if(emitted[t])
+				continue;
+			emitted[t] = 1;
+			if(triangles)
+				(*triangles)[output.size()/3] = t;
+			for(int k = 0; k < 3; ++k){
+				unsigned int v = indices[t*3 + k];
+				output.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				--adj.live[v];
+				if(timestamp - cacheTime[v] > cacheSize)
+					cacheTime[v] = timestamp++;
+			}
+		}
+
+		// Continue with the candidate that stays longest in the cache after its
+		// remaining triangles are emitted.
+		long next = -1;
+		long bestPriority = -1;
+		for(size_t i = 0; i < candidates.size(); ++i){
+			unsigned int v = candidates[i];
+			if(adj.live[v] == 0)
+				continue;
+			long priority = 0;
+			if(timestamp - cacheTime[v] + 2*adj.live[v] <= cacheSize)
+				priority = timestamp - cacheTime[v];
+			if(priority > bestPriority){
+				bestPriority = priority;
+				next = v;
+			}
+		}
+		if(next < 0){
+			next = skip_dead_end(adj, deadEnd, cursor);
+			if(next >= 0 && clusters)
+				clusters->push_back(output.size());
+		}
+		fanning = next;
+	}
+
+	std::copy(output.begin(), output.end(), indices);
+}
+
+struct cluster_order {
+	size_t begin, end;
+	float score;
+	bool operator<(const cluster_order &other) const { return score > other.score; }
+};
+
+void optimize_overdraw(unsigned int *indices, size_t numIndices, const float *positions,
+		size_t stride, const std::vector<unsigned int> &clusters,
+		std::vector<unsigned int> *triangles)
+{
+	if(clusters.size() < 2)
+		return;
+
+	// Area weighted centroid and normal of every cluster and of the mesh.
+	std::vector<cluster_order> order(clusters.size());
+	std::vector<float> centroids(clusters.size()*3), normals(clusters.size()*3);
+	float meshCentroid[3] = { 0.0f, 0.0f, 0.0f };
+	float meshArea = 0.0f;
+	for(size_t c = 0; c < clusters.size(); ++c){
+		order[c].begin = clusters[c];
+		order[c].end = c + 1 < clusters.size()? clusters[c + 1]: numIndices;
+		float area = 0.0f;
+		float *centroid = &centroids[c*3], *normal = &normals[c*3];
+		for(size_t i = order[c].begin; i < order[c].end; i += 3){
+			const float *a = positions + indices[i]*stride;
+			const float *b = positions + indices[i + 1]*stride;
+			const float *d = positions + indices[i + 2]*stride;
+			float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+			float e2[3] = { d[0] - a[0], d[1] - a[1], d[2] - a[2] };
+			float n[3] = { e1[1]*e2[2] - e1[2]*e2[1], e1[2]*e2[0] - e1[0]*e2[2],
+				e1[0]*e2[1] - e1[1]*e2[0] };
+			float w = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+			for(int k = 0; k < 3; ++k){
+				centroid[k] += w*(a[k] + b[k] + d[k])/3.0f;
+				normal[k] += n[k];
+			}
+			area += w;
+		}
+		for(int k = 0; k < 3; ++k)
+			meshCentroid[k] += centroid[k];
+		meshArea += area;
+		if(area > 0.0f){
+			for(int k = 0; k < 3; ++k)
+				centroid[k] /= area;
+		}
+	}
+	if(meshArea > 0.0f){
+		for(int k = 0; k < 3; ++k)
+			meshCentroid[k] /= meshArea;
+	}
+
+	for(size_t c = 0; c < clusters.size(); ++c){
+		const float *centroid = &centroids[c*3], *normal = &normals[c*3];
+		float length = std::sqrt(normal[0]*normal[0] + normal[1]*normal[1] + normal[2]*normal[2]);
+		float score = 0.0f;
+		for(int k = 0; k < 3; ++k)
+			score += (centroid[k] - meshCentroid[k])*normal[k];
+		order[c].score = length > 0.0f? score/length: 0.0f;
+	}
+	std::stable_sort(order.begin(), order.end());
+
+	std::vector<unsigned int> output;
+	output.reserve(numIndices);
+	for(size_t c = 0; c < order.size(); ++c)
+		output.insert(output.end(), indices + order[c].begin, indices + order[c].end);
+	std::copy(output.begin(), output.end(), indices);
+
+	if(triangles){
+		std::vector<unsigned int> moved;
+		moved.reserve(triangles->size());
+		for(size_t c = 0; c < order.size(); ++c)
+			moved.insert(moved.end(), triangles->begin() + order[c].begin/3,
+					triangles->begin() + order[c].end/3);
+		triangles->swap(moved);
+	}
+}
+
+size_t optimize_vertex_fetch(unsigned int *indices, size_t numIndices, size_t numVertices,
+		std::vector<unsigned int> &remap)
+{
+	remap.assign(numVertices, ~0u);
+	unsigned int next = 0;
+	for(size_t i = 0; i < numIndices; ++i){
+		unsigned int &v = remap[indices[i]];
+		if(v == ~0u)
+			v = next++;
+		indices[i] = v;
+	}
+	return next;
+}
+
+void remap_vertices(std::vector<float> &data, size_t components,
+		const std::vector<unsigned int> &remap, size_t newCount)
+{
+	if(data.size() != remap.size()*components)
+		return;
+	std::vector<float> output(newCount*components);
+	for(size_t v = 0; v < remap.size(); ++v){
+		if(remap[v] != ~0u)
+			std::copy(&data[v*components], &data[v*components] + components,
+					&output[remap[v]*components]);
+	}
+	data.swap(output);
+}
+
+void optimize_mesh(tinyobj::mesh_t &mesh, bool overdraw,
+		mesh_cache_stats *before, mesh_cache_stats *after)
+{
+	// With LOAD_INTERLEAVED the positions are only in 'vertices'.
+	const bool interleaved = mesh.positions.empty();
+	const float *positions = interleaved? mesh.vertices.data(): mesh.positions.data();
+	const size_t stride = interleaved? size_t(tinyobj::INTERLEAVED_STRIDE): 3;
+	size_t numVertices = (interleaved? mesh.vertices.size(): mesh.positions.size())/stride;
+	unsigned int *indices = mesh.indices.data();
+	size_t numIndices = mesh.indices.size();
+	if(numIndices == 0)
+		return;
+
+	mesh_cache_stats original = analyze_vertex_cache(indices, numIndices, numVertices);
+	if(before)
+		*before = original;
+
+	// Tipsify is a greedy heuristic. Keep the file order if it is already
+	// better, e.g. when one vertex is shared by a very large fan.
+	std::vector<unsigned int> fileOrder(mesh.indices);
+	std::vector<unsigned int> clusters;
+	// The material of every face moves with its triangle.
+	std::vector<unsigned int> triangles;
+	std::vector<unsigned int> *order = mesh.material_ids.size() == numIndices/3? &triangles: nullptr;
+	optimize_vertex_cache(indices, numIndices, numVertices, MESH_CACHE_SIZE,
+			overdraw? &clusters: nullptr, order);
+	if(overdraw)
+		optimize_overdraw(indices, numIndices, positions, stride, clusters, order);
+	if(analyze_vertex_cache(indices, numIndices, numVertices).acmr > original.acmr)
+		mesh.indices.swap(fileOrder);
+	else if(order){
+		std::vector<int> materials(triangles.size());
+		for(size_t t = 0; t < triangles.size(); ++t)
+			materials[t] = mesh.material_ids[triangles[t]];
+		mesh.material_ids.swap(materials);
+	}
+	indices = mesh.indices.data();
+
+	std::vector<unsigned int> remap;
+	size_t newCount = optimize_vertex_fetch(indices, numIndices, numVertices, remap);
+	remap_vertices(mesh.positions, 3, remap, newCount);
+	remap_vertices(mesh.normals, 3, remap, newCount);
+	remap_vertices(mesh.texcoords, 2, remap, newCount);
+	remap_vertices(mesh.vertices, tinyobj::INTERLEAVED_STRIDE, remap, newCount);
+
+	if(after)
+		*after = analyze_vertex_cache(indices, numIndices, newCount);
+}
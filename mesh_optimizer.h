@@ -0,0 +1,83 @@
+#ifndef _MESH_OPTIMIZER_H
+#define _MESH_OPTIMIZER_H
+
+#include <cstddef>
+#include <vector>
+#include "tiny_obj_loader.h"
+
+/* Triangle and vertex reordering of indexed triangle lists.
+ *
+ * - optimize_vertex_cache reorders the triangles for the post-transform vertex
+ *   cache with Tipsify (Sander, Nehab and Barczak, 2007).
+ * - optimize_overdraw sorts the clusters found by optimize_vertex_cache so that
+ *   the outward facing parts of the mesh are drawn first.
+ * - optimize_vertex_fetch renumbers the vertices in the order the triangles
+ *   first use them, so the vertex fetches walk the vertex buffer forward.
+ */
+
+/* Entries of the simulated FIFO cache. Tipsify is not sensitive to the exact
+ * size as long as it is not larger than the real cache.
+ */
+#define MESH_CACHE_SIZE 16
+
+struct mesh_cache_stats {
+	float acmr;	// Average cache miss ratio: transformed vertices per triangle
+	float atvr;	// Average transform to vertex ratio: 1.0 is the optimum
+};
+
+/* Simulate a FIFO post-transform cache of 'cacheSize' entries over an index list.
+ * Parameter:
+ * - indices, numIndices: The triangle list.
+ * - numVertices: All indices are less than this.
+ */
+mesh_cache_stats analyze_vertex_cache(const unsigned int *indices, size_t numIndices,
+		size_t numVertices, unsigned int cacheSize = MESH_CACHE_SIZE);
+
+/* Reorder the triangles of 'indices' in place for the vertex cache.
+ * Parameter:
+ * - clusters: Optional output of the first index of every cluster, i.e. the
+ *   places where Tipsify had to restart because it reached a dead end.
+ * - triangles: Optional output of the input triangle of every output triangle.
+ */
+void optimize_vertex_cache(unsigned int *indices, size_t numIndices, size_t numVertices,
+		unsigned int cacheSize = MESH_CACHE_SIZE, std::vector<unsigned int> *clusters = nullptr,
+		std::vector<unsigned int> *triangles = nullptr);
+
+/* Sort the clusters of an optimized index list from the most to the least
+ * outward facing, relative to the centroid of the mesh. The triangle order
+ * inside a cluster is kept, so the cache efficiency barely changes.
+ * Parameter:
+ * - positions, stride: x, y, z of vertex i are at positions[i*stride].
+ * - clusters: The output of optimize_vertex_cache for 'indices'.
+ * - triangles: Optional, one entry per triangle moved along with it.
+ */
+void optimize_overdraw(unsigned int *indices, size_t numIndices, const float *positions,
+		size_t stride, const std::vector<unsigned int> &clusters,
+		std::vector<unsigned int> *triangles = nullptr);
+
+/* Renumber the vertices in the order of their first use in 'indices'.
+ * Parameter:
+ * - remap: Output, the new index of every old vertex, or ~0u for a vertex no
+ *   triangle uses. Call remap_vertices with it for every vertex array.
+ * Return:
+ * - The number of vertices left.
+ */
+size_t optimize_vertex_fetch(unsigned int *indices, size_t numIndices, size_t numVertices,
+		std::vector<unsigned int> &remap);
+
+/* Move the vertices of an array of 'components' floats per vertex to their
+ * new places and drop the unused ones. Empty arrays are left alone.
+ */
+void remap_vertices(std::vector<float> &data, size_t components,
+		const std::vector<unsigned int> &remap, size_t newCount);
+
+/* Run all the optimizations on a mesh loaded by tinyobj and keep every vertex
+ * array and the per-face material_ids of it consistent with the new order.
+ * Parameter:
+ * - overdraw: Also sort the clusters with optimize_overdraw.
+ * - before, after: Optional cache statistics of the mesh.
+ */
+void optimize_mesh(tinyobj::mesh_t &mesh, bool overdraw,
+		mesh_cache_stats *before = nullptr, mesh_cache_stats *after = nullptr);
+
+#endif // _MESH_OPTIMIZER_H
@@ -0,0 +1,318 @@
+#include "mesh_simplify.h"
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+/* Symmetric 4x4 matrix of a sum of plane equations, and the sum of their
+ * weights so that the error can be turned back into a distance.
+ */
+struct quadric {
+	double a00, a01, a02, a03, a11, a12, a13, a22, a23, a33;
+	double weight;
+
+	quadric(): a00(0), a01(0), a02(0), a03(0), a11(0), a12(0), a13(0),
+		a22(0), a23(0), a33(0), weight(0) {}
+
+	/* Add the plane n.p + d = 0, n normalized. */
+	void add_plane(const double n[3], double d, double w)
+	{
+		a00 += w*n[0]*n[0]; a01 += w*n[0]*n[1]; a02 += w*n[0]*n[2]; a03 += w*n[0]*d;
+		a11 += w*n[1]*n[1]; a12 += w*n[1]*n[2]; a13 += w*n[1]*d;
+		a22 += w*n[2]*n[2]; a23 += w*n[2]*d;
+		a33 += w*d*d;
+		weight += w;
+	}
+
+	quadric &operator+=(const quadric &q)
+	{
+		a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+		a11 += q.a11; a12 += q.a12; a13 += q.a13;
+		a22 += q.a22; a23 += q.a23; a33 += q.a33;
+		weight += q.weight;
+		return *this;
+	}
+
+	/* Weighted sum of the squared distances of 'p' to the planes. */
+	double eval(const float *p) const
+	{
+		double x = p[0], y = p[1], z = p[2];
+		double r = a00*x*x + a11*y*y + a22*z*z + a33 +
+			2*(a01*x*y + a02*x*z + a12*y*z + a03*x + a13*y + a23*z);
+		return r > 0? r: 0;
+	}
+};
+
+static void triangle_normal(const float *p0, const float *p1, const float *p2, double n[3])
+{
+	double e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+	double e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+	n[0] = e1[1]*e2[2] - e1[2]*e2[1];
+	n[1] = e1[2]*e2[0] - e1[0]*e2[2];
+	n[2] = e1[0]*e2[1] - e1[1]*e2[0];
+}
+
+/* Sorts vertex indices by their position. */
+struct position_less {
+	const float *vertices;
+	size_t stride;
+	bool operator()(unsigned int a, unsigned int b) const
+	{
+		const float *p = vertices + a*stride, *q = vertices + b*stride;
+		if(p[0] != q[0]) return p[0] < q[0];
+		if(p[1] != q[1]) return p[1] < q[1];
+		return p[2] < q[2];
+	}
+};
+
+struct collapse {
+	unsigned int from, to;
+	double cost;
+	bool operator<(const collapse &other) const { return cost < other.cost; }
+};
+
+/* State of one simplification. run() can be called with decreasing targets
+ * to continue from the previous result, which is how the LOD chain is built.
+ */
+struct simplifier {
+	const float *vertices;
+	size_t numVertices, stride;
+	std::vector<unsigned int> rep;	// Vertex with the same position that holds the quadric
+	std::vector<char> locked;	// On a UV seam or a border
+	std::vector<quadric> quadrics;
+	double radius;
+	double reached;	// Largest collapse cost so far
+	std::vector<unsigned int> result;
+
+	// Scratch memory of run()
+	std::vector<unsigned int> offsets, triangles, remap;
+	std::vector<collapse> candidates;
+	std::vector<char> touched;
+
+	simplifier(const unsigned int *indices, size_t numIndices, const float *vertices,
+			size_t numVertices, size_t stride);
+	void run(size_t targetIndices, float maxError);
+	float error() const { return radius > 0? float(std::sqrt(reached)/radius): 0.0f; }
+
+	const float *position(unsigned int v) const { return vertices + size_t(v)*stride; }
+};
+
+simplifier::simplifier(const unsigned int *indices, size_t numIndices, const float *vertices,
+		size_t numVertices, size_t stride):
+	vertices(vertices), numVertices(numVertices), stride(stride), rep(numVertices),
+	locked(numVertices, 0), quadrics(numVertices), radius(0), reached(0),
+	result(indices, indices + numIndices), remap(numVertices), touched(numVertices)
+{
+	// Vertices with the same position share a representative, the first of them.
+	std::vector<unsigned int> order(numVertices);
+	for(size_t v = 0; v < numVertices; ++v)
+		order[v] = v;
+	position_less less = { vertices, stride };
+	std::sort(order.begin(), order.end(), less);
+	for(size_t i = 0; i < numVertices; ){
+		size_t j = i + 1;
+		while(j < numVertices && !less(order[i], order[j]))
+			++j;
+		for(size_t k = i; k < j; ++k){
+			rep[order[k]] = order[i];
+			locked[order[k]] = j - i > 1;	// On a UV seam
+		}
+		i = j;
+	}
+
+	// Lock the open borders: position edges used by a single triangle.
+	std::vector<std::pair<unsigned int, unsigned int> > edges;
+	edges.reserve(numIndices);
+	for(size_t i = 0; i < numIndices; i += 3){
+		for(int k = 0; k < 3; ++k){
+			unsigned int a = rep[result[i + k]], b = rep[result[i + (k + 1)%3]];
+			edges.push_back(std::make_pair(std::min(a, b), std::max(a, b)));
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+	std::vector<char> border(numVertices, 0);
+	for(size_t i = 0; i < edges.size(); ){
+		size_t j = i + 1;
+		while(j < edges.size() && edges[j] == edges[i])
+			++j;
+		if(j - i == 1)
+			border[edges[i].first] = border[edges[i].second] = 1;
+		i = j;
+	}
+	for(size_t v = 0; v < numVertices; ++v){
+		if(border[rep[v]])
+			locked[v] = 1;
+	}
+
+	// Quadrics of the planes around every position, weighted by area.
+	double lower[3] = { 1e30, 1e30, 1e30 }, upper[3] = { -1e30, -1e30, -1e30 };
+	for(size_t v = 0; v < numVertices; ++v){
+		for(int k = 0; k < 3; ++k){
+			lower[k] = std::min(lower[k], double(position(v)[k]));
+			upper[k] = std::max(upper[k], double(position(v)[k]));
+		}
+	}
+	radius = 0.5*std::sqrt((upper[0] - lower[0])*(upper[0] - lower[0]) +
+			(upper[1] - lower[1])*(upper[1] - lower[1]) + (upper[2] - lower[2])*(upper[2] - lower[2]));
+	for(size_t i = 0; i < numIndices; i += 3){
+		const float *p0 = position(result[i]);
+		double n[3];
+		triangle_normal(p0, position(result[i + 1]), position(result[i + 2]), n);
+		double area = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+		if(area <= 0)
+			continue;
+		for(int k = 0; k < 3; ++k)
+			n[k] /= area;
+		double d = -(n[0]*p0[0] + n[1]*p0[1] + n[2]*p0[2]);
+		for(int k = 0; k < 3; ++k)
+			quadrics[rep[result[i + k]]].add_plane(n, d, area);
+	}
+}
+
+/* Collapse the cheapest edges in passes. In a pass every vertex moves at most
+ * once and nothing around a moved vertex changes again, so the adjacency built
+ * at the start of the pass stays valid.
+ */
+void simplifier::run(size_t targetIndices, float maxError)
+{
+	if(radius <= 0)
+		return;
+	double maxCost = double(maxError)*radius;
+	maxCost *= maxCost;
+	while(result.size() > targetIndices){
+		// Triangles around every vertex.
+		offsets.assign(numVertices + 1, 0);
+		for(size_t i = 0; i < result.size(); ++i)
+			++offsets[result[i] + 1];
+		for(size_t v = 0; v < numVertices; ++v)
+			offsets[v + 1] += offsets[v];
+		triangles.resize(result.size());
+		std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+		for(size_t i = 0; i < result.size(); ++i)
+			triangles[fill[result[i]]++] = i/3;
+
+		// Both directions of every edge. An inner edge is in two triangles,
+		// take it from the one where it goes from the lower index.
+		candidates.clear();
+		for(size_t i = 0; i < result.size(); i += 3){
+			for(int k = 0; k < 3; ++k){
+				unsigned int a = result[i + k], b = result[i + (k + 1)%3];
+				if(a > b)
+					continue;
+				for(int dir = 0; dir < 2; ++dir, std::swap(a, b)){
+					if(locked[a])
+						continue;
+					quadric q = quadrics[rep[a]];
+					q += quadrics[rep[b]];
+					collapse c = { a, b, q.weight > 0? q.eval(position(b))/q.weight: 0 };
+					candidates.push_back(c);
+				}
+			}
+		}
+		std::sort(candidates.begin(), candidates.end());
+
+		std::fill(touched.begin(), touched.end(), 0);
+		for(size_t v = 0; v < numVertices; ++v)
+			remap[v] = v;
+		size_t numTriangles = result.size()/3, collapses = 0;
+		for(size_t c = 0; c < candidates.size() && numTriangles*3 > targetIndices; ++c){
+			unsigned int a = candidates[c].from, b = candidates[c].to;
+			if(candidates[c].cost > maxCost)
+				break;
+			if(touched[a] || touched[b])
+				continue;
+
+			// Reject a collapse that flips or folds a triangle, or that moves a
+			// onto another copy of b's position than the one the triangles of
+			// a are textured with.
+			bool valid = true;
+			size_t removed = 0;
+			for(unsigned int t = offsets[a]; valid && t < offsets[a + 1]; ++t){
+				const unsigned int *tri = &result[triangles[t]*3];
+				if(tri[0] == b || tri[1] == b || tri[2] == b){
+					++removed;
+					continue;
+				}
+				const float *p[3], *q[3];
+				for(int k = 0; k < 3; ++k){
+					if(tri[k] != a && rep[tri[k]] == rep[b])
+						valid = false;
+					p[k] = position(tri[k]);
+					q[k] = tri[k] == a? position(b): p[k];
+				}
+				double n0[3], n1[3];
+				triangle_normal(p[0], p[1], p[2], n0);
+				triangle_normal(q[0], q[1], q[2], n1);
+				double dot = n0[0]*n1[0] + n0[1]*n1[1] + n0[2]*n1[2];
+				double len = std::sqrt((n0[0]*n0[0] + n0[1]*n0[1] + n0[2]*n0[2])*
+						(n1[0]*n1[0] + n1[1]*n1[1] + n1[2]*n1[2]));
+				if(dot <= 0.25*len)
+					valid = false;
+			}
+			if(!valid)
+				continue;
+
+			remap[a] = b;
+			quadrics[rep[b]] += quadrics[rep[a]];
+			for(unsigned int t = offsets[a]; t < offsets[a + 1]; ++t){
+				const unsigned int *tri = &result[triangles[t]*3];
+				touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = 1;
+			}
+			numTriangles -= removed;
+			reached = std::max(reached, candidates[c].cost);
+			++collapses;
+		}
+		if(collapses == 0)
+			break;
+
+		// Apply the collapses and drop the degenerate triangles.
+		size_t out = 0;
+		for(size_t i = 0; i < result.size(); i += 3){
+			unsigned int v0 = remap[result[i]], v1 = remap[result[i + 1]], v2 = remap[result[i + 2]];
+			if(v0 == v1 || v1 == v2 || v2 == v0)
+				continue;
+			result[out++] = v0;
+			result[out++] = v1;
+			result[out++] = v2;
+		}
+		result.resize(out);
+	}
+}
+
+std::vector<unsigned int> simplify_mesh(const unsigned int *indices, size_t numIndices,
+		const float *vertices, size_t numVertices, size_t stride,
+		size_t targetIndices, float maxError, float *error)
+{
+	simplifier s(indices, numIndices, vertices, numVertices, stride);
+	s.run(targetIndices, maxError);
+	if(error)
+		*error = s.error();
+	return s.result;
+}
+
+void build_lod_chain(const unsigned int *indices, size_t numIndices,
+		const float *vertices, size_t numVertices, size_t stride, unsigned int numLevels,
+		std::vector<unsigned int> &lodIndices, std::vector<mesh_lod> &lods)
+{
+	lodIndices.assign(indices, indices + numIndices);
+	lods.clear();
+	mesh_lod full = { 0, numIndices, 0.0f };
+	lods.push_back(full);
+
+	// Every level continues the simplification of the previous one. The
+	// quadrics still hold the planes of the full mesh, so the error of every
+	// level is measured against the full mesh.
+	simplifier s(indices, numIndices, vertices, numVertices, stride);
+	while(lods.size() < numLevels){
+		size_t previous = s.result.size();
+		s.run(previous/6*3, 1.0f);
+		// Stop when the simplification gets stuck on locked vertices.
+		if(s.result.empty() || s.result.size() > previous*9/10)
+			break;
+
+		mesh_lod lod = { lodIndices.size(), s.result.size(), s.error() };
+		lodIndices.insert(lodIndices.end(), s.result.begin(), s.result.end());
+		optimize_vertex_cache(&lodIndices[lod.firstIndex], lod.numIndices, numVertices);
+		lods.push_back(lod);
+	}
+}
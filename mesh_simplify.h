@@ -0,0 +1,51 @@
+#ifndef _MESH_SIMPLIFY_H
+#define _MESH_SIMPLIFY_H
+
+#include <cstddef>
+#include <vector>
+
+/* Mesh simplification with quadric error metrics (Garland and Heckbert, 1997).
+ *
+ * Edges are collapsed onto one of their existing vertices, so every level of
+ * detail is only a new index list over the original vertex buffer and all the
+ * levels can share one vertex buffer object.
+ *
+ * Vertices on a UV seam (several vertices at the same position with different
+ * texcoords or normals) and on an open border never move, so the seams do not
+ * tear and the texture mapping of the remaining triangles is kept.
+ */
+
+/* Simplify a triangle list down to about 'targetIndices' indices.
+ * Parameter:
+ * - vertices, numVertices, stride: Position x, y, z of vertex i is at
+ *   vertices[i*stride], in floats.
+ * - maxError: Stop before an error larger than this, relative to the radius
+ *   of the mesh.
+ * - error: Optional output of the relative error reached.
+ * Return:
+ * - The simplified index list. It is not shorter than 'targetIndices' unless
+ *   it cannot be simplified any further within 'maxError'.
+ */
+std::vector<unsigned int> simplify_mesh(const unsigned int *indices, size_t numIndices,
+		const float *vertices, size_t numVertices, size_t stride,
+		size_t targetIndices, float maxError, float *error = nullptr);
+
+/* A level of detail as a range of a shared index buffer. */
+struct mesh_lod {
+	size_t firstIndex;
+	size_t numIndices;
+	float error;	// Relative error of simplify_mesh, 0 for the full mesh
+};
+
+/* Build a LOD chain: the full mesh, then halving the triangle count per level
+ * until 'numLevels' levels exist or the mesh stops simplifying.
+ * Parameter:
+ * - lodIndices: Output, the index lists of all the levels one after another.
+ *   Each level is reordered for the vertex cache.
+ * - lods: Output, the range of every level in 'lodIndices'.
+ */
+void build_lod_chain(const unsigned int *indices, size_t numIndices,
+		const float *vertices, size_t numVertices, size_t stride, unsigned int numLevels,
+		std::vector<unsigned int> &lodIndices, std::vector<mesh_lod> &lods);
+
+#endif // _MESH_SIMPLIFY_H
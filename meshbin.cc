@@ -0,0 +1,175 @@
+#include "meshbin.h"
+
+#include <cstring>
+#include "mapped_file.h"
+
+/* Check that 'array' lies inside the mapped file and is aligned. */
+static bool array_in_file(const meshbin_array &array, size_t elementSize, size_t fileSize)
+{
+	if(array.count == 0)
+		return true;
+	if(array.offset % MESHBIN_ALIGNMENT != 0 || array.offset > fileSize)
+		return false;
+	return array.count <= (fileSize - array.offset) / elementSize;
+}
+
+bool meshbin_open(const char *objfile, meshbin &cache)
+{
+	meshbin_close(cache);
+
+	size_t objSize;
+	void *obj = map_file(objfile, &objSize);
+	if(!obj)
+		return false;
+	cache.sourceHash = hash_bytes(static_cast<const unsigned char *>(obj), objSize);
+	cache.sourceSize = objSize;
+	unmap_file(obj, objSize);
+
+	std::string cachefile = std::string(objfile) + ".meshbin";
+	size_t size;
+	void *addr = map_file(cachefile.c_str(), &size);
+	if(!addr)
+		return false;
+
+	const char *base = static_cast<const char *>(addr);
+	const meshbin_header *header = static_cast<const meshbin_header *>(addr);
+	bool valid = size >= sizeof(meshbin_header) &&
+		memcmp(header->magic, MESHBIN_MAGIC, sizeof(MESHBIN_MAGIC)) == 0 &&
+		header->version == MESHBIN_VERSION &&
+		header->sourceHash == cache.sourceHash &&
+		header->sourceSize == cache.sourceSize &&
+		header->numShapes <= (size - sizeof(meshbin_header)) / sizeof(meshbin_shape_entry);
+
+	const meshbin_shape_entry *entries = reinterpret_cast<const meshbin_shape_entry *>(header + 1);
+	for(unsigned int i = 0; valid && i < header->numShapes; ++i){
+		const meshbin_shape_entry &e = entries[i];
+		valid = e.name.offset <= size && e.name.count <= size - e.name.offset &&
+			array_in_file(e.positions, sizeof(float), size) &&
+			array_in_file(e.normals, sizeof(float), size) &&
+			array_in_file(e.texcoords, sizeof(float), size) &&
+			array_in_file(e.vertices, sizeof(float), size) &&
+			array_in_file(e.indices, sizeof(unsigned int), size) &&
+			array_in_file(e.materialIds, sizeof(int), size);
+		if(!valid)
+			break;
+
+		meshbin_shape shape;
+		shape.name.assign(base + e.name.offset, e.name.count);
+		shape.positions = reinterpret_cast<const float *>(base + e.positions.offset);
+		shape.numPositions = e.positions.count;
+		shape.normals = reinterpret_cast<const float *>(base + e.normals.offset);
+		shape.numNormals = e.normals.count;
+		shape.texcoords = reinterpret_cast<const float *>(base + e.texcoords.offset);
+		shape.numTexcoords = e.texcoords.count;
+		shape.vertices = reinterpret_cast<const float *>(base + e.vertices.offset);
+		shape.numVertices = e.vertices.count;
+		shape.indices = reinterpret_cast<const unsigned int *>(base + e.indices.offset);
+		shape.numIndices = e.indices.count;
+		shape.materialIds = reinterpret_cast<const int *>(base + e.materialIds.offset);
+		shape.numMaterialIds = e.materialIds.count;
+		cache.shapes.push_back(shape);
+	}
+
+	if(!valid){
+		cache.shapes.clear();
+		unmap_file(addr, size);
+		return false;
+	}
+	cache.addr = addr;
+	cache.size = size;
+	return true;
+}
+
+void meshbin_view(const std::vector<tinyobj::shape_t> &shapes, meshbin &cache)
+{
+	cache.shapes.clear();
+	for(size_t i = 0; i < shapes.size(); ++i){
+		const tinyobj::mesh_t &mesh = shapes[i].mesh;
+		meshbin_shape shape;
+		shape.name = shapes[i].name;
+		shape.positions = mesh.positions.data();
+		shape.numPositions = mesh.positions.size();
+		shape.normals = mesh.normals.data();
+		shape.numNormals = mesh.normals.size();
+		shape.texcoords = mesh.texcoords.data();
+		shape.numTexcoords = mesh.texcoords.size();
+		shape.vertices = mesh.vertices.data();
+		shape.numVertices = mesh.vertices.size();
+		shape.indices = mesh.indices.data();
+		shape.numIndices = mesh.indices.size();
+		shape.materialIds = mesh.material_ids.data();
+		shape.numMaterialIds = mesh.material_ids.size();
+		cache.shapes.push_back(shape);
+	}
+}
+
+/* Reserve space for 'count' elements of 'elementSize' bytes at the end of the file. */
+static meshbin_array place_array(unsigned long long &end, size_t count, size_t elementSize,
+		size_t alignment)
+{
+	meshbin_array array;
+	end = (end + alignment - 1) / alignment * alignment;
+	array.offset = end;
+	array.count = count;
+	end += count * elementSize;
+	return array;
+}
+
+/* memcpy which also accepts the null data() of an empty vector. */
+static void copy_array(char *dst, const void *src, size_t bytes)
+{
+	if(bytes)
+		memcpy(dst, src, bytes);
+}
+
+bool meshbin_write(const char *objfile, const meshbin &cache,
+		const std::vector<tinyobj::shape_t> &shapes)
+{
+	meshbin_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MESHBIN_MAGIC, sizeof(MESHBIN_MAGIC));
+	header.version = MESHBIN_VERSION;
+	header.numShapes = shapes.size();
+	header.sourceHash = cache.sourceHash;
+	header.sourceSize = cache.sourceSize;
+
+	// Lay out the names and the arrays after the shape table.
+	std::vector<meshbin_shape_entry> entries(shapes.size());
+	unsigned long long end = sizeof(header) + sizeof(meshbin_shape_entry)*shapes.size();
+	for(size_t i = 0; i < shapes.size(); ++i){
+		const tinyobj::mesh_t &mesh = shapes[i].mesh;
+		entries[i].name = place_array(end, shapes[i].name.size(), 1, 1);
+		entries[i].positions = place_array(end, mesh.positions.size(), sizeof(float), MESHBIN_ALIGNMENT);
+		entries[i].normals = place_array(end, mesh.normals.size(), sizeof(float), MESHBIN_ALIGNMENT);
+		entries[i].texcoords = place_array(end, mesh.texcoords.size(), sizeof(float), MESHBIN_ALIGNMENT);
+		entries[i].vertices = place_array(end, mesh.vertices.size(), sizeof(float), MESHBIN_ALIGNMENT);
+		entries[i].indices = place_array(end, mesh.indices.size(), sizeof(unsigned int), MESHBIN_ALIGNMENT);
+		entries[i].materialIds = place_array(end, mesh.material_ids.size(), sizeof(int), MESHBIN_ALIGNMENT);
+	}
+
+	std::vector<char> data(end, 0);
+	memcpy(&data[0], &header, sizeof(header));
+	copy_array(&data[sizeof(header)], entries.data(), sizeof(meshbin_shape_entry)*entries.size());
+	for(size_t i = 0; i < shapes.size(); ++i){
+		const tinyobj::mesh_t &mesh = shapes[i].mesh;
+		const meshbin_shape_entry &e = entries[i];
+		copy_array(&data[0] + e.name.offset, shapes[i].name.data(), e.name.count);
+		copy_array(&data[0] + e.positions.offset, mesh.positions.data(), sizeof(float)*e.positions.count);
+		copy_array(&data[0] + e.normals.offset, mesh.normals.data(), sizeof(float)*e.normals.count);
+		copy_array(&data[0] + e.texcoords.offset, mesh.texcoords.data(), sizeof(float)*e.texcoords.count);
+		copy_array(&data[0] + e.vertices.offset, mesh.vertices.data(), sizeof(float)*e.vertices.count);
+		copy_array(&data[0] + e.indices.offset, mesh.indices.data(), sizeof(unsigned int)*e.indices.count);
+		copy_array(&data[0] + e.materialIds.offset, mesh.material_ids.data(), sizeof(int)*e.materialIds.count);
+	}
+
+	return replace_file((std::string(objfile) + ".meshbin").c_str(), &data[0], data.size());
+}
+
+void meshbin_close(meshbin &cache)
+{
+	if(cache.addr)
+		unmap_file(cache.addr, cache.size);
+	cache.addr = nullptr;
+	cache.size = 0;
+	cache.shapes.clear();
+}
@@ -0,0 +1,91 @@
+#ifndef _MESHBIN_H
+#define _MESHBIN_H
+
+#include <string>
+#include <vector>
+#include "tiny_obj_loader.h"
+
+/* Binary cache of the shapes loaded from an OBJ file.
+ *
+ * The cache of "foo.obj" is written next to it as "foo.obj.meshbin". It
+ * records the hash of the OBJ contents and the format version, and is
+ * ignored when either of them does not match. Layout (little endian):
+ * - meshbin_header
+ * - numShapes * meshbin_shape_entry
+ * - The shape names and the arrays, each array aligned to MESHBIN_ALIGNMENT.
+ */
+#define MESHBIN_MAGIC "MESHBIN"
+#define MESHBIN_VERSION 4
+#define MESHBIN_ALIGNMENT 16
+
+struct meshbin_header {
+	char magic[8];
+	unsigned int version;
+	unsigned int numShapes;
+	unsigned long long sourceHash;	// Hash of the OBJ contents
+	unsigned long long sourceSize;	// Size of the OBJ file in bytes
+};
+
+/* Offsets are from the beginning of the file, counts are in elements. */
+struct meshbin_array {
+	unsigned long long offset;
+	unsigned long long count;
+};
+
+struct meshbin_shape_entry {
+	meshbin_array name;
+	meshbin_array positions;
+	meshbin_array normals;
+	meshbin_array texcoords;
+	meshbin_array vertices;
+	meshbin_array indices;
+	meshbin_array materialIds;
+};
+
+/* A shape whose arrays point into a mapped cache file or into shape_t. */
+struct meshbin_shape {
+	std::string name;
+	const float *positions;
+	size_t numPositions;
+	const float *normals;
+	size_t numNormals;
+	const float *texcoords;
+	size_t numTexcoords;
+	const float *vertices;	// Interleaved, see tinyobj::LOAD_INTERLEAVED
+	size_t numVertices;
+	const unsigned int *indices;
+	size_t numIndices;
+	const int *materialIds;
+	size_t numMaterialIds;
+};
+
+struct meshbin {
+	void *addr;	// The mapped cache file, nullptr if not mapped
+	size_t size;
+	unsigned long long sourceHash;
+	unsigned long long sourceSize;
+	std::vector<meshbin_shape> shapes;
+	meshbin(): addr(nullptr), size(0), sourceHash(0), sourceSize(0) {}
+};
+
+/* Hash the contents of 'objfile' and map its cache if the cache is valid.
+ * Return:
+ * - true if 'cache->shapes' point into the mapped cache.
+ * - false if there is no valid cache. 'cache->sourceHash' and
+ *   'cache->sourceSize' are still set for meshbin_write if the OBJ could be read.
+ */
+bool meshbin_open(const char *objfile, meshbin &cache);
+
+/* Point 'cache->shapes' at the arrays of 'shapes' instead of a cache file. */
+void meshbin_view(const std::vector<tinyobj::shape_t> &shapes, meshbin &cache);
+
+/* Write the cache of 'objfile' for 'shapes' parsed from the contents
+ * identified by 'cache.sourceHash'. Return false if it cannot be written.
+ */
+bool meshbin_write(const char *objfile, const meshbin &cache,
+		const std::vector<tinyobj::shape_t> &shapes);
+
+/* Unmap the cache file and drop the shape views. */
+void meshbin_close(meshbin &cache);
+
+#endif // _MESHBIN_H
@@ -0,0 +1,180 @@
+/* Checks that a .meshbin cache reads back the shapes it was written from and
+ * that it is ignored once the OBJ or the format version changes.
+ *
+ * Usage: meshbin_test
+ *
+ * The test files are written to the working directory and removed again.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include "meshbin.h"
+#include "mapped_file.h"
+
+#define TEST_OBJ "meshbin_test.obj"
+#define TEST_CACHE TEST_OBJ ".meshbin"
+
+static int failures = 0;
+
+static void fail(const std::string &what)
+{
+	failures++;
+	std::cerr << "FAIL: " << what << std::endl;
+}
+
+static void write_file(const char *filename, const std::string &contents)
+{
+	if(!replace_file(filename, contents.data(), contents.size()))
+		fail(std::string("cannot write ") + filename);
+}
+
+static std::string read_file(const char *filename)
+{
+	size_t size;
+	void *addr = map_file(filename, &size);
+	if(!addr)
+		return std::string();
+	std::string contents(static_cast<const char *>(addr), size);
+	unmap_file(addr, size);
+	return contents;
+}
+
+template <typename T>
+static bool same_array(const T *a, size_t count, const std::vector<T> &b)
+{
+	return count == b.size() && (count == 0 || memcmp(a, b.data(), count*sizeof(T)) == 0);
+}
+
+/* One shape with every array filled, one with some and one with none. */
+static std::vector<tinyobj::shape_t> make_shapes()
+{
+	std::vector<tinyobj::shape_t> shapes(3);
+	shapes[0].name = "first";
+	for(int i = 0; i < 30; ++i){
+		shapes[0].mesh.positions.push_back(i*0.5f);
+		shapes[0].mesh.normals.push_back(-i*0.25f);
+	}
+	for(int i = 0; i < 20; ++i)
+		shapes[0].mesh.texcoords.push_back(i/20.0f);
+	for(int i = 0; i < 80; ++i)
+		shapes[0].mesh.vertices.push_back(i*3.0f);
+	for(unsigned int i = 0; i < 9; ++i)
+		shapes[0].mesh.indices.push_back(i);
+	shapes[0].mesh.material_ids.assign(3, 1);
+
+	shapes[1].name = "second, with a longer name";
+	shapes[1].mesh.positions.assign(9, 1.0f);
+	shapes[1].mesh.indices.push_back(2);
+	shapes[1].mesh.indices.push_back(1);
+	shapes[1].mesh.indices.push_back(0);
+	shapes[1].mesh.material_ids.push_back(-1);
+	return shapes;
+}
+
+static bool same_shapes(const meshbin &cache, const std::vector<tinyobj::shape_t> &shapes)
+{
+	if(cache.shapes.size() != shapes.size())
+		return false;
+	for(size_t i = 0; i < shapes.size(); ++i){
+		const meshbin_shape &s = cache.shapes[i];
+		const tinyobj::mesh_t &mesh = shapes[i].mesh;
+		if(s.name != shapes[i].name ||
+				!same_array(s.positions, s.numPositions, mesh.positions) ||
+				!same_array(s.normals, s.numNormals, mesh.normals) ||
+				!same_array(s.texcoords, s.numTexcoords, mesh.texcoords) ||
+				!same_array(s.vertices, s.numVertices, mesh.vertices) ||
+				!same_array(s.indices, s.numIndices, mesh.indices) ||
+				!same_array(s.materialIds, s.numMaterialIds, mesh.material_ids))
+			return false;
+	}
+	return true;
+}
+
+static void test_round_trip(const std::vector<tinyobj::shape_t> &shapes)
+{
+	meshbin cache;
+	std::remove(TEST_CACHE);
+	if(meshbin_open(TEST_OBJ, cache))
+		fail("a missing cache is opened");
+	if(!meshbin_write(TEST_OBJ, cache, shapes))
+		fail("cannot write the cache");
+
+	if(!meshbin_open(TEST_OBJ, cache))
+		fail("the written cache is not opened");
+	else if(!same_shapes(cache, shapes))
+		fail("the cache does not read back the shapes it was written from");
+	meshbin_close(cache);
+}
+
+/* Open the cache after replacing its contents with 'contents'. */
+static bool opens_with(const std::string &contents)
+{
+	meshbin cache;
+	write_file(TEST_CACHE, contents);
+	bool opened = meshbin_open(TEST_OBJ, cache);
+	meshbin_close(cache);
+	return opened;
+}
+
+static void test_invalidation(const std::vector<tinyobj::shape_t> &shapes)
+{
+	std::string written = read_file(TEST_CACHE);
+	if(written.size() < sizeof(meshbin_header)){
+		fail("the cache is smaller than its header");
+		return;
+	}
+
+	std::string other = written;
+	reinterpret_cast<meshbin_header *>(&other[0])->version = MESHBIN_VERSION - 1;
+	if(opens_with(other))
+		fail("a cache of another format version is opened");
+
+	other = written;
+	other[0] = 'X';
+	if(opens_with(other))
+		fail("a cache without the magic is opened");
+
+	if(opens_with(written.substr(0, written.size()/2)))
+		fail("a truncated cache is opened");
+
+	other = written;
+	reinterpret_cast<meshbin_shape_entry *>(&other[sizeof(meshbin_header)])->indices.offset += 4;
+	if(opens_with(other))
+		fail("a cache with a misaligned array is opened");
+
+	if(!opens_with(written))
+		fail("the rewritten cache is not opened");
+
+	// The same size, other contents, and then another size.
+	write_file(TEST_OBJ, "v 0 0 1\nv 0 1 0\nv 1 0 0\nf 1 2 3\n");
+	meshbin cache;
+	if(meshbin_open(TEST_OBJ, cache))
+		fail("the cache of a changed OBJ is opened");
+	write_file(TEST_OBJ, "v 0 0 0\nv 0 1 0\nv 1 0 0\nf 1 2 3\n# a comment\n");
+	if(meshbin_open(TEST_OBJ, cache))
+		fail("the cache of a grown OBJ is opened");
+
+	// Which a new cache of the changed OBJ fixes.
+	if(!meshbin_write(TEST_OBJ, cache, shapes) || !meshbin_open(TEST_OBJ, cache))
+		fail("the cache of the changed OBJ is not opened");
+	meshbin_close(cache);
+}
+
+int main()
+{
+	std::vector<tinyobj::shape_t> shapes = make_shapes();
+	write_file(TEST_OBJ, "v 0 0 0\nv 0 1 0\nv 1 0 0\nf 1 2 3\n");
+	test_round_trip(shapes);
+	test_invalidation(shapes);
+	std::remove(TEST_OBJ);
+	std::remove(TEST_CACHE);
+
+	if(failures){
+		std::cerr << failures << " failures" << std::endl;
+		return 1;
+	}
+	std::cout << "meshbin_test: all passed" << std::endl;
+	return 0;
+}
@@ -0,0 +1,137 @@
+#include "mipmap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+unsigned int mip_levels(unsigned int width, unsigned int height)
+{
+	unsigned int levels = 1;
+	while(width > 1 || height > 1){
+		width = width > 1? width/2: 1;
+		height = height > 1? height/2: 1;
+		++levels;
+	}
+	return levels;
+}
+
+size_t mip_offset(unsigned int width, unsigned int height, unsigned int level)
+{
+	size_t offset = 0;
+	for(unsigned int i = 0; i < level; ++i){
+		offset += size_t(width)*height*4;
+		width = width > 1? width/2: 1;
+		height = height > 1? height/2: 1;
+	}
+	return offset;
+}
+
+size_t mip_chain_size(unsigned int width, unsigned int height)
+{
+	return mip_offset(width, height, mip_levels(width, height));
+}
+
+/* One level from the previous one. A side of 1 is not halved, so its texels
+ * are averaged with themselves.
+ */
+static void downsample(const unsigned char *src, unsigned int srcWidth, unsigned int srcHeight,
+		unsigned char *dst, unsigned int width, unsigned int height)
+{
+	const size_t dx = srcWidth > 1? 4: 0;
+	const size_t dy = srcHeight > 1? size_t(srcWidth)*4: 0;
+	const size_t srcStep = srcHeight > 1? 2: 1;
+	for(unsigned int y = 0; y < height; ++y){
+		const unsigned char *row = src + y*srcStep*srcWidth*4;
+		for(unsigned int x = 0; x < width; ++x, dst += 4){
+			const unsigned char *p = row + x*2*dx;
+			for(int c = 0; c < 4; ++c)
+				dst[c] = (unsigned char)((p[c] + p[dx + c] + p[dy + c] + p[dy + dx + c] + 2) >> 2);
+		}
+	}
+}
+
+void generate_mips(unsigned char *chain, unsigned int width, unsigned int height)
+{
+	unsigned char *src = chain;
+	while(width > 1 || height > 1){
+		unsigned int nextWidth = width > 1? width/2: 1;
+		unsigned int nextHeight = height > 1? height/2: 1;
+		unsigned char *dst = src + size_t(width)*height*4;
+		downsample(src, width, height, dst, nextWidth, nextHeight);
+		src = dst;
+		width = nextWidth;
+		height = nextHeight;
+	}
+}
+
+/* The taps of a tent filter along one axis: for destination texel i, the
+ * source texels first[i] to first[i + 1] - 1 of 'index' and their 'weight',
+ * which add up to 1.
+ */
+struct resample_taps {
+	std::vector<unsigned int> first;
+	std::vector<unsigned int> index;
+	std::vector<float> weight;
+};
+
+static void tent_taps(unsigned int srcSize, unsigned int dstSize, resample_taps &taps)
+{
+	const float scale = float(srcSize)/dstSize;
+	const float radius = std::max(1.0f, scale);
+	taps.first.assign(1, 0);
+	for(unsigned int i = 0; i < dstSize; ++i){
+		// Texel centers of the destination in source coordinates.
+		const float center = (i + 0.5f)*scale - 0.5f;
+		const int lower = (int)std::ceil(center - radius), upper = (int)std::floor(center + radius);
+		float sum = 0.0f;
+		const size_t begin = taps.index.size();
+		for(int j = lower; j <= upper; ++j){
+			float w = 1.0f - std::fabs(j - center)/radius;
+			if(w <= 0.0f)
+				continue;
+			taps.index.push_back(std::min(std::max(j, 0), (int)srcSize - 1));
+			taps.weight.push_back(w);
+			sum += w;
+		}
+		for(size_t k = begin; k < taps.weight.size(); ++k)
+			taps.weight[k] /= sum;
+		taps.first.push_back(taps.index.size());
+	}
+}
+
+void resize_image(const unsigned char *src, unsigned int srcWidth, unsigned int srcHeight,
+		unsigned char *dst, unsigned int dstWidth, unsigned int dstHeight)
+{
+	resample_taps columns, rows;
+	tent_taps(srcWidth, dstWidth, columns);
+	tent_taps(srcHeight, dstHeight, rows);
+
+	// Rows first, into floats, then columns of those rows.
+	std::vector<float> wide(size_t(dstWidth)*srcHeight*4);
+	for(unsigned int y = 0; y < srcHeight; ++y){
+		const unsigned char *in = src + size_t(y)*srcWidth*4;
+		float *out = &wide[size_t(y)*dstWidth*4];
+		for(unsigned int x = 0; x < dstWidth; ++x, out += 4){
+			float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			for(unsigned int k = columns.first[x]; k < columns.first[x + 1]; ++k){
+				const unsigned char *p = in + columns.index[k]*4;
+				for(int c = 0; c < 4; ++c)
+					sum[c] += columns.weight[k]*p[c];
+			}
+			std::copy(sum, sum + 4, out);
+		}
+	}
+	for(unsigned int y = 0; y < dstHeight; ++y){
+		unsigned char *out = dst + size_t(y)*dstWidth*4;
+		for(unsigned int x = 0; x < dstWidth; ++x, out += 4){
+			float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			for(unsigned int k = rows.first[y]; k < rows.first[y + 1]; ++k){
+				const float *p = &wide[(size_t(rows.index[k])*dstWidth + x)*4];
+				for(int c = 0; c < 4; ++c)
+					sum[c] += rows.weight[k]*p[c];
+			}
+			for(int c = 0; c < 4; ++c)
+				out[c] = (unsigned char)std::min(255.0f, sum[c] + 0.5f);
+		}
+	}
+}
@@ -0,0 +1,34 @@
+#ifndef _MIPMAP_H
+#define _MIPMAP_H
+
+#include <cstddef>
+
+/* Mipmaps of RGBA8 images made on the CPU.
+ *
+ * A mip chain is stored in one array, level 0 first and every level tightly
+ * packed right after the previous one. Level i is max(1, width >> i) by
+ * max(1, height >> i), down to 1x1 like glGenerateMipmap.
+ */
+
+/* Number of levels in the chain of a width x height image. */
+unsigned int mip_levels(unsigned int width, unsigned int height);
+
+/* Size in bytes of the whole chain. */
+size_t mip_chain_size(unsigned int width, unsigned int height);
+
+/* Byte offset of 'level' in the chain. */
+size_t mip_offset(unsigned int width, unsigned int height, unsigned int level);
+
+/* Fill levels 1 and up of 'chain' from level 0 with a 2x2 box filter. The
+ * last row and column of odd sized levels are dropped.
+ */
+void generate_mips(unsigned char *chain, unsigned int width, unsigned int height);
+
+/* Resample an RGBA8 image to dstWidth x dstHeight with a tent filter, which
+ * is bilinear when enlarging and spans every source texel under the
+ * destination texel when shrinking.
+ */
+void resize_image(const unsigned char *src, unsigned int srcWidth, unsigned int srcHeight,
+		unsigned char *dst, unsigned int dstWidth, unsigned int dstHeight);
+
+#endif // _MIPMAP_H
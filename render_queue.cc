@@ -0,0 +1,104 @@
+#include "render_queue.h"
+
+#include <algorithm>
+#include "gl_state.h"
+#include "shader_uniforms.h"
+
+#define DEPTH_BITS 24
+#define LOD_BITS 4
+#define TEXTURE_BITS 12
+#define VERTEX_ARRAY_BITS 12
+#define PROGRAM_BITS 8
+#define PASS_BITS 4
+
+static std::vector<render_item> scratch;	// The other buffer of the radix sort
+
+static render_counters counters;
+
+/* Append 'bits' bits of 'value' to 'key'. */
+static unsigned long long push_bits(unsigned long long key, unsigned int value, unsigned int bits)
+{
+	return (key << bits) | (value & ((1u << bits) - 1));
+}
+
+unsigned long long make_render_key(render_pass pass, unsigned int program,
+		unsigned int vertexArray, unsigned int texture, unsigned int lod, float depth)
+{
+	depth = std::min(std::max(depth, 0.0f), 1.0f);
+	if(pass == PASS_BLENDED)
+		depth = 1.0f - depth;
+	unsigned long long key = 0;
+	key = push_bits(key, pass, PASS_BITS);
+	key = push_bits(key, program, PROGRAM_BITS);
+	key = push_bits(key, vertexArray, VERTEX_ARRAY_BITS);
+	key = push_bits(key, texture, TEXTURE_BITS);
+	key = push_bits(key, lod, LOD_BITS);
+	return push_bits(key, (unsigned int)(depth*((1u << DEPTH_BITS) - 1)), DEPTH_BITS);
+}
+
+void sort_render_queue(std::vector<render_item> &items)
+{
+	if(items.size() < 2)
+		return;
+
+	// The histograms of all the bytes in one pass over the keys.
+	size_t counts[8][256] = {};
+	for(size_t i = 0; i < items.size(); ++i)
+		for(int byte = 0; byte < 8; ++byte)
+			++counts[byte][(items[i].key >> 8*byte) & 0xff];
+
+	scratch.resize(items.size());
+	for(int byte = 0; byte < 8; ++byte){
+		size_t *count = counts[byte];
+		if(count[(items[0].key >> 8*byte) & 0xff] == items.size())
+			continue;
+		size_t offset = 0;
+		for(int digit = 0; digit < 256; ++digit){
+			size_t n = count[digit];
+			count[digit] = offset;
+			offset += n;
+		}
+		for(size_t i = 0; i < items.size(); ++i)
+			scratch[count[(items[i].key >> 8*byte) & 0xff]++] = items[i];
+		items.swap(scratch);
+	}
+}
+
+/* Count a bind, dropped if it was 'bound' already.
+ * Return:
+ * - false if it was dropped.
+ */
+static bool count_bind(bool bound)
+{
+	if(bound){
+		++counters.bindsSkipped;
+		return false;
+	}
+	++counters.bindsIssued;
+	return true;
+}
+
+bool queue_use_program(unsigned int program)
+{
+	return count_bind(!use_program(program));
+}
+
+bool queue_bind_vertex_array(unsigned int vao)
+{
+	return count_bind(!state_bind_vertex_array(vao));
+}
+
+bool queue_bind_texture(unsigned int target, unsigned int texture)
+{
+	return count_bind(!state_bind_texture(0, target, texture));
+}
+
+const render_counters &get_render_counters()
+{
+	return counters;
+}
+
+void reset_render_counters()
+{
+	counters = render_counters();
+}
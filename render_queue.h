@@ -0,0 +1,58 @@
+#ifndef _RENDER_QUEUE_H
+#define _RENDER_QUEUE_H
+
+#include <vector>
+
+/* The draws of a frame in the order that changes the least GL state.
+ *
+ * Every draw gets a 64-bit key, most significant bits first:
+ * - pass, 4 bits
+ * - program, 8 bits
+ * - vertex array, 12 bits
+ * - texture, 12 bits
+ * - level of detail, 4 bits
+ * - depth, 24 bits: front to back, back to front in PASS_BLENDED
+ * The program, vertex array and texture are ranks the caller gives them in
+ * this frame, not GL names, so they fit. Larger ranks are masked, which only
+ * makes the order worse, so submission compares the real state of the draws.
+ * sort_render_queue() is a stable radix sort, so draws with equal keys stay
+ * in the order they were queued. The queue_* binds go through gl_state.h and
+ * count the binds of the submission it issues and drops.
+ */
+
+enum render_pass {
+	PASS_OPAQUE,
+	PASS_BLENDED	// Drawn after the opaque pass, far ones first
+};
+
+struct render_item {
+	unsigned long long key;
+	unsigned int index;	// Of the draw in the caller's list
+};
+
+/* Pack a key. 'depth' is clamped to [0, 1], 0 at the camera. */
+unsigned long long make_render_key(render_pass pass, unsigned int program,
+		unsigned int vertexArray, unsigned int texture, unsigned int lod, float depth);
+
+/* Sort by key, 8 bits per pass, skipping the bytes all the keys share. */
+void sort_render_queue(std::vector<render_item> &items);
+
+/* Bind a program, a vertex array, or a texture on unit 0. The program is
+ * use_program() of shader_uniforms.h.
+ * Return:
+ * - false if the bind is skipped.
+ */
+bool queue_use_program(unsigned int program);
+bool queue_bind_vertex_array(unsigned int vao);
+bool queue_bind_texture(unsigned int target, unsigned int texture);
+
+/* Binds of the queue_* functions since the last reset_render_counters(). */
+struct render_counters {
+	unsigned long bindsIssued;
+	unsigned long bindsSkipped;
+};
+
+const render_counters &get_render_counters();
+void reset_render_counters();
+
+#endif // _RENDER_QUEUE_H
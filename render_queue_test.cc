@@ -0,0 +1,131 @@
+/* Checks that sort_render_queue() orders the draws as std::stable_sort does
+ * and the order of the keys of make_render_key().
+ *
+ * Usage: render_queue_test
+ *
+ * No GL context is needed: the binds render_queue.cc issues are stubbed out.
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+#include "render_queue.h"
+#include "gl_state.h"
+#include "shader_uniforms.h"
+
+bool use_program(unsigned int /*program*/) { return true; }
+bool state_bind_vertex_array(unsigned int /*vao*/) { return true; }
+bool state_bind_texture(unsigned int /*unit*/, unsigned int /*target*/, unsigned int /*texture*/)
+{
+	return true;
+}
+
+static int failures = 0;
+
+static void fail(const std::string &what)
+{
+	failures++;
+	std::cerr << "FAIL: " << what << std::endl;
+}
+
+static bool key_less(const render_item &a, const render_item &b)
+{
+	return a.key < b.key;
+}
+
+/* Sort 'keys', queued in order, both ways and compare the orders. */
+static void check_sort(const std::vector<unsigned long long> &keys, const std::string &name)
+{
+	std::vector<render_item> items(keys.size());
+	for(size_t i = 0; i < keys.size(); ++i){
+		items[i].key = keys[i];
+		items[i].index = i;
+	}
+	std::vector<render_item> expected = items;
+	std::stable_sort(expected.begin(), expected.end(), key_less);
+	sort_render_queue(items);
+
+	for(size_t i = 0; i < items.size(); ++i)
+		if(items[i].key != expected[i].key || items[i].index != expected[i].index){
+			fail(name + " of " + std::to_string(keys.size()) + " keys differs at " +
+					std::to_string(i));
+			return;
+		}
+}
+
+static void test_sort()
+{
+	std::mt19937_64 rng(1);
+	// Counts from none to several frames of draws, around the powers of two,
+	// in an order which also shrinks the scratch buffer.
+	static const size_t counts[] = { 0, 1, 2, 3, 4, 7, 8, 15, 16, 17, 31, 32, 33, 63, 64,
+		65, 100, 255, 256, 257, 1000, 4096, 20000, 5, 300 };
+	for(size_t c = 0; c < sizeof(counts)/sizeof(counts[0]); ++c){
+		const size_t count = counts[c];
+		std::vector<unsigned long long> keys(count);
+
+		// A few distinct keys, so most are duplicates.
+		unsigned long long pool[5];
+		for(int i = 0; i < 5; ++i)
+			pool[i] = rng();
+		for(size_t i = 0; i < count; ++i)
+			keys[i] = pool[rng() % 5];
+		check_sort(keys, "duplicates of 5 random keys");
+
+		// Keys which differ in the lowest or the highest byte only, so the
+		// other passes are skipped.
+		for(int byte = 0; byte < 8; byte += 7){
+			for(size_t i = 0; i < count; ++i)
+				keys[i] = (0x0123456789abcdefULL & ~(0xffULL << 8*byte)) |
+					(rng() % 4) << 8*byte;
+			check_sort(keys, "keys differing in byte " + std::to_string(byte));
+		}
+
+		// Keys of make_render_key over a few programs, meshes and textures.
+		for(size_t i = 0; i < count; ++i)
+			keys[i] = make_render_key(rng() % 8 == 0? PASS_BLENDED: PASS_OPAQUE, rng() % 2,
+					rng() % 3, rng() % 9, rng() % 5, (rng() % 1000)/1000.0f);
+		check_sort(keys, "render keys");
+
+		for(size_t i = 0; i < count; ++i)
+			keys[i] = rng();
+		check_sort(keys, "random keys");
+
+		keys.assign(count, 42);
+		check_sort(keys, "equal keys");
+	}
+}
+
+static void test_keys()
+{
+	// Every field outranks the ones after it.
+	if(make_render_key(PASS_OPAQUE, 1, 0, 0, 0, 1.0f) <= make_render_key(PASS_OPAQUE, 0, 9, 9, 9, 0.0f))
+		fail("the program does not outrank the mesh, texture, level and depth");
+	if(make_render_key(PASS_OPAQUE, 0, 1, 0, 0, 1.0f) <= make_render_key(PASS_OPAQUE, 0, 0, 9, 9, 0.0f))
+		fail("the mesh does not outrank the texture, level and depth");
+	if(make_render_key(PASS_BLENDED, 0, 0, 0, 0, 0.0f) <= make_render_key(PASS_OPAQUE, 9, 9, 9, 9, 1.0f))
+		fail("the blended pass is not last");
+
+	// Near first, except in the blended pass.
+	if(make_render_key(PASS_OPAQUE, 0, 0, 0, 0, 0.25f) >= make_render_key(PASS_OPAQUE, 0, 0, 0, 0, 0.5f))
+		fail("opaque draws are not front to back");
+	if(make_render_key(PASS_BLENDED, 0, 0, 0, 0, 0.25f) <= make_render_key(PASS_BLENDED, 0, 0, 0, 0, 0.5f))
+		fail("blended draws are not back to front");
+	if(make_render_key(PASS_OPAQUE, 0, 0, 0, 0, -1.0f) != make_render_key(PASS_OPAQUE, 0, 0, 0, 0, 0.0f) ||
+			make_render_key(PASS_OPAQUE, 0, 0, 0, 0, 2.0f) != make_render_key(PASS_OPAQUE, 0, 0, 0, 0, 1.0f))
+		fail("the depth is not clamped");
+}
+
+int main()
+{
+	test_sort();
+	test_keys();
+
+	if(failures){
+		std::cerr << failures << " failures" << std::endl;
+		return 1;
+	}
+	std::cout << "render_queue_test: all passed" << std::endl;
+	return 0;
+}
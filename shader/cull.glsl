@@ -0,0 +1,128 @@
+#version 430
+// Frustum culling and level of detail of every object, writing the draw
+// commands of glMultiDrawElementsIndirect. See indirect_draw.h.
+layout(local_size_x = 64) in;
+
+// The block of vs.glsl, only the camera is used.
+layout(std140) uniform Frame {
+	mat4 vp;
+	vec4 sunPosition;
+	vec4 sunLightColor;
+	vec4 planetAmbient;
+	vec4 planetDiffuse;
+};
+
+// instance_data in main.cpp, the per-instance attributes of vs.glsl.
+struct Instance {
+	mat4 model;
+	vec4 planetEmission;
+	vec3 positionOffset;
+	float rotateDeg;
+	vec3 positionScale;
+	int textureLayer;
+};
+layout(std430, binding = 0) readonly buffer Instances {
+	Instance instances[];
+};
+
+// indirect_object in indirect_draw.h, in the order of the instances.
+struct Object {
+	uint mesh;
+	uint group;
+	uint object;
+};
+layout(std430, binding = 1) readonly buffer Objects {
+	Object objects[];
+};
+
+// The tables of merge_meshes().
+struct Mesh {
+	vec4 boundingSphere;
+	uint firstLod;
+	uint numLods;
+	int baseVertex;
+	uint padding;
+};
+layout(std430, binding = 2) readonly buffer Meshes {
+	Mesh meshes[];
+};
+struct Lod {
+	uint numIndices;
+	uint firstIndex;
+	float error;
+	uint padding;
+};
+layout(std430, binding = 3) readonly buffer Lods {
+	Lod lods[];
+};
+
+// The first command of every group.
+layout(std430, binding = 4) readonly buffer Groups {
+	uint groupFirst[];
+};
+
+// DrawElementsIndirectCommand
+struct Command {
+	uint count;
+	uint instanceCount;
+	uint firstIndex;
+	int baseVertex;
+	uint baseInstance;
+};
+layout(std430, binding = 5) writeonly buffer Commands {
+	Command commands[];
+};
+layout(std430, binding = 6) buffer DrawCounts {
+	uint drawCounts[];	// The commands written in every group
+};
+layout(std430, binding = 7) buffer ObjectLods {
+	uint objectLods[];	// The level of detail of the last frame
+};
+
+uniform int numObjects;
+uniform vec3 cameraEye;
+uniform float pixelScale;	// Pixels per unit of radius / distance
+uniform float pixelError;
+uniform float hysteresis;
+
+void main()
+{
+	uint i = gl_GlobalInvocationID.x;
+	if (i >= uint(numObjects))
+		return;
+	Object object = objects[i];
+	Mesh mesh = meshes[object.mesh];
+	mat4 model = instances[i].model;
+
+	// The bounding sphere in world space.
+	vec3 center = (model * vec4(mesh.boundingSphere.xyz, 1.0f)).xyz;
+	float scale = max(length(model[0].xyz), max(length(model[1].xyz), length(model[2].xyz)));
+	float radius = mesh.boundingSphere.w * scale;
+
+	// The planes of the frustum are sums of the rows of vp.
+	mat4 rows = transpose(vp);
+	vec4 planes[6] = vec4[6](rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1],
+			rows[3] - rows[1], rows[3] + rows[2], rows[3] - rows[2]);
+	for (int p = 0; p < 6; ++p)
+		if (dot(planes[p].xyz, center) + planes[p].w < -radius * length(planes[p].xyz))
+			return;
+
+	// The same choice as select_lod() in main.cpp.
+	int last = int(mesh.numLods) - 1;
+	int lod = 0;
+	float distance = length(center - cameraEye);
+	if (distance > radius) {
+		float radiusPx = radius / distance * pixelScale;
+		lod = min(int(objectLods[object.object]), last);
+		while (lod > 0 && lods[mesh.firstLod + lod].error * radiusPx > pixelError * (1.0f + hysteresis))
+			--lod;
+		while (lod < last &&
+				lods[mesh.firstLod + lod + 1].error * radiusPx < pixelError * (1.0f - hysteresis))
+			++lod;
+	}
+	objectLods[object.object] = uint(lod);
+
+	Lod range = lods[mesh.firstLod + lod];
+	uint slot = groupFirst[object.group] + atomicAdd(drawCounts[object.group], 1u);
+	commands[slot] = Command(range.numIndices, 1u, range.firstIndex, mesh.baseVertex, i);
+}
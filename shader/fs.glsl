@@ -7,15 +7,24 @@ layout(location=0) out vec4 color;
 in vec2 fTexcoord;
 in vec4 worldPosition;
 in vec4 worldNormal;
+flat in vec4 fEmission;
+flat in int fTextureLayer;
 
+// With TEXTURE_ARRAY defined all planets share one array texture, a layer each.
+#ifdef TEXTURE_ARRAY
+uniform sampler2DArray uSampler;
+#else
 uniform sampler2D uSampler;
+#endif
 
-// Matiral and Light color
-uniform vec4 sunPosition;	// Where is the SUN?
-uniform vec4 sunLightColor;	// What is the color of the sunlight?
-uniform vec4 planetAmbient;
-uniform vec4 planetDiffuse;
-uniform vec4 planetEmission;
+// Matiral and Light color, the block of vs.glsl
+layout(std140) uniform Frame {
+	mat4 vp;
+	vec4 sunPosition;	// Where is the SUN?
+	vec4 sunLightColor;	// What is the color of the sunlight?
+	vec4 planetAmbient;
+	vec4 planetDiffuse;
+};
 
 void main()
 {
@@ -26,5 +35,10 @@ void main()
 	// which means the mesh is away from the light, no need to do the diffuse reflection.
 	vec4 diffuse = max(dot(meshNormal, shootToTheLight), 0) * sunLightColor * planetDiffuse;
 
-	color = (planetEmission + diffuse + planetAmbient) * texture(uSampler,fTexcoord);
+#ifdef TEXTURE_ARRAY
+	vec4 texel = texture(uSampler, vec3(fTexcoord, fTextureLayer));
+#else
+	vec4 texel = texture(uSampler, fTexcoord);
+#endif
+	color = (fEmission + diffuse + planetAmbient) * texel;
 }
@@ -3,26 +3,46 @@ layout(location=0) in vec3 position;
 layout(location=1) in vec2 texcoord;
 layout(location=2) in vec3 normal;
 
-uniform mat4 model;	// Model matrix
-uniform mat4 vp;	// View Projection matrix
-uniform float rotateDeg;
+// The same for all objects in a frame, frame_block in main.cpp.
+layout(std140) uniform Frame {
+	mat4 vp;	// View Projection matrix
+	vec4 sunPosition;	// Where is the SUN?
+	vec4 sunLightColor;	// What is the color of the sunlight?
+	vec4 planetAmbient;
+	vec4 planetDiffuse;
+};
+
+// One per object, instance_data in main.cpp.
+layout(location=3) in mat4 model;	// Model matrix, locations 3 to 6
+layout(location=7) in vec4 planetEmission;
+// Compact vertices store positions normalized within the bounding box.
+layout(location=8) in vec3 positionOffset;
+layout(location=9) in vec3 positionScale;
+layout(location=10) in float rotateDeg;
+layout(location=11) in int textureLayer;
 
 // 'out' means vertex shader output for fragment shader
 // fNormal will be interpolated before passing to fragment shader
 out vec2 fTexcoord;
 out vec4 worldPosition;
 out vec4 worldNormal;
+flat out vec4 fEmission;
+flat out int fTextureLayer;
 
 void main()
 {
+	fEmission = planetEmission;
+	fTextureLayer = textureLayer;
+
 	// Circular shift the texcoord
 	float new_x = texcoord.x - rotateDeg / 360.0f;
 	// No need to normalize the texcoord within [0,1] !?
 	fTexcoord = vec2(new_x, texcoord.y);
 
-	worldPosition = model * vec4(position, 1.0f);
+	vec3 objectPosition = positionOffset + positionScale * position;
+	worldPosition = model * vec4(objectPosition, 1.0f);
 	worldNormal = model * vec4(normal, 0.0f);
 	
 	// Transfrom current vertex to clip-space position.
-	gl_Position = vp * model * vec4(position, 1.0);
+	gl_Position = vp * worldPosition;
 }
@@ -0,0 +1,226 @@
+#include "shader_uniforms.h"
+
+#include <GL/glew.h>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <glm/gtc/type_ptr.hpp>
+#include "gl_extensions.h"
+#include "gl_state.h"
+
+// Write uniforms with glProgramUniform* where the context has it. Build with
+// -DPROGRAM_UNIFORM_DSA=0 to always bind the program and use glUniform*.
+#ifndef PROGRAM_UNIFORM_DSA
+#define PROGRAM_UNIFORM_DSA 1
+#endif
+
+struct uniform_info {
+	GLenum type;
+	GLint size;	// Elements of an array, 1 otherwise
+	GLint location;
+};
+
+typedef std::map<std::string, uniform_info> uniform_table;
+
+static std::map<unsigned int, uniform_table> programs;
+static uniform_counters counters;
+
+/* Whether the setters use glProgramUniform*, checked by reflect_program(). */
+static bool programUniforms = false;
+
+void reflect_program(unsigned int program)
+{
+	programUniforms = PROGRAM_UNIFORM_DSA &&
+		(has_version(4, 1) || has_extension("GL_ARB_separate_shader_objects"));
+
+	uniform_table &table = programs[program];
+	table.clear();
+	GLint count = 0, maxLength = 0;
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+	std::vector<char> name(maxLength + 1);
+	for(GLint i = 0; i < count; ++i){
+		GLsizei length = 0;
+		uniform_info info;
+		glGetActiveUniform(program, i, name.size(), &length, &info.size, &info.type, name.data());
+		// The members of uniform blocks have no location.
+		info.location = glGetUniformLocation(program, name.data());
+		if(info.location == -1)
+			continue;
+		// Arrays are reported as "name[0]".
+		std::string key(name.data(), length);
+		if(key.size() > 3 && key.compare(key.size() - 3, 3, "[0]") == 0)
+			key.erase(key.size() - 3);
+		table[key] = info;
+	}
+}
+
+void forget_program(unsigned int program)
+{
+	programs.erase(program);
+}
+
+static GLenum uniform_type(const float *){ return GL_FLOAT; }
+static GLenum uniform_type(const int *){ return GL_INT; }
+static GLenum uniform_type(const glm::vec3 *){ return GL_FLOAT_VEC3; }
+static GLenum uniform_type(const glm::vec4 *){ return GL_FLOAT_VEC4; }
+static GLenum uniform_type(const glm::mat4 *){ return GL_FLOAT_MAT4; }
+
+/* Samplers are set as ints, like with glUniform1i. */
+static bool compatible_types(GLenum wanted, GLenum actual)
+{
+	if(wanted == actual)
+		return true;
+	if(wanted != GL_INT)
+		return false;
+	switch(actual){
+	case GL_SAMPLER_2D:
+	case GL_SAMPLER_2D_ARRAY:
+	case GL_SAMPLER_3D:
+	case GL_SAMPLER_CUBE:
+	case GL_BOOL:
+		return true;
+	}
+	return false;
+}
+
+template<typename T> uniform<T> find_uniform(unsigned int program, const char *name)
+{
+	uniform<T> u;
+	u.program = program;
+	std::map<unsigned int, uniform_table>::const_iterator table = programs.find(program);
+	if(table == programs.end()){
+		std::cerr<<"Uniform "<<name<<" of a program which is not reflected"<<std::endl;
+		return u;
+	}
+	uniform_table::const_iterator it = table->second.find(name);
+	if(it == table->second.end())
+		return u;
+	if(!compatible_types(uniform_type((const T *)nullptr), it->second.type)){
+		std::cerr<<"Uniform "<<name<<" has type 0x"<<std::hex<<it->second.type<<std::dec
+			<<" in the shaders"<<std::endl;
+		return u;
+	}
+	u.location = it->second.location;
+	return u;
+}
+
+template uniform<float> find_uniform<float>(unsigned int, const char *);
+template uniform<int> find_uniform<int>(unsigned int, const char *);
+template uniform<glm::vec3> find_uniform<glm::vec3>(unsigned int, const char *);
+template uniform<glm::vec4> find_uniform<glm::vec4>(unsigned int, const char *);
+template uniform<glm::mat4> find_uniform<glm::mat4>(unsigned int, const char *);
+
+bool bind_uniform_block(unsigned int program, const char *name, unsigned int binding,
+		size_t size)
+{
+	GLuint index = glGetUniformBlockIndex(program, name);
+	if(index == GL_INVALID_INDEX){
+		std::cerr<<"Uniform block "<<name<<" is not active"<<std::endl;
+		return false;
+	}
+	GLint dataSize = 0;
+	glGetActiveUniformBlockiv(program, index, GL_UNIFORM_BLOCK_DATA_SIZE, &dataSize);
+	if(size_t(dataSize) != size){
+		std::cerr<<"Uniform block "<<name<<" has "<<dataSize<<" bytes in the shaders, not "
+			<<size<<std::endl;
+		return false;
+	}
+	glUniformBlockBinding(program, index, binding);
+	return true;
+}
+
+/* Return false if 'program' is already current. */
+static bool bind_program(unsigned int program)
+{
+	if(!state_use_program(program))
+		return false;
+	++counters.programBinds;
+	return true;
+}
+
+bool use_program(unsigned int program)
+{
+	if(bind_program(program))
+		return true;
+	++counters.callsSaved;
+	return false;
+}
+
+/* Count a setter and bind the program of 'u' unless glProgramUniform* is used.
+ * Return:
+ * - false if the handle sets nothing.
+ */
+template<typename T> static bool begin_set(const uniform<T> &u)
+{
+	if(u.location == -1)
+		return false;
+	// Setting by name made a glUseProgram and a glGetUniformLocation per uniform.
+	++counters.uniformCalls;
+	counters.callsSaved += 2;
+	if(!programUniforms && bind_program(u.program))
+		--counters.callsSaved;
+	return true;
+}
+
+void set_uniform(const uniform<float> &u, float value)
+{
+	if(!begin_set(u))
+		return;
+	if(programUniforms)
+		glProgramUniform1f(u.program, u.location, value);
+	else
+		glUniform1f(u.location, value);
+}
+
+void set_uniform(const uniform<int> &u, int value)
+{
+	if(!begin_set(u))
+		return;
+	if(programUniforms)
+		glProgramUniform1i(u.program, u.location, value);
+	else
+		glUniform1i(u.location, value);
+}
+
+void set_uniform(const uniform<glm::vec3> &u, const glm::vec3 &value)
+{
+	if(!begin_set(u))
+		return;
+	if(programUniforms)
+		glProgramUniform3fv(u.program, u.location, 1, glm::value_ptr(value));
+	else
+		glUniform3fv(u.location, 1, glm::value_ptr(value));
+}
+
+void set_uniform(const uniform<glm::vec4> &u, const glm::vec4 &value)
+{
+	if(!begin_set(u))
+		return;
+	if(programUniforms)
+		glProgramUniform4fv(u.program, u.location, 1, glm::value_ptr(value));
+	else
+		glUniform4fv(u.location, 1, glm::value_ptr(value));
+}
+
+void set_uniform(const uniform<glm::mat4> &u, const glm::mat4 &value)
+{
+	if(!begin_set(u))
+		return;
+	// mat4 of glm is column major, same as opengl, so no transpose.
+	if(programUniforms)
+		glProgramUniformMatrix4fv(u.program, u.location, 1, GL_FALSE, glm::value_ptr(value));
+	else
+		glUniformMatrix4fv(u.location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
+const uniform_counters &get_uniform_counters()
+{
+	return counters;
+}
+
+void reset_uniform_counters()
+{
+	counters = uniform_counters();
+}
@@ -0,0 +1,72 @@
+#ifndef _SHADER_UNIFORMS_H
+#define _SHADER_UNIFORMS_H
+
+#include <cstddef>
+#include <glm/glm.hpp>
+
+/* Uniforms of linked programs, read once with glGetActiveUniform.
+ *
+ * reflect_program() keeps a table of the active uniforms of a program: name,
+ * type and location. find_uniform() resolves a typed handle from that table
+ * without asking GL, and set_uniform() writes through the handle with
+ * glProgramUniform* when the context has it (GL 4.1 or
+ * GL_ARB_separate_shader_objects), so no program has to be bound. Otherwise
+ * it binds the program through use_program(), which skips the bind if the
+ * program is already current. Uniform blocks are checked against the structs
+ * which mirror them in bind_uniform_block().
+ */
+
+template<typename T> struct uniform {
+	unsigned int program;
+	int location;	// -1 if the program has no active uniform of that name and type
+	uniform(): program(0), location(-1){}
+};
+
+/* Build the table of a linked program. Call it again after relinking. */
+void reflect_program(unsigned int program);
+
+/* Drop the table of a program before deleting it. */
+void forget_program(unsigned int program);
+
+/* Resolve a uniform of a reflected program. The handle of a uniform which is
+ * not active, usually because the shaders do not use it, sets nothing. A
+ * uniform whose type in the shaders is not T also sets nothing and is
+ * reported. Arrays resolve to their first element.
+ * Defined for float, int, glm::vec3, glm::vec4 and glm::mat4.
+ */
+template<typename T> uniform<T> find_uniform(unsigned int program, const char *name);
+
+void set_uniform(const uniform<float> &u, float value);
+void set_uniform(const uniform<int> &u, int value);
+void set_uniform(const uniform<glm::vec3> &u, const glm::vec3 &value);
+void set_uniform(const uniform<glm::vec4> &u, const glm::vec4 &value);
+void set_uniform(const uniform<glm::mat4> &u, const glm::mat4 &value);
+
+/* Connect the uniform block 'name' of 'program' to a binding point of
+ * glBindBufferBase. 'size' is the size of the struct which mirrors the block.
+ * Return:
+ * - false, reported, if the program has no such active block or its std140
+ *   size in the shaders is not 'size'.
+ */
+bool bind_uniform_block(unsigned int program, const char *name, unsigned int binding,
+		size_t size);
+
+/* glUseProgram unless 'program' is already the current one.
+ * Return:
+ * - false if the program was already current.
+ */
+bool use_program(unsigned int program);
+
+/* GL calls of this module since the last reset_uniform_counters(). */
+struct uniform_counters {
+	unsigned long uniformCalls;	// glUniform* and glProgramUniform*
+	unsigned long programBinds;	// glUseProgram
+	// glUseProgram and glGetUniformLocation which setting by name, with a bind
+	// and a lookup per uniform, would have made on top of these.
+	unsigned long callsSaved;
+};
+
+const uniform_counters &get_uniform_counters();
+void reset_uniform_counters();
+
+#endif // _SHADER_UNIFORMS_H
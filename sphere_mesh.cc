@@ -0,0 +1,236 @@
+#include "sphere_mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <utility>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Floats per vertex, the same as tinyobj::INTERLEAVED_STRIDE.
+#define SPHERE_STRIDE 8
+
+/* Write one vertex of a sphere of 'radius' from its unit direction. */
+static inline void put_vertex(float *out, float radius, float x, float y, float z, float u, float v)
+{
+	out[0] = radius*x;
+	out[1] = radius*y;
+	out[2] = radius*z;
+	out[3] = u;
+	out[4] = v;
+	out[5] = x;
+	out[6] = y;
+	out[7] = z;
+}
+
+void generate_uv_sphere(float radius, unsigned int rings, unsigned int segments,
+		sphere_mesh &mesh)
+{
+	if(rings < 2)
+		rings = 2;
+	if(segments < 3)
+		segments = 3;
+
+	// Sines and cosines of every ring and segment, so the vertex loop is only
+	// multiplications and stores.
+	std::vector<float> sinLat(rings + 1), cosLat(rings + 1), sinLon(segments + 1), cosLon(segments + 1);
+	for(unsigned int i = 0; i <= rings; ++i){
+		double lat = M_PI*(0.5 - double(i)/rings);
+		sinLat[i] = std::sin(lat);
+		cosLat[i] = i == 0 || i == rings? 0.0f: std::cos(lat);
+	}
+	for(unsigned int j = 0; j <= segments; ++j){
+		double lon = 2.0*M_PI*double(j)/segments;
+		sinLon[j] = std::sin(lon);
+		cosLon[j] = std::cos(lon);
+	}
+
+	// (rings + 1) x (segments + 1) vertices, the last column is the seam and
+	// the first and last rows are the poles with one vertex per segment.
+	const unsigned int base = mesh.vertices.size()/SPHERE_STRIDE;
+	const unsigned int columns = segments + 1;
+	size_t first = mesh.vertices.size();
+	mesh.vertices.resize(first + size_t(rings + 1)*columns*SPHERE_STRIDE);
+	float *out = &mesh.vertices[first];
+	for(unsigned int i = 0; i <= rings; ++i){
+		float v = 1.0f - float(i)/rings;
+		for(unsigned int j = 0; j <= segments; ++j, out += SPHERE_STRIDE){
+			// The pole vertices sit between the vertices of the next ring.
+			float u = (j + (i == 0 || i == rings? 0.5f: 0.0f))/segments;
+			put_vertex(out, radius, -sinLon[j]*cosLat[i], sinLat[i], -cosLon[j]*cosLat[i], u, v);
+		}
+	}
+
+	// One triangle per segment at the poles, two in between.
+	mesh.indices.reserve(mesh.indices.size() + size_t(rings - 1)*segments*6);
+	for(unsigned int i = 0; i < rings; ++i){
+		for(unsigned int j = 0; j < segments; ++j){
+			unsigned int a = base + i*columns + j, b = a + 1;
+			unsigned int c = a + columns, d = c + 1;
+			if(i != 0){
+				mesh.indices.push_back(a);
+				mesh.indices.push_back(c);
+				mesh.indices.push_back(b);
+			}
+			if(i != rings - 1){
+				// At the north pole 'a' is the pole vertex of this segment.
+				mesh.indices.push_back(i == 0? a: b);
+				mesh.indices.push_back(c);
+				mesh.indices.push_back(d);
+			}
+		}
+	}
+}
+
+/* Append a copy of vertex 'v' and return its index. */
+static unsigned int copy_vertex(std::vector<float> &vertices, unsigned int v)
+{
+	float copy[SPHERE_STRIDE];
+	std::copy(&vertices[v*SPHERE_STRIDE], &vertices[v*SPHERE_STRIDE] + SPHERE_STRIDE, copy);
+	vertices.insert(vertices.end(), copy, copy + SPHERE_STRIDE);
+	return vertices.size()/SPHERE_STRIDE - 1;
+}
+
+/* Texcoords of a unit direction, the inverse of the mapping of generate_uv_sphere. */
+static void sphere_texcoord(const float *p, float &u, float &v)
+{
+	u = float(std::atan2(-p[0], -p[2])/(2.0*M_PI));
+	if(u < 0.0f)
+		u += 1.0f;
+	v = float(0.5 + std::asin(std::max(-1.0f, std::min(1.0f, p[1])))/M_PI);
+}
+
+void generate_icosphere(float radius, unsigned int subdivisions, sphere_mesh &mesh)
+{
+	// The icosahedron.
+	const float t = float((1.0 + std::sqrt(5.0))/2.0);
+	const float corners[12][3] = {
+		{ -1, t, 0 }, { 1, t, 0 }, { -1, -t, 0 }, { 1, -t, 0 },
+		{ 0, -1, t }, { 0, 1, t }, { 0, -1, -t }, { 0, 1, -t },
+		{ t, 0, -1 }, { t, 0, 1 }, { -t, 0, -1 }, { -t, 0, 1 },
+	};
+	const unsigned int faces[20][3] = {
+		{ 0, 11, 5 }, { 0, 5, 1 }, { 0, 1, 7 }, { 0, 7, 10 }, { 0, 10, 11 },
+		{ 1, 5, 9 }, { 5, 11, 4 }, { 11, 10, 2 }, { 10, 7, 6 }, { 7, 1, 8 },
+		{ 3, 9, 4 }, { 3, 4, 2 }, { 3, 2, 6 }, { 3, 6, 8 }, { 3, 8, 9 },
+		{ 4, 9, 5 }, { 2, 4, 11 }, { 6, 2, 10 }, { 8, 6, 7 }, { 9, 8, 1 },
+	};
+	std::vector<float> positions;
+	for(int i = 0; i < 12; ++i){
+		float length = std::sqrt(corners[i][0]*corners[i][0] + corners[i][1]*corners[i][1] +
+				corners[i][2]*corners[i][2]);
+		for(int k = 0; k < 3; ++k)
+			positions.push_back(corners[i][k]/length);
+	}
+	std::vector<unsigned int> triangles(&faces[0][0], &faces[0][0] + 60);
+
+	// Split every triangle into four, the new vertices are pushed out to the
+	// sphere. Edges shared by two triangles get one midpoint.
+	for(unsigned int level = 0; level < subdivisions; ++level){
+		std::map<std::pair<unsigned int, unsigned int>, unsigned int> midpoints;
+		std::vector<unsigned int> next;
+		next.reserve(triangles.size()*4);
+		for(size_t i = 0; i < triangles.size(); i += 3){
+			unsigned int m[3];
+			for(int k = 0; k < 3; ++k){
+				unsigned int a = triangles[i + k], b = triangles[i + (k + 1)%3];
+				std::pair<unsigned int, unsigned int> edge(std::min(a, b), std::max(a, b));
+				std::map<std::pair<unsigned int, unsigned int>, unsigned int>::iterator it =
+					midpoints.find(edge);
+				if(it != midpoints.end()){
+					m[k] = it->second;
+					continue;
+				}
+				float p[3];
+				for(int c = 0; c < 3; ++c)
+					p[c] = positions[a*3 + c] + positions[b*3 + c];
+				float length = std::sqrt(p[0]*p[0] + p[1]*p[1] + p[2]*p[2]);
+				m[k] = positions.size()/3;
+				for(int c = 0; c < 3; ++c)
+					positions.push_back(p[c]/length);
+				midpoints[edge] = m[k];
+			}
+			const unsigned int split[12] = {
+				triangles[i], m[0], m[2], triangles[i + 1], m[1], m[0],
+				triangles[i + 2], m[2], m[1], m[0], m[1], m[2],
+			};
+			next.insert(next.end(), split, split + 12);
+		}
+		triangles.swap(next);
+	}
+
+	// Texcoords. A triangle across the seam gets copies of its vertices with
+	// u + 1 on the u < 0.5 side, and a pole gets a copy per triangle with the
+	// u of the triangle, like the poles of generate_uv_sphere.
+	const unsigned int base = mesh.vertices.size()/SPHERE_STRIDE;
+	const size_t numPositions = positions.size()/3;
+	std::vector<float> &vertices = mesh.vertices;
+	vertices.resize(vertices.size() + numPositions*SPHERE_STRIDE);
+	for(size_t i = 0; i < numPositions; ++i){
+		const float *p = &positions[i*3];
+		float u, v;
+		sphere_texcoord(p, u, v);
+		put_vertex(&vertices[(base + i)*SPHERE_STRIDE], radius, p[0], p[1], p[2], u, v);
+	}
+	std::vector<unsigned int> seamCopy(numPositions, ~0u);
+	mesh.indices.reserve(mesh.indices.size() + triangles.size());
+	for(size_t i = 0; i < triangles.size(); i += 3){
+		unsigned int tri[3];
+		float u[3];
+		bool pole[3];
+		for(int k = 0; k < 3; ++k){
+			tri[k] = base + triangles[i + k];
+			u[k] = vertices[tri[k]*SPHERE_STRIDE + 3];
+			const float *p = &positions[triangles[i + k]*3];
+			pole[k] = std::fabs(p[0]) < 1e-6f && std::fabs(p[2]) < 1e-6f;
+		}
+
+		float lower = 1.0f, upper = 0.0f;
+		for(int k = 0; k < 3; ++k){
+			if(!pole[k]){
+				lower = std::min(lower, u[k]);
+				upper = std::max(upper, u[k]);
+			}
+		}
+		if(upper - lower > 0.5f){
+			for(int k = 0; k < 3; ++k){
+				if(pole[k] || u[k] >= 0.5f)
+					continue;
+				unsigned int &copy = seamCopy[triangles[i + k]];
+				if(copy == ~0u){
+					copy = copy_vertex(vertices, tri[k]);
+					vertices[copy*SPHERE_STRIDE + 3] += 1.0f;
+				}
+				tri[k] = copy;
+				u[k] += 1.0f;
+			}
+		}
+
+		for(int k = 0; k < 3; ++k){
+			if(!pole[k])
+				continue;
+			float sum = 0.0f;
+			for(int o = 0; o < 3; ++o)
+				sum += o == k? 0.0f: u[o];
+			unsigned int copy = copy_vertex(vertices, tri[k]);
+			vertices[copy*SPHERE_STRIDE + 3] = sum*0.5f;
+			tri[k] = copy;
+		}
+		mesh.indices.insert(mesh.indices.end(), tri, tri + 3);
+	}
+}
+
+float uv_sphere_error(unsigned int rings, unsigned int segments)
+{
+	// The center of the largest quad, at the equator.
+	return float(1.0 - std::cos(M_PI/segments)*std::cos(M_PI/(2.0*rings)));
+}
+
+float icosphere_error(unsigned int subdivisions)
+{
+	// The center of a face, 37.38 degrees from its corners on the icosahedron.
+	// Every subdivision halves that angle.
+	return float(1.0 - std::cos(0.6524/(1 << subdivisions)));
+}
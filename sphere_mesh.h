@@ -0,0 +1,40 @@
+#ifndef _SPHERE_MESH_H
+#define _SPHERE_MESH_H
+
+#include <vector>
+
+/* Procedural spheres in the interleaved vertex layout of
+ * tinyobj::LOAD_INTERLEAVED: position(3), texcoord(2), normal(3).
+ *
+ * The texture mapping matches earth.obj: v = 1 at the north pole (+y) and
+ * u = 0 faces -z, going around through -x. The seam and the poles get their
+ * own vertices, so every triangle has continuous texcoords. Triangles are
+ * counter-clockwise seen from outside.
+ */
+
+struct sphere_mesh {
+	std::vector<float> vertices;
+	std::vector<unsigned int> indices;
+};
+
+/* Append a latitude-longitude sphere to 'mesh'.
+ * Parameter:
+ * - rings: Number of latitude bands, at least 2.
+ * - segments: Number of longitude bands, at least 3.
+ */
+void generate_uv_sphere(float radius, unsigned int rings, unsigned int segments,
+		sphere_mesh &mesh);
+
+/* Append an icosahedron subdivided 'subdivisions' times to 'mesh'. Every
+ * subdivision splits each triangle into four, so it has 20*4^subdivisions
+ * triangles of nearly the same size.
+ */
+void generate_icosphere(float radius, unsigned int subdivisions, sphere_mesh &mesh);
+
+/* Largest distance between the sphere and the triangles of a tessellation,
+ * relative to the radius.
+ */
+float uv_sphere_error(unsigned int rings, unsigned int segments);
+float icosphere_error(unsigned int subdivisions);
+
+#endif // _SPHERE_MESH_H
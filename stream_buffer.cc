@@ -0,0 +1,197 @@
+#include "stream_buffer.h"
+
+#include <GL/glew.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "gl_extensions.h"
+#include "gl_state.h"
+#include "timer.h"
+
+// Map the ring persistently where glBufferStorage exists. Build with
+// -DPERSISTENT_STREAMING=0 to always upload it with glBufferSubData.
+#ifndef PERSISTENT_STREAMING
+#define PERSISTENT_STREAMING 1
+#endif
+
+/* A buffer replaced by a larger one, deleted once its fence is signaled. */
+struct retired_buffer {
+	GLuint buffer;
+	GLsync fence;	// 0 until the end of the frame which replaced it
+};
+
+static GLuint ringBuffer = 0;
+static bool persistent = false;
+static unsigned char *mapped = nullptr;	// The whole ring, the mapping or 'shadow'
+static std::vector<unsigned char> shadow;	// Without a persistent mapping
+static size_t regionSize = 0;
+static size_t alignment = 16;
+static GLsync fences[STREAM_REGIONS];
+static std::vector<retired_buffer> retired;
+
+static int region = 0;	// Of this frame
+static size_t head = 0;	// The next free byte in the region
+static size_t flushed = 0;	// The bytes of the region uploaded, without a persistent mapping
+static stream_counters counters;
+
+/* Wait until the GPU has passed 'fence' and delete it.
+ * Return:
+ * - false if it had passed already.
+ */
+static bool wait_fence(GLsync fence)
+{
+	bool waited = false;
+	GLenum status = glClientWaitSync(fence, 0, 0);
+	if(status == GL_TIMEOUT_EXPIRED){
+		waited = true;
+		while(status == GL_TIMEOUT_EXPIRED)
+			status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+	}
+	glDeleteSync(fence);
+	return waited;
+}
+
+/* A new ring of STREAM_REGIONS regions of 'size' bytes. */
+static void create_ring(size_t size)
+{
+	regionSize = size;
+	const size_t ringSize = regionSize*STREAM_REGIONS;
+	glGenBuffers(1, &ringBuffer);
+	state_bind_buffer(GL_COPY_WRITE_BUFFER, ringBuffer);
+	if(persistent){
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_WRITE_BUFFER, ringSize, nullptr, flags);
+		mapped = static_cast<unsigned char *>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, ringSize,
+				flags));
+	}else{
+		glBufferData(GL_COPY_WRITE_BUFFER, ringSize, nullptr, GL_STREAM_DRAW);
+		shadow.resize(ringSize);
+		mapped = shadow.data();
+	}
+}
+
+void start_stream_buffer(size_t size)
+{
+	persistent = PERSISTENT_STREAMING &&
+		(has_version(4, 4) || has_extension("GL_ARB_buffer_storage"));
+	// Every allocation can be bound as a uniform or shader storage range.
+	GLint uniformAlignment = 0, storageAlignment = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+	if(has_version(4, 3) || has_extension("GL_ARB_shader_storage_buffer_object"))
+		glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageAlignment);
+	alignment = std::max<size_t>(16, std::max(uniformAlignment, storageAlignment));
+
+	create_ring((size + alignment - 1)/alignment*alignment);
+	std::fill(fences, fences + STREAM_REGIONS, GLsync(0));
+	region = 0;
+	head = flushed = 0;
+}
+
+/* Delete the retired buffers the GPU is done with, all of them if 'wait'. */
+static void delete_retired(bool wait)
+{
+	for(size_t i = 0; i < retired.size();){
+		retired_buffer &old = retired[i];
+		if(old.fence && (wait || glClientWaitSync(old.fence, 0, 0) != GL_TIMEOUT_EXPIRED)){
+			wait_fence(old.fence);
+			state_delete_buffers(1, &old.buffer);
+			retired.erase(retired.begin() + i);
+		}else
+			++i;
+	}
+}
+
+void stop_stream_buffer()
+{
+	for(int i = 0; i < STREAM_REGIONS; ++i)
+		if(fences[i]){
+			wait_fence(fences[i]);
+			fences[i] = 0;
+		}
+	delete_retired(true);
+	// Deleting the buffer unmaps it.
+	state_delete_buffers(1, &ringBuffer);
+	ringBuffer = 0;
+	mapped = nullptr;
+	shadow.clear();
+}
+
+void begin_stream_frame()
+{
+	region = (region + 1) % STREAM_REGIONS;
+	head = flushed = 0;
+	++counters.frames;
+	if(fences[region]){
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		if(wait_fence(fences[region])){
+			++counters.waits;
+			counters.waitTime += elapsed_ms(start);
+		}
+		fences[region] = 0;
+	}
+	delete_retired(false);
+}
+
+/* Move this frame to a new ring whose regions hold 'size' more bytes. */
+static void grow_ring(size_t size)
+{
+	flush_stream_buffer();
+	// The fence of this frame covers the older frames of the old ring.
+	retired_buffer old = {ringBuffer, 0};
+	retired.push_back(old);
+	for(int i = 0; i < STREAM_REGIONS; ++i)
+		if(fences[i]){
+			glDeleteSync(fences[i]);
+			fences[i] = 0;
+		}
+	create_ring(std::max(regionSize*2, (size + alignment - 1)/alignment*alignment));
+	head = flushed = 0;
+}
+
+stream_allocation stream_alloc(size_t size)
+{
+	size_t offset = (head + alignment - 1)/alignment*alignment;
+	if(offset + size > regionSize){
+		grow_ring(size);
+		offset = 0;
+	}
+	head = offset + size;
+	counters.bytes += size;
+
+	stream_allocation allocation;
+	allocation.buffer = ringBuffer;
+	allocation.offset = region*regionSize + offset;
+	allocation.size = size;
+	allocation.data = mapped + allocation.offset;
+	return allocation;
+}
+
+void flush_stream_buffer()
+{
+	// Coherent mappings need no flush.
+	if(persistent || flushed == head)
+		return;
+	const size_t offset = region*regionSize + flushed;
+	state_bind_buffer(GL_COPY_WRITE_BUFFER, ringBuffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, offset, head - flushed, mapped + offset);
+	flushed = head;
+}
+
+void end_stream_frame()
+{
+	flush_stream_buffer();
+	fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	for(size_t i = 0; i < retired.size(); ++i)
+		if(!retired[i].fence)
+			retired[i].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+const stream_counters &get_stream_counters()
+{
+	return counters;
+}
+
+void reset_stream_counters()
+{
+	counters = stream_counters();
+}
@@ -0,0 +1,65 @@
+#ifndef _STREAM_BUFFER_H
+#define _STREAM_BUFFER_H
+
+#include <cstddef>
+
+/* A ring allocator for the data written every frame.
+ *
+ * One buffer holds STREAM_REGIONS regions, one per frame in flight. It is
+ * created with glBufferStorage and mapped persistently and coherently once,
+ * so an allocation is a pointer into the mapping: no map, unmap or
+ * glBufferData per frame. begin_stream_frame() waits on the fence which
+ * end_stream_frame() put after the last use of the region it reuses. With
+ * three regions the GPU is usually done with it, and the waits are counted
+ * as the time the CPU got ahead of the GPU.
+ *
+ * A frame which needs more than its region moves to a new buffer with larger
+ * regions. The old buffer stays alive until the GPU has read this frame.
+ * Without GL 4.4 or GL_ARB_buffer_storage the regions are written in CPU
+ * memory and uploaded with glBufferSubData in flush_stream_buffer().
+ *
+ * The buffer is shared by every target: bind it with state_bind_buffer_range()
+ * of gl_state.h or point vertex attributes at the offset.
+ */
+
+#define STREAM_REGIONS 3
+
+struct stream_allocation {
+	unsigned int buffer;
+	size_t offset;	// Aligned for uniform and shader storage buffer ranges
+	size_t size;
+	void *data;	// Write only, valid until the next stream_alloc()
+};
+
+/* Create the ring with 'regionSize' bytes per frame. Call it with a current
+ * GL context.
+ */
+void start_stream_buffer(size_t regionSize);
+
+/* Delete the ring once the GPU is done with it. */
+void stop_stream_buffer();
+
+/* Move to the next region, waiting until the GPU has read it. */
+void begin_stream_frame();
+
+/* 'size' bytes of the region of this frame. */
+stream_allocation stream_alloc(size_t size);
+
+/* Make the data written so far visible to the GL commands issued next. */
+void flush_stream_buffer();
+
+/* Fence the region after the last GL command which reads it. */
+void end_stream_frame();
+
+/* Since the last reset_stream_counters(). */
+struct stream_counters {
+	unsigned long frames;
+	unsigned long waits;	// Frames whose region was still in use by the GPU
+	double waitTime;	// Milliseconds spent in those waits
+	size_t bytes;	// Allocated
+};
+
+const stream_counters &get_stream_counters();
+void reset_stream_counters();
+
+#endif // _STREAM_BUFFER_H
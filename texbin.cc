@@ -0,0 +1,148 @@
+#include "texbin.h"
+
+#include <cstring>
+#include <sstream>
+#include <string>
+#include "mapped_file.h"
+#include "mipmap.h"
+#include "texture_compress.h"
+
+/* Point 'tex' at the levels of a whole cache file in memory, after checking
+ * that they lie inside it.
+ */
+static bool view_levels(const unsigned char *base, size_t size, texbin &tex)
+{
+	const texbin_header *header = reinterpret_cast<const texbin_header *>(base);
+	bool valid = size >= sizeof(texbin_header) &&
+		memcmp(header->magic, TEXBIN_MAGIC, sizeof(TEXBIN_MAGIC)) == 0 &&
+		header->version == TEXBIN_VERSION &&
+		header->sourceHash == tex.sourceHash &&
+		header->sourceSize == tex.sourceSize &&
+		(tex.width == 0 || (header->width == tex.width && header->height == tex.height)) &&
+		(header->format == TEXBIN_BC1 || header->format == TEXBIN_BC3) &&
+		header->numLevels == mip_levels(header->width, header->height) &&
+		header->numLevels <= (size - sizeof(texbin_header)) / sizeof(texbin_level);
+	tex.levels.clear();
+	tex.levelSizes.clear();
+	if(!valid)
+		return false;
+
+	const texbin_level *levels = reinterpret_cast<const texbin_level *>(header + 1);
+	const bool alpha = header->format == TEXBIN_BC3;
+	unsigned int width = header->width, height = header->height;
+	for(unsigned int i = 0; i < header->numLevels; ++i){
+		const texbin_level &level = levels[i];
+		if(level.size != bc_size(width, height, alpha) ||
+				level.offset % TEXBIN_ALIGNMENT != 0 || level.offset > size ||
+				level.size > size - level.offset){
+			tex.levels.clear();
+			tex.levelSizes.clear();
+			return false;
+		}
+		tex.levels.push_back(base + level.offset);
+		tex.levelSizes.push_back(level.size);
+		width = width > 1? width/2: 1;
+		height = height > 1? height/2: 1;
+	}
+	tex.format = header->format;
+	tex.width = header->width;
+	tex.height = header->height;
+	return true;
+}
+
+bool texbin_open(const char *bmpfile, unsigned int width, unsigned int height, texbin &tex)
+{
+	texbin_close(tex);
+	tex.cachefile = std::string(bmpfile) + ".texbin";
+	if(width != 0){
+		std::ostringstream name;
+		name<<bmpfile<<"."<<width<<"x"<<height<<".texbin";
+		tex.cachefile = name.str();
+	}
+	tex.width = width;
+	tex.height = height;
+
+	size_t bmpSize;
+	void *bmp = map_file(bmpfile, &bmpSize);
+	if(!bmp)
+		return false;
+	tex.sourceHash = hash_bytes(static_cast<const unsigned char *>(bmp), bmpSize);
+	tex.sourceSize = bmpSize;
+	unmap_file(bmp, bmpSize);
+
+	size_t size;
+	void *addr = map_file(tex.cachefile.c_str(), &size);
+	if(!addr)
+		return false;
+	if(!view_levels(static_cast<const unsigned char *>(addr), size, tex)){
+		unmap_file(addr, size);
+		return false;
+	}
+	tex.addr = addr;
+	tex.size = size;
+	return true;
+}
+
+bool texbin_cook(const unsigned char *chain, unsigned int width, unsigned int height,
+		texbin &tex)
+{
+	// Opaque images take BC1, half the size of BC3.
+	const size_t texels = size_t(width)*height;
+	bool alpha = false;
+	for(size_t i = 0; i < texels && !alpha; ++i)
+		alpha = chain[i*4 + 3] != 255;
+
+	texbin_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, TEXBIN_MAGIC, sizeof(TEXBIN_MAGIC));
+	header.version = TEXBIN_VERSION;
+	header.format = alpha? TEXBIN_BC3: TEXBIN_BC1;
+	header.width = width;
+	header.height = height;
+	header.numLevels = mip_levels(width, height);
+	header.sourceHash = tex.sourceHash;
+	header.sourceSize = tex.sourceSize;
+
+	std::vector<texbin_level> levels(header.numLevels);
+	unsigned long long end = sizeof(header) + sizeof(texbin_level)*levels.size();
+	unsigned int w = width, h = height;
+	for(unsigned int i = 0; i < header.numLevels; ++i){
+		end = (end + TEXBIN_ALIGNMENT - 1) / TEXBIN_ALIGNMENT * TEXBIN_ALIGNMENT;
+		levels[i].offset = end;
+		levels[i].size = bc_size(w, h, alpha);
+		end += levels[i].size;
+		w = w > 1? w/2: 1;
+		h = h > 1? h/2: 1;
+	}
+
+	texbin_close(tex);
+	tex.memory.assign(end, 0);
+	memcpy(&tex.memory[0], &header, sizeof(header));
+	memcpy(&tex.memory[sizeof(header)], levels.data(), sizeof(texbin_level)*levels.size());
+	w = width;
+	h = height;
+	for(unsigned int i = 0; i < header.numLevels; ++i){
+		const unsigned char *rgba = chain + mip_offset(width, height, i);
+		unsigned char *out = &tex.memory[levels[i].offset];
+		if(alpha)
+			compress_bc3(rgba, w, h, out);
+		else
+			compress_bc1(rgba, w, h, out);
+		w = w > 1? w/2: 1;
+		h = h > 1? h/2: 1;
+	}
+	view_levels(&tex.memory[0], tex.memory.size(), tex);
+
+	return replace_file(tex.cachefile.c_str(), &tex.memory[0], tex.memory.size());
+}
+
+void texbin_close(texbin &tex)
+{
+	if(tex.addr)
+		unmap_file(tex.addr, tex.size);
+	tex.addr = nullptr;
+	tex.size = 0;
+	std::vector<unsigned char>().swap(tex.memory);
+	tex.levels.clear();
+	tex.levelSizes.clear();
+}
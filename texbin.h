@@ -0,0 +1,84 @@
+#ifndef _TEXBIN_H
+#define _TEXBIN_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/* Block-compressed mip chains of BMP files, cooked on the first run.
+ *
+ * The cache of "foo.bmp" is written next to it as "foo.bmp.texbin", or as
+ * "foo.bmp.1024x512.texbin" when it is resized to 1024x512. Like the
+ * KTX container it records the GL internal format and every mip level, so the
+ * levels go to glCompressedTexImage2D straight from the mapped file. It also
+ * records the hash of the BMP contents and is ignored when the BMP changes.
+ * Layout (little endian):
+ * - texbin_header
+ * - numLevels * texbin_level
+ * - The levels, each aligned to TEXBIN_ALIGNMENT.
+ */
+#define TEXBIN_MAGIC "TEXBIN"
+#define TEXBIN_VERSION 1
+#define TEXBIN_ALIGNMENT 16
+#define TEXBIN_MAX_LEVELS 32
+
+// GL_EXT_texture_compression_s3tc
+#define TEXBIN_BC1 0x83F0	// GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define TEXBIN_BC3 0x83F3	// GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+
+struct texbin_header {
+	char magic[8];
+	unsigned int version;
+	unsigned int format;	// TEXBIN_BC1 or TEXBIN_BC3
+	unsigned int width;
+	unsigned int height;
+	unsigned int numLevels;
+	unsigned int reserved;
+	unsigned long long sourceHash;	// Hash of the BMP contents
+	unsigned long long sourceSize;	// Size of the BMP file in bytes
+};
+
+/* Offset from the beginning of the file and size in bytes. */
+struct texbin_level {
+	unsigned long long offset;
+	unsigned long long size;
+};
+
+struct texbin {
+	void *addr;	// The mapped cache file, nullptr if not mapped
+	size_t size;
+	std::vector<unsigned char> memory;	// The cooked file when it is not mapped
+	std::string cachefile;	// Set by texbin_open for texbin_cook
+	unsigned long long sourceHash;
+	unsigned long long sourceSize;
+	unsigned int format;
+	unsigned int width, height;
+	std::vector<const unsigned char *> levels;
+	std::vector<size_t> levelSizes;
+	texbin(): addr(nullptr), size(0), sourceHash(0), sourceSize(0), format(0), width(0), height(0) {}
+};
+
+/* Hash the contents of 'bmpfile' and map its cache if the cache is valid.
+ * Parameter:
+ * - width, height: The size of level 0, 0 for the size of the BMP.
+ * Return:
+ * - true if 'tex.levels' point into the mapped cache.
+ * - false if there is no valid cache. 'tex.sourceHash' and 'tex.sourceSize'
+ *   are still set for texbin_cook if the BMP could be read.
+ */
+bool texbin_open(const char *bmpfile, unsigned int width, unsigned int height, texbin &tex);
+
+/* Compress a mip chain of mipmap.h made from the contents identified by
+ * 'tex.sourceHash', as BC1, or BC3 if any alpha is not 255, into the cache
+ * texbin_open looked for. 'tex.levels' point at the compressed levels in
+ * 'tex.memory' afterwards.
+ * Return:
+ * - false if the cache cannot be written. 'tex' is still usable.
+ */
+bool texbin_cook(const unsigned char *chain, unsigned int width, unsigned int height,
+		texbin &tex);
+
+/* Unmap the cache file and drop the levels. */
+void texbin_close(texbin &tex);
+
+#endif // _TEXBIN_H
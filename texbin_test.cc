@@ -0,0 +1,298 @@
+/* Checks the BC1/BC3 encoder of texture_compress.h by decoding its blocks,
+ * and that texbin_open() reads back a cooked cache and rejects broken ones.
+ *
+ * Usage: texbin_test
+ *
+ * The test files are written to the working directory and removed again.
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "mapped_file.h"
+#include "mipmap.h"
+#include "texbin.h"
+#include "texture_compress.h"
+
+#define TEST_BMP "texbin_test.bmp"
+
+// The lowest PSNR in dB the encoder may reach on the test images.
+#define MIN_COLOR_PSNR 35.0
+#define MIN_ALPHA_PSNR 32.0
+
+static int failures = 0;
+
+static void fail(const std::string &what)
+{
+	failures++;
+	std::cerr << "FAIL: " << what << std::endl;
+}
+
+/* The four colors of a color block, in the mode GL picks for BC1 or BC3. */
+static void color_palette(const unsigned char *block, bool bc3, unsigned char palette[4][4])
+{
+	unsigned int c[2] = { block[0] | (unsigned int)block[1] << 8, block[2] | (unsigned int)block[3] << 8 };
+	for(int i = 0; i < 2; ++i){
+		unsigned int r = (c[i] >> 11) & 31, g = (c[i] >> 5) & 63, b = c[i] & 31;
+		palette[i][0] = (r << 3) | (r >> 2);
+		palette[i][1] = (g << 2) | (g >> 4);
+		palette[i][2] = (b << 3) | (b >> 2);
+		palette[i][3] = 255;
+	}
+	for(int k = 0; k < 4; ++k){
+		if(bc3 || c[0] > c[1]){
+			palette[2][k] = (2*palette[0][k] + palette[1][k])/3;
+			palette[3][k] = (palette[0][k] + 2*palette[1][k])/3;
+		}else{
+			palette[2][k] = (palette[0][k] + palette[1][k])/2;
+			palette[3][k] = 0;
+		}
+	}
+}
+
+/* Decode the color block of BC1, or of BC3 if 'bc3', to 16 RGBA texels. */
+static void decode_color_block(const unsigned char *block, bool bc3, unsigned char texels[64])
+{
+	unsigned char palette[4][4];
+	color_palette(block, bc3, palette);
+	for(int i = 0; i < 16; ++i){
+		int index = (block[4 + i/4] >> (2*(i%4))) & 3;
+		memcpy(texels + i*4, palette[index], 4);
+	}
+}
+
+/* Decode the alpha block of BC3 into the alpha of 16 RGBA texels. */
+static void decode_alpha_block(const unsigned char *block, unsigned char texels[64])
+{
+	int palette[8] = { block[0], block[1] };
+	for(int k = 2; k < 8; ++k){
+		if(block[0] > block[1])
+			palette[k] = ((8 - k)*block[0] + (k - 1)*block[1])/7;
+		else
+			palette[k] = k < 6? ((6 - k)*block[0] + (k - 1)*block[1])/5: (k == 6? 0: 255);
+	}
+	unsigned long long bits = 0;
+	for(int i = 0; i < 6; ++i)
+		bits |= (unsigned long long)block[2 + i] << (8*i);
+	for(int i = 0; i < 16; ++i)
+		texels[i*4 + 3] = palette[(bits >> (3*i)) & 7];
+}
+
+/* Decode a BC1 or BC3 image of compress_bc1/compress_bc3 to RGBA8. */
+static std::vector<unsigned char> decode(const unsigned char *data, unsigned int width,
+		unsigned int height, bool bc3)
+{
+	std::vector<unsigned char> rgba((size_t)width*height*4);
+	unsigned char texels[64];
+	for(unsigned int y = 0; y < height; y += 4){
+		for(unsigned int x = 0; x < width; x += 4, data += bc3? 16: 8){
+			decode_color_block(bc3? data + 8: data, bc3, texels);
+			if(bc3)
+				decode_alpha_block(data, texels);
+			for(unsigned int j = 0; j < 4 && y + j < height; ++j)
+				for(unsigned int i = 0; i < 4 && x + i < width; ++i)
+					memcpy(&rgba[((size_t)(y + j)*width + x + i)*4], texels + (j*4 + i)*4, 4);
+		}
+	}
+	return rgba;
+}
+
+/* PSNR of the 'first'..'last' channels of two RGBA8 images. */
+static double psnr(const std::vector<unsigned char> &a, const std::vector<unsigned char> &b,
+		int first, int last)
+{
+	double sum = 0.0;
+	size_t count = 0;
+	for(size_t i = 0; i < a.size(); i += 4)
+		for(int k = first; k <= last; ++k, ++count)
+			sum += (a[i + k] - b[i + k])*(a[i + k] - b[i + k]);
+	if(sum == 0.0)
+		return INFINITY;
+	return 10.0*std::log10(255.0*255.0*count/sum);
+}
+
+/* A smooth brightness in one tint with a little noise, like the planet
+ * textures, and an alpha ramp if 'alpha'.
+ */
+static std::vector<unsigned char> make_image(unsigned int width, unsigned int height, bool alpha)
+{
+	std::mt19937 rng(width*131 + height);
+	std::vector<unsigned char> rgba((size_t)width*height*4);
+	for(unsigned int y = 0; y < height; ++y)
+		for(unsigned int x = 0; x < width; ++x){
+			unsigned char *p = &rgba[((size_t)y*width + x)*4];
+			float brightness = 110.0f + 80.0f*std::sin(x*0.3f)*std::cos(y*0.2f);
+			for(int k = 0; k < 3; ++k){
+				int noise = (int)(rng() % 5) - 2;
+				float tint[3] = { 1.1f, 0.9f, 0.6f };
+				p[k] = (unsigned char)std::min(255, std::max(0, (int)(brightness*tint[k]) + noise));
+			}
+			p[3] = alpha? (unsigned char)(128 + 100*std::sin(x*0.4f + y*0.25f)): 255;
+		}
+	return rgba;
+}
+
+static void test_encoder()
+{
+	static const unsigned int sizes[][2] = { { 64, 64 }, { 13, 7 }, { 1, 1 }, { 2, 5 } };
+	for(size_t s = 0; s < sizeof(sizes)/sizeof(sizes[0]); ++s){
+		unsigned int width = sizes[s][0], height = sizes[s][1];
+		std::string name = std::to_string(width) + "x" + std::to_string(height);
+
+		std::vector<unsigned char> opaque = make_image(width, height, false);
+		std::vector<unsigned char> bc1(bc_size(width, height, false));
+		compress_bc1(opaque.data(), width, height, bc1.data());
+		std::vector<unsigned char> decoded = decode(bc1.data(), width, height, false);
+		double colors = psnr(opaque, decoded, 0, 2);
+		if(colors < MIN_COLOR_PSNR)
+			fail("BC1 of " + name + " has a PSNR of " + std::to_string(colors) + " dB");
+		if(psnr(opaque, decoded, 3, 3) != INFINITY)
+			fail("BC1 of " + name + " is not opaque");
+
+		// The BC3 blocks of bc1_to_bc3 decode to the same texels.
+		std::vector<unsigned char> widened(bc_size(width, height, true));
+		bc1_to_bc3(bc1.data(), bc1.size(), widened.data());
+		if(decode(widened.data(), width, height, true) != decoded)
+			fail("bc1_to_bc3 of " + name + " decodes to other texels");
+
+		std::vector<unsigned char> translucent = make_image(width, height, true);
+		std::vector<unsigned char> bc3(bc_size(width, height, true));
+		compress_bc3(translucent.data(), width, height, bc3.data());
+		decoded = decode(bc3.data(), width, height, true);
+		colors = psnr(translucent, decoded, 0, 2);
+		double alpha = psnr(translucent, decoded, 3, 3);
+		if(colors < MIN_COLOR_PSNR || alpha < MIN_ALPHA_PSNR)
+			fail("BC3 of " + name + " has a PSNR of " + std::to_string(colors) + " dB, alpha " +
+					std::to_string(alpha) + " dB");
+	}
+
+	// A single color only loses the bits 565 cannot hold.
+	std::vector<unsigned char> solid(16*4);
+	for(size_t i = 0; i < solid.size(); i += 4){
+		solid[i] = 0x84;
+		solid[i + 1] = 0x41;
+		solid[i + 2] = 0x10;
+		solid[i + 3] = 255;
+	}
+	unsigned char block[8];
+	compress_bc1(solid.data(), 4, 4, block);
+	if(psnr(solid, decode(block, 4, 4, false), 0, 3) != INFINITY)
+		fail("BC1 of a single 565 color is not exact");
+}
+
+static void write_file(const char *filename, const std::string &contents)
+{
+	if(!replace_file(filename, contents.data(), contents.size()))
+		fail(std::string("cannot write ") + filename);
+}
+
+/* Open the cache of TEST_BMP after replacing it with 'contents'. */
+static bool opens_with(const std::string &cachefile, const std::string &contents)
+{
+	texbin tex;
+	write_file(cachefile.c_str(), contents);
+	bool opened = texbin_open(TEST_BMP, 0, 0, tex);
+	texbin_close(tex);
+	return opened;
+}
+
+static void test_cache()
+{
+	const unsigned int width = 32, height = 8;
+	std::vector<unsigned char> chain(mip_chain_size(width, height));
+	std::vector<unsigned char> image = make_image(width, height, false);
+	std::copy(image.begin(), image.end(), chain.begin());
+	generate_mips(chain.data(), width, height);
+
+	// texbin_open only hashes the BMP, so any contents do.
+	write_file(TEST_BMP, "not really a BMP file");
+	texbin tex;
+	if(texbin_open(TEST_BMP, 0, 0, tex))
+		fail("a missing cache is opened");
+	const std::string cachefile = tex.cachefile;
+	if(!texbin_cook(chain.data(), width, height, tex))
+		fail("cannot write the cache");
+	const std::string written(tex.memory.begin(), tex.memory.end());
+	std::vector<std::vector<unsigned char> > levels;
+	for(size_t i = 0; i < tex.levels.size(); ++i)
+		levels.push_back(std::vector<unsigned char>(tex.levels[i], tex.levels[i] + tex.levelSizes[i]));
+	texbin_close(tex);
+
+	if(!texbin_open(TEST_BMP, 0, 0, tex))
+		fail("the written cache is not opened");
+	else if(tex.format != TEXBIN_BC1 || tex.width != width || tex.height != height ||
+			tex.levels.size() != mip_levels(width, height))
+		fail("the cache does not read back its header");
+	else{
+		for(size_t i = 0; i < levels.size(); ++i)
+			if(tex.levelSizes[i] != levels[i].size() ||
+					memcmp(tex.levels[i], levels[i].data(), levels[i].size()) != 0)
+				fail("level " + std::to_string(i) + " does not read back");
+	}
+	texbin_close(tex);
+
+	// Truncated files.
+	if(opens_with(cachefile, written.substr(0, written.size() - 1)))
+		fail("a cache without its last byte is opened");
+	if(opens_with(cachefile, written.substr(0, sizeof(texbin_header) + sizeof(texbin_level))))
+		fail("a cache cut after the first level entry is opened");
+	if(opens_with(cachefile, written.substr(0, sizeof(texbin_header) - 1)))
+		fail("a cache shorter than its header is opened");
+
+	// Broken headers and level tables.
+	std::string other = written;
+	reinterpret_cast<texbin_header *>(&other[0])->version = TEXBIN_VERSION + 1;
+	if(opens_with(cachefile, other))
+		fail("a cache of another format version is opened");
+	other = written;
+	reinterpret_cast<texbin_header *>(&other[0])->format = TEXBIN_BC1 + 1;
+	if(opens_with(cachefile, other))
+		fail("a cache of an unknown format is opened");
+	other = written;
+	reinterpret_cast<texbin_header *>(&other[0])->numLevels -= 1;
+	if(opens_with(cachefile, other))
+		fail("a cache without its last level is opened");
+	other = written;
+	reinterpret_cast<texbin_header *>(&other[0])->width *= 2;
+	if(opens_with(cachefile, other))
+		fail("a cache of the wrong width is opened");
+	other = written;
+	reinterpret_cast<texbin_level *>(&other[sizeof(texbin_header)])[1].offset += 8;
+	if(opens_with(cachefile, other))
+		fail("a cache with a misaligned level is opened");
+	other = written;
+	reinterpret_cast<texbin_level *>(&other[sizeof(texbin_header)])[0].size += 8;
+	if(opens_with(cachefile, other))
+		fail("a cache with a level of the wrong size is opened");
+	other = written;
+	reinterpret_cast<texbin_level *>(&other[sizeof(texbin_header)])[0].offset = written.size();
+	if(opens_with(cachefile, other))
+		fail("a cache with a level past the end is opened");
+	if(!opens_with(cachefile, written))
+		fail("the rewritten cache is not opened");
+
+	// Another BMP.
+	write_file(TEST_BMP, "not really a BMP file either");
+	if(texbin_open(TEST_BMP, 0, 0, tex))
+		fail("the cache of a changed BMP is opened");
+	texbin_close(tex);
+	std::remove(cachefile.c_str());
+}
+
+int main()
+{
+	test_encoder();
+	test_cache();
+	std::remove(TEST_BMP);
+
+	if(failures){
+		std::cerr << failures << " failures" << std::endl;
+		return 1;
+	}
+	std::cout << "texbin_test: all passed" << std::endl;
+	return 0;
+}
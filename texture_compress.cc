@@ -0,0 +1,265 @@
+#include "texture_compress.h"
+
+#include <algorithm>
+#include <cmath>
+
+size_t bc_size(unsigned int width, unsigned int height, bool alpha)
+{
+	return size_t((width + 3)/4)*((height + 3)/4)*(alpha? 16: 8);
+}
+
+/* Copy the 4x4 block at (x, y), repeating the last column and row. */
+static void fetch_block(const unsigned char *rgba, unsigned int width, unsigned int height,
+		unsigned int x, unsigned int y, unsigned char block[64])
+{
+	for(unsigned int j = 0; j < 4; ++j){
+		const unsigned char *row = rgba + size_t(std::min(y + j, height - 1))*width*4;
+		for(unsigned int i = 0; i < 4; ++i){
+			const unsigned char *p = row + std::min(x + i, width - 1)*4;
+			std::copy(p, p + 4, block + (j*4 + i)*4);
+		}
+	}
+}
+
+static unsigned int pack565(const float c[3])
+{
+	int r = (int)std::floor(std::max(0.0f, std::min(255.0f, c[0]))*31.0f/255.0f + 0.5f);
+	int g = (int)std::floor(std::max(0.0f, std::min(255.0f, c[1]))*63.0f/255.0f + 0.5f);
+	int b = (int)std::floor(std::max(0.0f, std::min(255.0f, c[2]))*31.0f/255.0f + 0.5f);
+	return (r << 11) | (g << 5) | b;
+}
+
+static void unpack565(unsigned int c, float out[3])
+{
+	int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+	out[0] = float((r << 3) | (r >> 2));
+	out[1] = float((g << 2) | (g >> 4));
+	out[2] = float((b << 3) | (b >> 2));
+}
+
+/* Pick the nearest of the four palette colors of c0 > c1 for every texel.
+ * Return:
+ * - The squared error of the block.
+ */
+static float assign_indices(const unsigned char block[64], unsigned int c0, unsigned int c1,
+		unsigned char indices[16])
+{
+	float palette[4][3];
+	unpack565(c0, palette[0]);
+	unpack565(c1, palette[1]);
+	for(int k = 0; k < 3; ++k){
+		palette[2][k] = (2.0f*palette[0][k] + palette[1][k])/3.0f;
+		palette[3][k] = (palette[0][k] + 2.0f*palette[1][k])/3.0f;
+	}
+	float error = 0.0f;
+	for(int i = 0; i < 16; ++i){
+		float best = 1e30f;
+		for(int p = 0; p < 4; ++p){
+			float d = 0.0f;
+			for(int k = 0; k < 3; ++k){
+				float e = block[i*4 + k] - palette[p][k];
+				d += e*e;
+			}
+			if(d < best){
+				best = d;
+				indices[i] = p;
+			}
+		}
+		error += best;
+	}
+	return error;
+}
+
+/* The endpoints which fit the block best for the given indices, by least squares. */
+static bool refine_endpoints(const unsigned char block[64], const unsigned char indices[16],
+		float end0[3], float end1[3])
+{
+	static const float weights[4] = { 1.0f, 0.0f, 2.0f/3.0f, 1.0f/3.0f };
+	float aa = 0.0f, ab = 0.0f, bb = 0.0f, ax[3] = { 0, 0, 0 }, bx[3] = { 0, 0, 0 };
+	for(int i = 0; i < 16; ++i){
+		float a = weights[indices[i]], b = 1.0f - a;
+		aa += a*a;
+		ab += a*b;
+		bb += b*b;
+		for(int k = 0; k < 3; ++k){
+			ax[k] += a*block[i*4 + k];
+			bx[k] += b*block[i*4 + k];
+		}
+	}
+	float det = aa*bb - ab*ab;
+	if(std::fabs(det) < 1e-6f)
+		return false;
+	for(int k = 0; k < 3; ++k){
+		end0[k] = (ax[k]*bb - bx[k]*ab)/det;
+		end1[k] = (bx[k]*aa - ax[k]*ab)/det;
+	}
+	return true;
+}
+
+/* Write the 8-byte color block. c0 > c1 selects the four-color mode. */
+static void write_color_block(unsigned int c0, unsigned int c1, const unsigned char indices[16],
+		unsigned char out[8])
+{
+	unsigned int bits = 0;
+	for(int i = 15; i >= 0; --i)
+		bits = (bits << 2) | indices[i];
+	out[0] = c0 & 0xff;
+	out[1] = c0 >> 8;
+	out[2] = c1 & 0xff;
+	out[3] = c1 >> 8;
+	for(int i = 0; i < 4; ++i)
+		out[4 + i] = (bits >> (8*i)) & 0xff;
+}
+
+static void compress_color_block(const unsigned char block[64], unsigned char out[8])
+{
+	// Mean and covariance of the colors.
+	float mean[3] = { 0, 0, 0 };
+	for(int i = 0; i < 16; ++i)
+		for(int k = 0; k < 3; ++k)
+			mean[k] += block[i*4 + k]/16.0f;
+	float cov[6] = { 0, 0, 0, 0, 0, 0 };
+	for(int i = 0; i < 16; ++i){
+		float r = block[i*4] - mean[0], g = block[i*4 + 1] - mean[1], b = block[i*4 + 2] - mean[2];
+		cov[0] += r*r;
+		cov[1] += r*g;
+		cov[2] += r*b;
+		cov[3] += g*g;
+		cov[4] += g*b;
+		cov[5] += b*b;
+	}
+
+	// The principal axis by power iteration.
+	float axis[3] = { 1.0f, 1.0f, 1.0f };
+	for(int iteration = 0; iteration < 8; ++iteration){
+		float next[3] = {
+			cov[0]*axis[0] + cov[1]*axis[1] + cov[2]*axis[2],
+			cov[1]*axis[0] + cov[3]*axis[1] + cov[4]*axis[2],
+			cov[2]*axis[0] + cov[4]*axis[1] + cov[5]*axis[2],
+		};
+		float length = std::max(std::fabs(next[0]), std::max(std::fabs(next[1]), std::fabs(next[2])));
+		if(length < 1e-6f)
+			break;
+		for(int k = 0; k < 3; ++k)
+			axis[k] = next[k]/length;
+	}
+
+	// The extreme colors along the axis are the first endpoints.
+	float lowest = 1e30f, highest = -1e30f;
+	int low = 0, high = 0;
+	for(int i = 0; i < 16; ++i){
+		float t = 0.0f;
+		for(int k = 0; k < 3; ++k)
+			t += (block[i*4 + k] - mean[k])*axis[k];
+		if(t < lowest){
+			lowest = t;
+			low = i;
+		}
+		if(t > highest){
+			highest = t;
+			high = i;
+		}
+	}
+	float end0[3], end1[3];
+	for(int k = 0; k < 3; ++k){
+		end0[k] = block[high*4 + k];
+		end1[k] = block[low*4 + k];
+	}
+
+	unsigned int c0 = pack565(end0), c1 = pack565(end1);
+	unsigned char indices[16];
+	if(c0 == c1){
+		// A single color: every texel takes c0, the mode does not matter.
+		std::fill(indices, indices + 16, 0);
+		write_color_block(c0, c1, indices, out);
+		return;
+	}
+	if(c0 < c1)
+		std::swap(c0, c1);
+	float error = assign_indices(block, c0, c1, indices);
+
+	// Least squares refinement of the endpoints, kept if it is better.
+	for(int iteration = 0; iteration < 2; ++iteration){
+		float r0[3], r1[3];
+		if(!refine_endpoints(block, indices, r0, r1))
+			break;
+		unsigned int n0 = pack565(r0), n1 = pack565(r1);
+		if(n0 == n1)
+			break;
+		if(n0 < n1)
+			std::swap(n0, n1);
+		unsigned char refined[16];
+		float refinedError = assign_indices(block, n0, n1, refined);
+		if(refinedError >= error)
+			break;
+		error = refinedError;
+		c0 = n0;
+		c1 = n1;
+		std::copy(refined, refined + 16, indices);
+	}
+	write_color_block(c0, c1, indices, out);
+}
+
+/* The 8-byte alpha block of BC3, in the mode with six interpolated values. */
+static void compress_alpha_block(const unsigned char block[64], unsigned char out[8])
+{
+	unsigned char a0 = 0, a1 = 255;
+	for(int i = 0; i < 16; ++i){
+		a0 = std::max(a0, block[i*4 + 3]);
+		a1 = std::min(a1, block[i*4 + 3]);
+	}
+	unsigned long long bits = 0;
+	if(a0 != a1){
+		float palette[8];
+		palette[0] = a0;
+		palette[1] = a1;
+		for(int p = 1; p < 7; ++p)
+			palette[p + 1] = ((7 - p)*a0 + p*a1)/7.0f;
+		for(int i = 15; i >= 0; --i){
+			int best = 0;
+			for(int p = 1; p < 8; ++p)
+				if(std::fabs(block[i*4 + 3] - palette[p]) < std::fabs(block[i*4 + 3] - palette[best]))
+					best = p;
+			bits = (bits << 3) | best;
+		}
+	}
+	out[0] = a0;
+	out[1] = a1;
+	for(int i = 0; i < 6; ++i)
+		out[2 + i] = (bits >> (8*i)) & 0xff;
+}
+
+void compress_bc1(const unsigned char *rgba, unsigned int width, unsigned int height,
+		unsigned char *out)
+{
+	unsigned char block[64];
+	for(unsigned int y = 0; y < height; y += 4){
+		for(unsigned int x = 0; x < width; x += 4, out += 8){
+			fetch_block(rgba, width, height, x, y, block);
+			compress_color_block(block, out);
+		}
+	}
+}
+
+void compress_bc3(const unsigned char *rgba, unsigned int width, unsigned int height,
+		unsigned char *out)
+{
+	unsigned char block[64];
+	for(unsigned int y = 0; y < height; y += 4){
+		for(unsigned int x = 0; x < width; x += 4, out += 16){
+			fetch_block(rgba, width, height, x, y, block);
+			compress_alpha_block(block, out);
+			compress_color_block(block, out + 8);
+		}
+	}
+}
+
+void bc1_to_bc3(const unsigned char *bc1, size_t size, unsigned char *out)
+{
+	// Alpha 255 with every index at the first endpoint.
+	static const unsigned char opaque[8] = { 255, 255, 0, 0, 0, 0, 0, 0 };
+	for(size_t i = 0; i < size; i += 8, out += 16){
+		std::copy(opaque, opaque + 8, out);
+		std::copy(bc1 + i, bc1 + i + 8, out + 8);
+	}
+}
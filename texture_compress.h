@@ -0,0 +1,30 @@
+#ifndef _TEXTURE_COMPRESS_H
+#define _TEXTURE_COMPRESS_H
+
+#include <cstddef>
+
+/* BC1 (DXT1) and BC3 (DXT5) compression of RGBA8 images, the formats of
+ * GL_EXT_texture_compression_s3tc.
+ *
+ * Every 4x4 block is fitted along the principal axis of its colors and then
+ * refined by least squares. Blocks across the right or top edge repeat the
+ * last column or row. BC1 is opaque, 8 bytes per block; BC3 adds 8 bytes of
+ * alpha per block.
+ */
+
+/* Size in bytes of a compressed image. */
+size_t bc_size(unsigned int width, unsigned int height, bool alpha);
+
+void compress_bc1(const unsigned char *rgba, unsigned int width, unsigned int height,
+		unsigned char *out);
+void compress_bc3(const unsigned char *rgba, unsigned int width, unsigned int height,
+		unsigned char *out);
+
+/* Widen 'size' bytes of BC1 blocks of compress_bc1 into BC3 blocks with opaque
+ * alpha. The colors are unchanged: BC3 color blocks always decode in the
+ * four-color mode, and compress_bc1 writes no other mode except single colors
+ * at index 0.
+ */
+void bc1_to_bc3(const unsigned char *bc1, size_t size, unsigned char *out);
+
+#endif // _TEXTURE_COMPRESS_H
@@ -0,0 +1,6 @@
+#include "timer.h"
+
+double elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
@@ -0,0 +1,9 @@
+#ifndef _TIMER_H
+#define _TIMER_H
+
+#include <chrono>
+
+/* Milliseconds from 'start' to now on the steady clock. */
+double elapsed_ms(std::chrono::steady_clock::time_point start);
+
+#endif // _TIMER_H
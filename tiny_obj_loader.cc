@@ -5,6 +5,14 @@
 //
 
 //
+// version 0.9.16: Flat face groups, reusable scratch buffers(LoadArena).
+// version 0.9.15: Streaming visitor API(ObjVisitor).
+// version 0.9.14: Optional interleaved vertex output(LOAD_INTERLEAVED).
+// version 0.9.13: SIMD token scanner and fast path for fixed-format decimals.
+// version 0.9.12: Optional multithreaded parsing of line-aligned chunks.
+// version 0.9.11: Parse .obj in place from a memory range (mmap for files).
+//                 Remove the 8192 characters line length limit.
+// version 0.9.10: Replace std::map vertex cache with open-addressing hash table.
 // version 0.9.9: Replace atof() with custom parser.
 // version 0.9.8: Fix multi-materials(per-face material ID).
 // version 0.9.7: Support multi-materials(per-face material ID) per
@@ -28,31 +36,99 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <algorithm>
 #include <fstream>
 #include <sstream>
+#include <iterator>
+#include <climits>
+#include <thread>
+
+#if defined(__SSE2__) && !defined(TINY_OBJ_LOADER_NO_SIMD)
+#include <emmintrin.h>
+#define TINY_OBJ_LOADER_SSE2
+#endif
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #include "tiny_obj_loader.h"
 
 namespace tinyobj {
 
-struct vertex_index {
-  int v_idx, vt_idx, vn_idx;
-  vertex_index(){};
-  vertex_index(int idx) : v_idx(idx), vt_idx(idx), vn_idx(idx){};
-  vertex_index(int vidx, int vtidx, int vnidx)
-      : v_idx(vidx), vt_idx(vtidx), vn_idx(vnidx){};
+static inline bool operator==(const vertex_index &a, const vertex_index &b) {
+  return (a.v_idx == b.v_idx) && (a.vt_idx == b.vt_idx) &&
+         (a.vn_idx == b.vn_idx);
+}
+
+static const unsigned int kEmptySlot = 0xffffffffu;
+
+// Open-addressing (linear probing) hash table from a (v, vt, vn) triple to
+// the index of the vertex emitted for it. The table never grows: it is sized
+// from the number of face corners, which bounds the number of unique keys.
+// The slots live in caller-owned vectors, so they can be reused.
+class vertex_index_map {
+public:
+  vertex_index_map(std::vector<vertex_index> &keys,
+                   std::vector<unsigned int> &values, size_t num_corners)
+      : keys_(keys), values_(values) {
+    size_t capacity = 16;
+    while (capacity < num_corners * 2)
+      capacity <<= 1;
+    mask_ = capacity - 1;
+    keys_.resize(capacity);
+    values_.assign(capacity, kEmptySlot);
+  }
+
+  // Returns the slot of 'key'. The slot is either the one holding 'key' or the
+  // empty slot where it should be inserted.
+  size_t find(const vertex_index &key) const {
+    size_t slot = hash(key) & mask_;
+    while (values_[slot] != kEmptySlot && !(keys_[slot] == key))
+      slot = (slot + 1) & mask_;
+    return slot;
+  }
+
+  bool occupied(size_t slot) const { return values_[slot] != kEmptySlot; }
+  unsigned int value(size_t slot) const { return values_[slot]; }
+
+  void insert(size_t slot, const vertex_index &key, unsigned int value) {
+    keys_[slot] = key;
+    values_[slot] = value;
+  }
+
+private:
+  static size_t hash(const vertex_index &key) {
+    size_t h = static_cast<unsigned int>(key.v_idx) * 0x9e3779b1u;
+    h ^= static_cast<unsigned int>(key.vt_idx) * 0x85ebca77u;
+    h ^= static_cast<unsigned int>(key.vn_idx) * 0xc2b2ae3du;
+    return h ^ (h >> 15);
+  }
+
+  size_t mask_;
+  std::vector<vertex_index> &keys_;
+  std::vector<unsigned int> &values_;
 };
-// for std::map
-static inline bool operator<(const vertex_index &a, const vertex_index &b) {
-  if (a.v_idx != b.v_idx)
-    return (a.v_idx < b.v_idx);
-  if (a.vn_idx != b.vn_idx)
-    return (a.vn_idx < b.vn_idx);
-  if (a.vt_idx != b.vt_idx)
-    return (a.vt_idx < b.vt_idx);
 
-  return false;
-}
+// Faces stored back to back: face i has sizes[i] corners, which follow the
+// corners of face i - 1.
+struct face_group {
+  std::vector<vertex_index> corners;
+  std::vector<unsigned int> sizes;
+
+  bool empty() const { return sizes.empty(); }
+  void clear() {
+    corners.clear();
+    sizes.clear();
+  }
+  void push_back(const vertex_index *indices, size_t num_indices) {
+    corners.insert(corners.end(), indices, indices + num_indices);
+    sizes.push_back(static_cast<unsigned int>(num_indices));
+  }
+};
 
 struct obj_shape {
   std::vector<float> v;
@@ -76,7 +152,7 @@ static inline int fixIndex(int idx, int n) {
 static inline std::string parseString(const char *&token) {
   std::string s;
   token += strspn(token, " \t");
-  int e = strcspn(token, " \t\r");
+  int e = strcspn(token, " \t\r\n");
   s = std::string(token, &token[e]);
   token += e;
   return s;
@@ -85,7 +161,7 @@ static inline std::string parseString(const char *&token) {
 static inline int parseInt(const char *&token) {
   token += strspn(token, " \t");
   int i = atoi(token);
-  token += strcspn(token, " \t\r");
+  token += strcspn(token, " \t\r\n");
   return i;
 }
 
@@ -232,15 +308,131 @@ assemble:
 fail:
 	return false;
 }
+#ifdef TINY_OBJ_LOADER_SSE2
+// Returns the first character at or after p which is ' ', '\t', '\r', '\n',
+// '\0' or, if 'slash' is set, '/'.
+//
+// Only 16-byte aligned blocks are loaded. They never cross a page boundary,
+// so reading them cannot fault, but the block holding the terminator is read
+// up to 15 bytes past it. The caller must make those bytes part of its
+// buffer: forEachLine copies the lines near the end of a buffer with
+// kTokenPadding bytes after them. The bytes before p in its block are read
+// too; they are outside the buffer only before its first token.
+static inline const char *findTokenEnd(const char *p, bool slash) {
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i cr = _mm_set1_epi8('\r');
+  const __m128i lf = _mm_set1_epi8('\n');
+  const __m128i nul = _mm_setzero_si128();
+  const __m128i sep = _mm_set1_epi8(slash ? '/' : ' ');
+
+  size_t misalign = reinterpret_cast<size_t>(p) & 15;
+  const char *block = p - misalign;
+  // Ignore the bytes of the first block which are before p.
+  unsigned int ignore = ~0u << misalign;
+  for (;;) {
+    __m128i c = _mm_load_si128(reinterpret_cast<const __m128i *>(block));
+    __m128i hit = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(c, space), _mm_cmpeq_epi8(c, tab)),
+        _mm_or_si128(_mm_cmpeq_epi8(c, cr), _mm_cmpeq_epi8(c, lf)));
+    hit = _mm_or_si128(hit, _mm_or_si128(_mm_cmpeq_epi8(c, nul),
+                                         _mm_cmpeq_epi8(c, sep)));
+    unsigned int mask = _mm_movemask_epi8(hit) & ignore;
+    if (mask) {
+      return block + __builtin_ctz(mask);
+    }
+    block += 16;
+    ignore = ~0u;
+  }
+}
+
+// Converts 16 ASCII digits to an integer: pairs, then quads of digits are
+// combined with multiply-adds, the four quads are combined in scalar code.
+static inline unsigned long long convertDigits16(const char *digits) {
+  __m128i d = _mm_sub_epi8(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(digits)),
+      _mm_set1_epi8('0'));
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i mul10 = _mm_set_epi16(1, 10, 1, 10, 1, 10, 1, 10);
+  const __m128i mul100 = _mm_set_epi16(1, 100, 1, 100, 1, 100, 1, 100);
+  __m128i pairs =
+      _mm_packs_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(d, zero), mul10),
+                      _mm_madd_epi16(_mm_unpackhi_epi8(d, zero), mul10));
+  int quads[4];
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(quads),
+                   _mm_madd_epi16(pairs, mul100));
+  return (quads[0] * 10000ull + quads[1]) * 100000000ull +
+         (quads[2] * 10000ull + quads[3]);
+}
+#else
+static inline const char *findTokenEnd(const char *p, bool slash) {
+  return p + strcspn(p, slash ? "/ \t\r\n" : " \t\r\n");
+}
+#endif
+
+// Readable bytes findTokenEnd needs after the terminator of a line.
+static const size_t kTokenPadding = 16;
+
+// Parses fixed-format decimals like Blender's "-0.013712": a sign, at most
+// 15 digits and an optional decimal point. The digits fit a double exactly,
+// so one division by an exact power of ten gives the correctly rounded value.
+// Returns false for anything else (exponents, more digits) so the caller can
+// fall back to tryParseDouble.
+static inline bool tryParseFixedDecimal(const char *s, const char *s_end,
+                                        double *result) {
+  static const double kPow10[] = {1e0, 1e1, 1e2,  1e3,  1e4,  1e5,
+                                  1e6, 1e7, 1e8,  1e9,  1e10, 1e11,
+                                  1e12, 1e13, 1e14, 1e15};
+  bool negative = false;
+  if (s < s_end && (*s == '+' || *s == '-')) {
+    negative = (*s == '-');
+    s++;
+  }
+
+  // Gather the digits, without the decimal point, right-aligned behind
+  // leading zeros.
+  char digits[16];
+  memset(digits, '0', sizeof(digits));
+  size_t len = s_end - s;
+  if (len == 0 || len > 16)
+    return false;
+  const char *dot = static_cast<const char *>(memchr(s, '.', len));
+  size_t numDigits = dot ? len - 1 : len;
+  if (numDigits == 0 || numDigits > 15)
+    return false;
+  int fracDigits = dot ? static_cast<int>(s_end - dot - 1) : 0;
+  char *out = digits + 16 - numDigits;
+  for (const char *c = s; c < s_end; c++) {
+    if (c == dot)
+      continue;
+    if (static_cast<unsigned char>(*c - '0') > 9)
+      return false;
+    *out++ = *c;
+  }
+
+#ifdef TINY_OBJ_LOADER_SSE2
+  unsigned long long mantissa = convertDigits16(digits);
+#else
+  unsigned long long mantissa = 0;
+  for (int i = 0; i < 16; i++)
+    mantissa = mantissa * 10 + (digits[i] - '0');
+#endif
+
+  double val = static_cast<double>(mantissa) / kPow10[fracDigits];
+  *result = negative ? -val : val;
+  return true;
+}
+
 static inline float parseFloat(const char *&token) {
   token += strspn(token, " \t");
 #ifdef TINY_OBJ_LOADER_OLD_FLOAT_PARSER
   float f = (float)atof(token);
-  token += strcspn(token, " \t\r");
+  token += strcspn(token, " \t\r\n");
 #else
-  const char *end = token + strcspn(token, " \t\r");
+  const char *end = findTokenEnd(token, false);
   double val = 0.0;
-  tryParseDouble(token, end, &val);
+  if (!tryParseFixedDecimal(token, end, &val))
+    tryParseDouble(token, end, &val);
   float f = static_cast<float>(val);
   token = end;
 #endif
@@ -260,13 +452,36 @@ static inline void parseFloat3(float &x, float &y, float &z,
   z = parseFloat(token);
 }
 
+// Marks an index which is not present in a raw triple.
+static const int kNoIndex = INT_MIN;
+
+// Parses an index of a triple and skips to the next '/' or separator.
+// Like atoi(), garbage after the digits is ignored and no digits give 0.
+static inline int parseIndex(const char *&token) {
+  const char *c = token;
+  bool negative = false;
+  if (*c == '+' || *c == '-') {
+    negative = (*c == '-');
+    c++;
+  }
+  int i = 0;
+  while (static_cast<unsigned char>(*c - '0') <= 9) {
+    i = i * 10 + (*c - '0');
+    c++;
+  }
+  // Almost always already at the separator.
+  if (*c != '/' && !isSpace(*c) && !isNewLine(*c))
+    c = findTokenEnd(c, true);
+  token = c;
+  return negative ? -i : i;
+}
+
 // Parse triples: i, i/j/k, i//k, i/j
-static vertex_index parseTriple(const char *&token, int vsize, int vnsize,
-                                int vtsize) {
-  vertex_index vi(-1);
+// The indices are returned as written in the file, kNoIndex if missing.
+static vertex_index parseRawTriple(const char *&token) {
+  vertex_index vi(kNoIndex);
 
-  vi.v_idx = fixIndex(atoi(token), vsize);
-  token += strcspn(token, "/ \t\r");
+  vi.v_idx = parseIndex(token);
   if (token[0] != '/') {
     return vi;
   }
@@ -275,41 +490,80 @@ static vertex_index parseTriple(const char *&token, int vsize, int vnsize,
   // i//k
   if (token[0] == '/') {
     token++;
-    vi.vn_idx = fixIndex(atoi(token), vnsize);
-    token += strcspn(token, "/ \t\r");
+    vi.vn_idx = parseIndex(token);
     return vi;
   }
 
   // i/j/k or i/j
-  vi.vt_idx = fixIndex(atoi(token), vtsize);
-  token += strcspn(token, "/ \t\r");
+  vi.vt_idx = parseIndex(token);
   if (token[0] != '/') {
     return vi;
   }
 
   // i/j/k
   token++; // skip '/'
-  vi.vn_idx = fixIndex(atoi(token), vnsize);
-  token += strcspn(token, "/ \t\r");
+  vi.vn_idx = parseIndex(token);
+  return vi;
+}
+
+// Parse triples: i, i/j/k, i//k, i/j
+static vertex_index parseTriple(const char *&token, int vsize, int vnsize,
+                                int vtsize) {
+  vertex_index raw = parseRawTriple(token);
+  vertex_index vi(-1);
+
+  vi.v_idx = fixIndex(raw.v_idx, vsize);
+  if (raw.vt_idx != kNoIndex)
+    vi.vt_idx = fixIndex(raw.vt_idx, vtsize);
+  if (raw.vn_idx != kNoIndex)
+    vi.vn_idx = fixIndex(raw.vn_idx, vnsize);
   return vi;
 }
 
 static unsigned int
-updateVertex(std::map<vertex_index, unsigned int> &vertexCache,
-             std::vector<float> &positions, std::vector<float> &normals,
-             std::vector<float> &texcoords,
+updateVertex(vertex_index_map &vertexCache, mesh_t &mesh, unsigned int flags,
              const std::vector<float> &in_positions,
              const std::vector<float> &in_normals,
              const std::vector<float> &in_texcoords, const vertex_index &i) {
-  const std::map<vertex_index, unsigned int>::iterator it = vertexCache.find(i);
+  const size_t slot = vertexCache.find(i);
 
-  if (it != vertexCache.end()) {
+  if (vertexCache.occupied(slot)) {
     // found cache
-    return it->second;
+    return vertexCache.value(slot);
   }
 
   assert(in_positions.size() > (unsigned int)(3 * i.v_idx + 2));
 
+  if (flags & LOAD_INTERLEAVED) {
+    // position, texcoord, normal. Missing attributes are zero.
+    std::vector<float> &vertices = mesh.vertices;
+    vertices.push_back(in_positions[3 * i.v_idx + 0]);
+    vertices.push_back(in_positions[3 * i.v_idx + 1]);
+    vertices.push_back(in_positions[3 * i.v_idx + 2]);
+    if (i.vt_idx >= 0) {
+      vertices.push_back(in_texcoords[2 * i.vt_idx + 0]);
+      vertices.push_back(in_texcoords[2 * i.vt_idx + 1]);
+    } else {
+      vertices.insert(vertices.end(), 2, 0.0f);
+    }
+    if (i.vn_idx >= 0) {
+      vertices.push_back(in_normals[3 * i.vn_idx + 0]);
+      vertices.push_back(in_normals[3 * i.vn_idx + 1]);
+      vertices.push_back(in_normals[3 * i.vn_idx + 2]);
+    } else {
+      vertices.insert(vertices.end(), 3, 0.0f);
+    }
+
+    unsigned int idx = vertices.size() / INTERLEAVED_STRIDE - 1;
+    vertexCache.insert(slot, i, idx);
+
+    return idx;
+  }
+
+  std::vector<float> &positions = mesh.positions;
+  std::vector<float> &normals = mesh.normals;
+  std::vector<float> &texcoords = mesh.texcoords;
+
   positions.push_back(in_positions[3 * i.v_idx + 0]);
   positions.push_back(in_positions[3 * i.v_idx + 1]);
   positions.push_back(in_positions[3 * i.v_idx + 2]);
@@ -326,7 +580,7 @@ updateVertex(std::map<vertex_index, unsigned int> &vertexCache,
   }
 
   unsigned int idx = positions.size() / 3 - 1;
-  vertexCache[i] = idx;
+  vertexCache.insert(slot, i, idx);
 
   return idx;
 }
@@ -352,40 +606,58 @@ void InitMaterial(material_t &material) {
 }
 
 static bool exportFaceGroupToShape(
-    shape_t &shape, std::map<vertex_index, unsigned int> vertexCache,
-    const std::vector<float> &in_positions,
+    shape_t &shape, const std::vector<float> &in_positions,
     const std::vector<float> &in_normals,
-    const std::vector<float> &in_texcoords,
-    const std::vector<std::vector<vertex_index> > &faceGroup,
-    const int material_id, const std::string &name, bool clearCache) {
+    const std::vector<float> &in_texcoords, const face_group &faceGroup,
+    std::vector<vertex_index> &cacheKeys,
+    std::vector<unsigned int> &cacheValues, const int material_id,
+    const std::string &name, unsigned int flags) {
   if (faceGroup.empty()) {
     return false;
   }
 
+  // Each face group is deduplicated on its own, so the cache is sized from
+  // the group's corner count and emptied for the next group.
+  vertex_index_map vertexCache(cacheKeys, cacheValues,
+                               faceGroup.corners.size());
+
+  // The number of triangles is known up front.
+  size_t numTriangles = 0;
+  for (size_t i = 0; i < faceGroup.sizes.size(); i++) {
+    if (faceGroup.sizes[i] >= 3)
+      numTriangles += faceGroup.sizes[i] - 2;
+  }
+  shape.mesh.indices.reserve(shape.mesh.indices.size() + numTriangles * 3);
+  shape.mesh.material_ids.reserve(shape.mesh.material_ids.size() +
+                                  numTriangles);
+
   // Flatten vertices and indices
-  for (size_t i = 0; i < faceGroup.size(); i++) {
-    const std::vector<vertex_index> &face = faceGroup[i];
+  const vertex_index *face = faceGroup.corners.data();
+  for (size_t i = 0; i < faceGroup.sizes.size();
+       face += faceGroup.sizes[i], i++) {
+    size_t npolys = faceGroup.sizes[i];
+    if (npolys < 3) {
+      continue; // not a polygon
+    }
 
     vertex_index i0 = face[0];
     vertex_index i1(-1);
     vertex_index i2 = face[1];
 
-    size_t npolys = face.size();
-
     // Polygon -> triangle fan conversion
     for (size_t k = 2; k < npolys; k++) {
       i1 = i2;
       i2 = face[k];
 
       unsigned int v0 = updateVertex(
-          vertexCache, shape.mesh.positions, shape.mesh.normals,
-          shape.mesh.texcoords, in_positions, in_normals, in_texcoords, i0);
+          vertexCache, shape.mesh, flags, in_positions, in_normals,
+          in_texcoords, i0);
       unsigned int v1 = updateVertex(
-          vertexCache, shape.mesh.positions, shape.mesh.normals,
-          shape.mesh.texcoords, in_positions, in_normals, in_texcoords, i1);
+          vertexCache, shape.mesh, flags, in_positions, in_normals,
+          in_texcoords, i1);
       unsigned int v2 = updateVertex(
-          vertexCache, shape.mesh.positions, shape.mesh.normals,
-          shape.mesh.texcoords, in_positions, in_normals, in_texcoords, i2);
+          vertexCache, shape.mesh, flags, in_positions, in_normals,
+          in_texcoords, i2);
 
       shape.mesh.indices.push_back(v0);
       shape.mesh.indices.push_back(v1);
@@ -397,9 +669,6 @@ static bool exportFaceGroupToShape(
 
   shape.name = name;
 
-  if (clearCache)
-    vertexCache.clear();
-
   return true;
 }
 
@@ -615,89 +884,320 @@ std::string MaterialFileReader::operator()(const std::string &matId,
   return LoadMtl(matMap, materials, matIStream);
 }
 
-std::string LoadObj(std::vector<shape_t> &shapes,
-                    std::vector<material_t> &materials, // [output]
-                    const char *filename, const char *mtl_basepath) {
+static inline bool isGroupingStatement(const char *token) {
+  return ((0 == strncmp(token, "usemtl", 6)) && isSpace((token[6]))) ||
+         ((0 == strncmp(token, "mtllib", 6)) && isSpace((token[6]))) ||
+         (token[0] == 'g' && isSpace((token[1]))) ||
+         (token[0] == 'o' && isSpace((token[1])));
+}
 
-  shapes.clear();
+// Walks the lines of [buf, buf + len) and calls 'parseLine' with the first
+// token of each line which is neither empty nor a comment.
+//
+// Lines are tokenized where they are. Every token parser stops at '\n', and
+// findTokenEnd reads up to kTokenPadding bytes past it, so only the lines
+// from the first one ending within kTokenPadding bytes of the end of the
+// buffer, including a last line without a terminating newline, are copied
+// out with that many '\0' after them. 'lastLine' keeps that copy alive until
+// the caller is done with the returned tokens.
+template <typename LineFn>
+static void forEachLine(const char *buf, size_t len, std::string &lastLine,
+                        LineFn &parseLine) {
+  const char *curr = buf;
+  const char *buf_end = buf + len;
+  bool copied = false;
+  while (curr < buf_end) {
+    const char *eol =
+        static_cast<const char *>(memchr(curr, '\n', buf_end - curr));
+    if (!copied && (!eol || size_t(buf_end - eol) <= kTokenPadding)) {
+      lastLine.assign(curr, buf_end);
+      lastLine.append(kTokenPadding, '\0');
+      buf_end = lastLine.data() + (buf_end - curr);
+      curr = lastLine.data();
+      eol = static_cast<const char *>(memchr(curr, '\n', buf_end - curr));
+      copied = true;
+    }
+    const char *line = curr;
+    curr = eol ? eol + 1 : buf_end;
 
-  std::stringstream err;
+    // Skip leading space.
+    const char *token = line;
+    token += strspn(token, " \t");
 
-  std::ifstream ifs(filename);
-  if (!ifs) {
-    err << "Cannot open file [" << filename << "]" << std::endl;
-    return err.str();
+    assert(token);
+    if (isNewLine(token[0]))
+      continue; // empty line
+
+    if (token[0] == '#')
+      continue; // comment line
+
+    if (!parseLine(token))
+      return;
   }
+}
 
-  std::string basePath;
-  if (mtl_basepath) {
-    basePath = mtl_basepath;
+// A statement of a chunk which has to be replayed in file order, after
+// 'numFaces' faces of the chunk.
+struct obj_statement {
+  size_t numFaces;
+  const char *token;
+};
+
+// Geometry parsed from one line-aligned chunk of the file.
+//
+// Face indices are fixed against the element counts of the chunk alone.
+// Relative (negative) indices additionally need the number of elements of
+// all preceding chunks, so the corners holding them are remembered and
+// offset after the chunk sizes have been prefix-summed.
+struct obj_chunk {
+  const char *begin;
+  const char *end;
+
+  std::vector<float> v;
+  std::vector<float> vn;
+  std::vector<float> vt;
+  std::vector<vertex_index> corners;
+  std::vector<unsigned int> faceSizes;
+  std::vector<size_t> relativeV;
+  std::vector<size_t> relativeVt;
+  std::vector<size_t> relativeVn;
+  std::vector<obj_statement> statements;
+  std::string lastLine;
+
+  bool operator()(const char *token) {
+    // vertex
+    if (token[0] == 'v' && isSpace((token[1]))) {
+      token += 2;
+      float x, y, z;
+      parseFloat3(x, y, z, token);
+      v.push_back(x);
+      v.push_back(y);
+      v.push_back(z);
+      return true;
+    }
+
+    // normal
+    if (token[0] == 'v' && token[1] == 'n' && isSpace((token[2]))) {
+      token += 3;
+      float x, y, z;
+      parseFloat3(x, y, z, token);
+      vn.push_back(x);
+      vn.push_back(y);
+      vn.push_back(z);
+      return true;
+    }
+
+    // texcoord
+    if (token[0] == 'v' && token[1] == 't' && isSpace((token[2]))) {
+      token += 3;
+      float x, y;
+      parseFloat2(x, y, token);
+      vt.push_back(x);
+      vt.push_back(y);
+      return true;
+    }
+
+    // face
+    if (token[0] == 'f' && isSpace((token[1]))) {
+      token += 2;
+      token += strspn(token, " \t");
+
+      unsigned int n = 0;
+      while (!isNewLine(token[0])) {
+        vertex_index raw = parseRawTriple(token);
+        vertex_index vi(-1);
+        vi.v_idx = fixLocal(raw.v_idx, v.size() / 3, relativeV);
+        if (raw.vt_idx != kNoIndex)
+          vi.vt_idx = fixLocal(raw.vt_idx, vt.size() / 2, relativeVt);
+        if (raw.vn_idx != kNoIndex)
+          vi.vn_idx = fixLocal(raw.vn_idx, vn.size() / 3, relativeVn);
+        corners.push_back(vi);
+        n++;
+        token += strspn(token, " \t\r");
+      }
+
+      faceSizes.push_back(n);
+
+      return true;
+    }
+
+    if (isGroupingStatement(token)) {
+      obj_statement st;
+      st.numFaces = faceSizes.size();
+      st.token = token;
+      statements.push_back(st);
+    }
+
+    // Ignore unknown command.
+    return true;
   }
-  MaterialFileReader matFileReader(basePath);
 
-  return LoadObj(shapes, materials, ifs, matFileReader);
-}
+  int fixLocal(int idx, int n, std::vector<size_t> &relative) {
+    if (idx < 0)
+      relative.push_back(corners.size());
+    return fixIndex(idx, n);
+  }
 
-std::string LoadObj(std::vector<shape_t> &shapes,
-                    std::vector<material_t> &materials, // [output]
-                    std::istream &inStream, MaterialReader &readMatFn) {
-  std::stringstream err;
+  void reset() {
+    v.clear();
+    vn.clear();
+    vt.clear();
+    corners.clear();
+    faceSizes.clear();
+    relativeV.clear();
+    relativeVt.clear();
+    relativeVn.clear();
+    statements.clear();
+    lastLine.clear();
+  }
+};
+
+static void parseChunk(obj_chunk *chunk) {
+  forEachLine(chunk->begin, chunk->end - chunk->begin, chunk->lastLine,
+              *chunk);
+}
 
+// Scratch buffers of LoadObj. reset() empties them but keeps their capacity.
+struct LoadArena::buffers_t {
   std::vector<float> v;
   std::vector<float> vn;
   std::vector<float> vt;
-  std::vector<std::vector<vertex_index> > faceGroup;
-  std::string name;
+  face_group faceGroup;
+  std::vector<vertex_index> cacheKeys;
+  std::vector<unsigned int> cacheValues;
+  std::vector<vertex_index> face;
+  std::string lastLine;
+  std::vector<obj_chunk> chunks;
+
+  void reset() {
+    v.clear();
+    vn.clear();
+    vt.clear();
+    faceGroup.clear();
+    face.clear();
+    lastLine.clear();
+    for (size_t i = 0; i < chunks.size(); i++)
+      chunks[i].reset();
+  }
+};
 
-  // material
-  std::map<std::string, int> material_map;
-  std::map<vertex_index, unsigned int> vertexCache;
-  int material = -1;
+LoadArena::LoadArena() : buffers(new buffers_t) {}
+
+LoadArena::~LoadArena() { delete buffers; }
+
+void LoadArena::release() {
+  delete buffers;
+  buffers = new buffers_t;
+}
 
+// Builds shapes from the statements of an .obj file.
+class obj_shape_builder : public ObjVisitor {
+public:
+  std::vector<float> &v;
+  std::vector<float> &vn;
+  std::vector<float> &vt;
+  face_group &faceGroup;
+  std::string name;
+  int material;
   shape_t shape;
 
-  int maxchars = 8192;             // Alloc enough size.
-  std::vector<char> buf(maxchars); // Alloc enough size.
-  while (inStream.peek() != -1) {
-    inStream.getline(&buf[0], maxchars);
+  obj_shape_builder(std::vector<shape_t> &output_shapes,
+                    LoadArena::buffers_t &arena, unsigned int flags)
+      : v(arena.v), vn(arena.vn), vt(arena.vt), faceGroup(arena.faceGroup),
+        material(-1), arena_(arena), shapes_(output_shapes), flags_(flags) {}
 
-    std::string linebuf(&buf[0]);
+  virtual void on_vertex(float x, float y, float z) {
+    v.push_back(x);
+    v.push_back(y);
+    v.push_back(z);
+  }
 
-    // Trim newline '\r\n' or '\n'
-    if (linebuf.size() > 0) {
-      if (linebuf[linebuf.size() - 1] == '\n')
-        linebuf.erase(linebuf.size() - 1);
+  virtual void on_normal(float x, float y, float z) {
+    vn.push_back(x);
+    vn.push_back(y);
+    vn.push_back(z);
+  }
+
+  virtual void on_texcoord(float x, float y) {
+    vt.push_back(x);
+    vt.push_back(y);
+  }
+
+  virtual void on_face(const vertex_index *indices, size_t num_indices) {
+    faceGroup.push_back(indices, num_indices);
+  }
+
+  virtual void on_group(const std::string &group_name) {
+    // flush previous face group.
+    if (exportFaceGroup()) {
+      shapes_.push_back(std::move(shape));
     }
-    if (linebuf.size() > 0) {
-      if (linebuf[linebuf.size() - 1] == '\r')
-        linebuf.erase(linebuf.size() - 1);
+
+    shape = shape_t();
+
+    // material = -1;
+    faceGroup.clear();
+
+    name = group_name;
+  }
+
+  virtual void on_usemtl(const std::string &material_name, int material_id) {
+    (void)material_name;
+
+    // Create face group per material.
+    if (exportFaceGroup()) {
+      faceGroup.clear();
     }
 
-    // Skip if empty line.
-    if (linebuf.empty()) {
-      continue;
+    material = material_id;
+  }
+
+  // Exports the last face group.
+  void finish() {
+    if (exportFaceGroup()) {
+      shapes_.push_back(std::move(shape));
     }
+    faceGroup.clear(); // for safety
+  }
 
-    // Skip leading space.
-    const char *token = linebuf.c_str();
-    token += strspn(token, " \t");
+private:
+  bool exportFaceGroup() {
+    return exportFaceGroupToShape(shape, v, vn, vt, faceGroup,
+                                  arena_.cacheKeys, arena_.cacheValues,
+                                  material, name, flags_);
+  }
 
-    assert(token);
-    if (token[0] == '\0')
-      continue; // empty line
+  LoadArena::buffers_t &arena_;
+  std::vector<shape_t> &shapes_;
+  unsigned int flags_;
+};
 
-    if (token[0] == '#')
-      continue; // comment line
+// Tokenizes statements and passes them to a visitor. Keeps the element
+// counts to resolve relative indices, and the materials to resolve names.
+struct obj_reader {
+  ObjVisitor &visitor;
+  std::vector<material_t> &materials;
+  MaterialReader &readMatFn;
+  std::map<std::string, int> material_map;
+  int numV, numVn, numVt;
+  std::vector<vertex_index> &face; // reused for every 'f'
+  std::string err;
 
+  obj_reader(ObjVisitor &vis, std::vector<material_t> &mat,
+             MaterialReader &reader, std::vector<vertex_index> &face_buffer)
+      : visitor(vis), materials(mat), readMatFn(reader), numV(0), numVn(0),
+        numVt(0), face(face_buffer) {}
+
+  // Returns false to stop parsing.
+  bool operator()(const char *token) {
     // vertex
     if (token[0] == 'v' && isSpace((token[1]))) {
       token += 2;
       float x, y, z;
       parseFloat3(x, y, z, token);
-      v.push_back(x);
-      v.push_back(y);
-      v.push_back(z);
-      continue;
+      visitor.on_vertex(x, y, z);
+      numV++;
+      return true;
     }
 
     // normal
@@ -705,10 +1205,9 @@ std::string LoadObj(std::vector<shape_t> &shapes,
       token += 3;
       float x, y, z;
       parseFloat3(x, y, z, token);
-      vn.push_back(x);
-      vn.push_back(y);
-      vn.push_back(z);
-      continue;
+      visitor.on_normal(x, y, z);
+      numVn++;
+      return true;
     }
 
     // texcoord
@@ -716,9 +1215,9 @@ std::string LoadObj(std::vector<shape_t> &shapes,
       token += 3;
       float x, y;
       parseFloat2(x, y, token);
-      vt.push_back(x);
-      vt.push_back(y);
-      continue;
+      visitor.on_texcoord(x, y);
+      numVt++;
+      return true;
     }
 
     // face
@@ -726,34 +1225,33 @@ std::string LoadObj(std::vector<shape_t> &shapes,
       token += 2;
       token += strspn(token, " \t");
 
-      std::vector<vertex_index> face;
+      face.clear();
       while (!isNewLine(token[0])) {
-        vertex_index vi =
-            parseTriple(token, v.size() / 3, vn.size() / 3, vt.size() / 2);
+        vertex_index vi = parseTriple(token, numV, numVn, numVt);
         face.push_back(vi);
         int n = strspn(token, " \t\r");
         token += n;
       }
 
-      faceGroup.push_back(face);
+      visitor.on_face(face.data(), face.size());
 
-      continue;
+      return true;
     }
 
+    // Ignore unknown command.
+    return parseGroupingStatement(token);
+  }
+
+  // Handles the statements which split faces into shapes: usemtl, mtllib, g
+  // and o. Returns false if loading a material library failed.
+  bool parseGroupingStatement(const char *token) {
     // use mtl
     if ((0 == strncmp(token, "usemtl", 6)) && isSpace((token[6]))) {
 
-      char namebuf[4096];
       token += 7;
-      sscanf(token, "%s", namebuf);
-
-      // Create face group per material.
-      bool ret = exportFaceGroupToShape(shape, vertexCache, v, vn, vt,
-                                        faceGroup, material, name, true);
-      if (ret) {
-        faceGroup.clear();
-      }
+      std::string namebuf = parseString(token);
 
+      int material = -1;
       if (material_map.find(namebuf) != material_map.end()) {
         material = material_map[namebuf];
       } else {
@@ -761,91 +1259,330 @@ std::string LoadObj(std::vector<shape_t> &shapes,
         material = -1;
       }
 
-      continue;
+      visitor.on_usemtl(namebuf, material);
+
+      return true;
     }
 
     // load mtl
     if ((0 == strncmp(token, "mtllib", 6)) && isSpace((token[6]))) {
-      char namebuf[4096];
       token += 7;
-      sscanf(token, "%s", namebuf);
-
-      std::string err_mtl = readMatFn(namebuf, materials, material_map);
-      if (!err_mtl.empty()) {
-        faceGroup.clear(); // for safety
-        return err_mtl;
-      }
+      std::string namebuf = parseString(token);
 
-      continue;
+      err = readMatFn(namebuf, materials, material_map);
+      return err.empty();
     }
 
     // group name
     if (token[0] == 'g' && isSpace((token[1]))) {
 
-      // flush previous face group.
-      bool ret = exportFaceGroupToShape(shape, vertexCache, v, vn, vt,
-                                        faceGroup, material, name, true);
-      if (ret) {
-        shapes.push_back(shape);
-      }
+      // Only the first name is used, the others are ignored.
+      token += 2;
+      visitor.on_group(parseString(token));
 
-      shape = shape_t();
+      return true;
+    }
 
-      // material = -1;
-      faceGroup.clear();
+    // object name
+    if (token[0] == 'o' && isSpace((token[1]))) {
 
-      std::vector<std::string> names;
-      while (!isNewLine(token[0])) {
-        std::string str = parseString(token);
-        names.push_back(str);
-        token += strspn(token, " \t\r"); // skip tag
-      }
+      // @todo { multiple object name? }
+      token += 2;
+      visitor.on_group(parseString(token));
 
-      assert(names.size() > 0);
+      return true;
+    }
 
-      // names[0] must be 'g', so skip the 0th element.
-      if (names.size() > 1) {
-        name = names[1];
-      } else {
-        name = "";
-      }
+    return true;
+  }
+};
 
-      continue;
+// Copies the geometry of 'chunk' to its place in the merged arrays and
+// offsets its relative indices by the element counts of preceding chunks.
+static void mergeChunk(obj_chunk *chunk, obj_shape_builder *builder,
+                       size_t vOffset, size_t vnOffset, size_t vtOffset) {
+  std::copy(chunk->v.begin(), chunk->v.end(), builder->v.begin() + vOffset);
+  std::copy(chunk->vn.begin(), chunk->vn.end(),
+            builder->vn.begin() + vnOffset);
+  std::copy(chunk->vt.begin(), chunk->vt.end(),
+            builder->vt.begin() + vtOffset);
+
+  for (size_t i = 0; i < chunk->relativeV.size(); i++)
+    chunk->corners[chunk->relativeV[i]].v_idx += vOffset / 3;
+  for (size_t i = 0; i < chunk->relativeVt.size(); i++)
+    chunk->corners[chunk->relativeVt[i]].vt_idx += vtOffset / 2;
+  for (size_t i = 0; i < chunk->relativeVn.size(); i++)
+    chunk->corners[chunk->relativeVn[i]].vn_idx += vnOffset / 3;
+}
+
+// Runs 'fn(&items[i], ...)' for every item, one thread per item.
+template <typename T, typename Fn>
+static void runOnThreads(T *items, size_t count, Fn fn) {
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < count; i++)
+    threads.push_back(std::thread(fn, &items[i]));
+  fn(&items[0]);
+  for (size_t i = 0; i < threads.size(); i++)
+    threads[i].join();
+}
+
+// Don't split the file into chunks smaller than this.
+static const size_t kMinChunkSize = 1 << 20;
+
+
+static std::string LoadObjParallel(std::vector<shape_t> &shapes,
+                                   std::vector<material_t> &materials,
+                                   const char *buf, size_t len,
+                                   MaterialReader &readMatFn,
+                                   unsigned int num_chunks,
+                                   unsigned int flags,
+                                   LoadArena::buffers_t &arena) {
+  // Split the file into line-aligned chunks. The chunk objects are kept in
+  // the arena, so their vectors are reused by the next load.
+  std::vector<obj_chunk> &chunks = arena.chunks;
+  if (chunks.size() < num_chunks)
+    chunks.resize(num_chunks);
+  const char *buf_end = buf + len;
+  const char *begin = buf;
+  unsigned int used = 0;
+  for (unsigned int i = 1; i <= num_chunks && begin < buf_end; i++) {
+    const char *end = buf_end;
+    if (i < num_chunks) {
+      end = buf + len / num_chunks * i;
+      if (end < begin)
+        end = begin;
+      const char *eol =
+          static_cast<const char *>(memchr(end, '\n', buf_end - end));
+      end = eol ? eol + 1 : buf_end;
     }
+    chunks[used].begin = begin;
+    chunks[used].end = end;
+    used++;
+    begin = end;
+  }
 
-    // object name
-    if (token[0] == 'o' && isSpace((token[1]))) {
+  runOnThreads(&chunks[0], used, parseChunk);
 
-      // flush previous face group.
-      bool ret = exportFaceGroupToShape(shape, vertexCache, v, vn, vt,
-                                        faceGroup, material, name, true);
-      if (ret) {
-        shapes.push_back(shape);
+  // Prefix-sum the element counts and merge the chunks.
+  obj_shape_builder builder(shapes, arena, flags);
+  size_t numV = 0, numVn = 0, numVt = 0;
+  for (size_t i = 0; i < used; i++) {
+    numV += chunks[i].v.size();
+    numVn += chunks[i].vn.size();
+    numVt += chunks[i].vt.size();
+  }
+  builder.v.resize(numV);
+  builder.vn.resize(numVn);
+  builder.vt.resize(numVt);
+
+  std::vector<std::thread> threads;
+  numV = numVn = numVt = 0;
+  for (size_t i = 0; i < used; i++) {
+    threads.push_back(std::thread(mergeChunk, &chunks[i], &builder, numV,
+                                  numVn, numVt));
+    numV += chunks[i].v.size();
+    numVn += chunks[i].vn.size();
+    numVt += chunks[i].vt.size();
+  }
+  for (size_t i = 0; i < threads.size(); i++)
+    threads[i].join();
+
+  // Replay faces and grouping statements in file order, the same way the
+  // serial loader sees them.
+  obj_reader reader(builder, materials, readMatFn, arena.face);
+  for (size_t i = 0; i < used; i++) {
+    const obj_chunk &chunk = chunks[i];
+    size_t face = 0, corner = 0;
+    for (size_t s = 0; s <= chunk.statements.size(); s++) {
+      size_t numFaces = s < chunk.statements.size()
+                            ? chunk.statements[s].numFaces
+                            : chunk.faceSizes.size();
+      for (; face < numFaces; face++) {
+        builder.on_face(&chunk.corners[corner], chunk.faceSizes[face]);
+        corner += chunk.faceSizes[face];
       }
 
-      // material = -1;
-      faceGroup.clear();
-      shape = shape_t();
+      if (s < chunk.statements.size() &&
+          !reader.parseGroupingStatement(chunk.statements[s].token)) {
+        return reader.err;
+      }
+    }
+  }
 
-      // @todo { multiple object name? }
-      char namebuf[4096];
-      token += 2;
-      sscanf(token, "%s", namebuf);
-      name = std::string(namebuf);
+  builder.finish();
 
-      continue;
+  return std::string();
+}
+
+// An .obj file mapped into memory. Where mmap is not available the file is
+// read into 'buffer' instead.
+struct obj_file {
+  const char *data;
+  size_t len;
+  void *addr;
+  std::string buffer;
+
+  obj_file() : data(""), len(0), addr(NULL) {}
+  ~obj_file() {
+#ifndef _WIN32
+    if (addr)
+      munmap(addr, len);
+#endif
+  }
+
+  // Returns an error message, or an empty string on success.
+  std::string map(const char *filename) {
+    std::stringstream err;
+
+#ifndef _WIN32
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+      err << "Cannot open file [" << filename << "]" << std::endl;
+      return err.str();
     }
 
-    // Ignore unknown command.
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      close(fd);
+      err << "Cannot stat file [" << filename << "]" << std::endl;
+      return err.str();
+    }
+
+    len = static_cast<size_t>(st.st_size);
+    if (len == 0) {
+      close(fd);
+      return err.str();
+    }
+
+    addr = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+      addr = NULL;
+      len = 0;
+      err << "Cannot map file [" << filename << "]" << std::endl;
+      return err.str();
+    }
+    madvise(addr, len, MADV_SEQUENTIAL);
+    data = static_cast<const char *>(addr);
+#else
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs) {
+      err << "Cannot open file [" << filename << "]" << std::endl;
+      return err.str();
+    }
+    buffer.assign((std::istreambuf_iterator<char>(ifs)),
+                  std::istreambuf_iterator<char>());
+    data = buffer.data();
+    len = buffer.size();
+#endif
+
+    return err.str();
+  }
+};
+
+// Feeds every statement of 'buf' to 'visitor'.
+static std::string parseObj(ObjVisitor &visitor,
+                            std::vector<material_t> &materials,
+                            const char *buf, size_t len,
+                            MaterialReader &readMatFn,
+                            LoadArena::buffers_t &arena) {
+  obj_reader reader(visitor, materials, readMatFn, arena.face);
+  forEachLine(buf, len, arena.lastLine, reader);
+  return reader.err;
+}
+
+std::string LoadObj(std::vector<shape_t> &shapes,
+                    std::vector<material_t> &materials, // [output]
+                    const char *filename, const char *mtl_basepath,
+                    unsigned int num_threads, unsigned int flags,
+                    LoadArena *arena) {
+
+  shapes.clear();
+
+  std::string basePath;
+  if (mtl_basepath) {
+    basePath = mtl_basepath;
   }
+  MaterialFileReader matFileReader(basePath);
 
-  bool ret = exportFaceGroupToShape(shape, vertexCache, v, vn, vt, faceGroup,
-                                    material, name, true);
-  if (ret) {
-    shapes.push_back(shape);
+  obj_file file;
+  std::string err = file.map(filename);
+  if (!err.empty()) {
+    return err;
   }
-  faceGroup.clear(); // for safety
 
-  return err.str();
+  return LoadObj(shapes, materials, file.data, file.len, matFileReader,
+                 num_threads, flags, arena);
+}
+
+std::string LoadObj(std::vector<shape_t> &shapes,
+                    std::vector<material_t> &materials, // [output]
+                    std::istream &inStream, MaterialReader &readMatFn,
+                    unsigned int flags) {
+  // Read the whole stream, then parse it in place like a mapped file.
+  std::string data((std::istreambuf_iterator<char>(inStream)),
+                   std::istreambuf_iterator<char>());
+
+  return LoadObj(shapes, materials, data.data(), data.size(), readMatFn, 1,
+                 flags);
+}
+
+std::string LoadObj(std::vector<shape_t> &shapes,
+                    std::vector<material_t> &materials, // [output]
+                    const char *buf, size_t len, MaterialReader &readMatFn,
+                    unsigned int num_threads, unsigned int flags,
+                    LoadArena *arena) {
+  LoadArena localArena;
+  if (!arena) {
+    arena = &localArena;
+  }
+  LoadArena::buffers_t &buffers = *arena->buffers;
+  buffers.reset();
+
+  if (num_threads == 0) {
+    num_threads = std::thread::hardware_concurrency();
+  }
+  if (num_threads > len / kMinChunkSize) {
+    num_threads = static_cast<unsigned int>(len / kMinChunkSize);
+  }
+  if (num_threads > 1) {
+    return LoadObjParallel(shapes, materials, buf, len, readMatFn,
+                           num_threads, flags, buffers);
+  }
+
+  obj_shape_builder builder(shapes, buffers, flags);
+  std::string err = parseObj(builder, materials, buf, len, readMatFn, buffers);
+  if (!err.empty()) {
+    return err;
+  }
+
+  builder.finish();
+
+  return std::string();
+}
+
+std::string LoadObj(ObjVisitor &visitor,
+                    std::vector<material_t> &materials, // [output]
+                    const char *filename, const char *mtl_basepath) {
+  std::string basePath;
+  if (mtl_basepath) {
+    basePath = mtl_basepath;
+  }
+  MaterialFileReader matFileReader(basePath);
+
+  obj_file file;
+  std::string err = file.map(filename);
+  if (!err.empty()) {
+    return err;
+  }
+
+  return LoadObj(visitor, materials, file.data, file.len, matFileReader);
+}
+
+std::string LoadObj(ObjVisitor &visitor,
+                    std::vector<material_t> &materials, // [output]
+                    const char *buf, size_t len, MaterialReader &readMatFn) {
+  LoadArena arena;
+  return parseObj(visitor, materials, buf, len, readMatFn, *arena.buffers);
 }
 }
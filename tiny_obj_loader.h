@@ -37,6 +37,7 @@ typedef struct {
   std::vector<float> positions;
   std::vector<float> normals;
   std::vector<float> texcoords;
+  std::vector<float> vertices; // interleaved, filled with LOAD_INTERLEAVED
   std::vector<unsigned int> indices;
   std::vector<int> material_ids; // per-mesh material ID
 } mesh_t;
@@ -46,6 +47,51 @@ typedef struct {
   mesh_t mesh;
 } shape_t;
 
+/// Flags of LoadObj.
+enum {
+  /// Emit one tightly packed vertex stream in mesh_t::vertices instead of
+  /// positions/normals/texcoords. Each vertex is INTERLEAVED_STRIDE floats:
+  /// position(3), texcoord(2), normal(3). Missing attributes are zero.
+  LOAD_INTERLEAVED = 1
+};
+
+/// Floats per vertex of mesh_t::vertices.
+enum { INTERLEAVED_STRIDE = 8 };
+
+/// Index of a face corner into the positions, texcoords and normals of the
+/// file. Indices are zero-based; a missing texcoord or normal index is -1.
+struct vertex_index {
+  int v_idx, vt_idx, vn_idx;
+  vertex_index(){};
+  vertex_index(int idx) : v_idx(idx), vt_idx(idx), vn_idx(idx){};
+  vertex_index(int vidx, int vtidx, int vnidx)
+      : v_idx(vidx), vt_idx(vtidx), vn_idx(vnidx){};
+};
+
+/// Receives the statements of an .obj file one by one, in file order.
+/// Override the callbacks of interest; the others do nothing.
+class ObjVisitor {
+public:
+  ObjVisitor() {}
+  virtual ~ObjVisitor() {}
+
+  /// 'v' statement.
+  virtual void on_vertex(float /*x*/, float /*y*/, float /*z*/) {}
+  /// 'vn' statement.
+  virtual void on_normal(float /*x*/, float /*y*/, float /*z*/) {}
+  /// 'vt' statement.
+  virtual void on_texcoord(float /*u*/, float /*v*/) {}
+  /// 'f' statement. Relative indices are already resolved. 'indices' is only
+  /// valid during the call.
+  virtual void on_face(const vertex_index * /*indices*/,
+                       size_t /*num_indices*/) {}
+  /// 'g' or 'o' statement. 'name' is empty for a 'g' without a name.
+  virtual void on_group(const std::string & /*name*/) {}
+  /// 'usemtl' statement. 'material_id' indexes the loaded materials, or is -1
+  /// if the material is unknown.
+  virtual void on_usemtl(const std::string & /*name*/, int /*material_id*/) {}
+};
+
 class MaterialReader {
 public:
   MaterialReader() {}
@@ -69,21 +115,77 @@ private:
   std::string m_mtlBasePath;
 };
 
+/// Scratch memory of LoadObj: vertex arrays, face groups, the vertex
+/// dedup table and the per-thread chunks. Passing the same arena to
+/// several LoadObj calls reuses their capacity, so loading many files
+/// allocates little more than the output shapes. Not thread-safe; use one
+/// arena per loading thread.
+class LoadArena {
+public:
+  LoadArena();
+  ~LoadArena();
+
+  /// Frees the memory kept between loads.
+  void release();
+
+  struct buffers_t;
+  buffers_t *buffers;
+
+private:
+  LoadArena(const LoadArena &);
+  LoadArena &operator=(const LoadArena &);
+};
+
 /// Loads .obj from a file.
+/// The file is memory mapped and parsed in place where mmap is available.
 /// 'shapes' will be filled with parsed shape data
 /// The function returns error string.
 /// Returns empty string when loading .obj success.
 /// 'mtl_basepath' is optional, and used for base path for .mtl file.
+/// 'num_threads' is optional, see the memory range overload.
+/// 'flags' is a combination of the LOAD_* flags.
+/// 'arena' is optional; without one the scratch memory is freed on return.
 std::string LoadObj(std::vector<shape_t> &shapes,       // [output]
                     std::vector<material_t> &materials, // [output]
-                    const char *filename, const char *mtl_basepath = NULL);
+                    const char *filename, const char *mtl_basepath = NULL,
+                    unsigned int num_threads = 1, unsigned int flags = 0,
+                    LoadArena *arena = NULL);
 
 /// Loads object from a std::istream, uses GetMtlIStreamFn to retrieve
 /// std::istream for materials.
 /// Returns empty string when loading .obj success.
 std::string LoadObj(std::vector<shape_t> &shapes,       // [output]
                     std::vector<material_t> &materials, // [output]
-                    std::istream &inStream, MaterialReader &readMatFn);
+                    std::istream &inStream, MaterialReader &readMatFn,
+                    unsigned int flags = 0);
+
+/// Loads object from the memory range [buf, buf + len).
+/// Lines are tokenized in place, so no line is copied and there is no limit
+/// on the line length. The range does not need to be null-terminated.
+/// With 'num_threads' > 1 the range is split into line-aligned chunks which
+/// are parsed concurrently and then merged; the result is the same as the
+/// serial one. 0 uses one thread per core. Chunks are at least 1 MB, so
+/// small files are always parsed serially.
+/// Returns empty string when loading .obj success.
+std::string LoadObj(std::vector<shape_t> &shapes,       // [output]
+                    std::vector<material_t> &materials, // [output]
+                    const char *buf, size_t len, MaterialReader &readMatFn,
+                    unsigned int num_threads = 1, unsigned int flags = 0,
+                    LoadArena *arena = NULL);
+
+/// Streams the .obj file to 'visitor' instead of building shapes, so no
+/// intermediate face groups or meshes are allocated. 'mtllib' statements
+/// still load materials into 'materials'.
+/// Returns empty string when loading .obj success.
+std::string LoadObj(ObjVisitor &visitor,
+                    std::vector<material_t> &materials, // [output]
+                    const char *filename, const char *mtl_basepath = NULL);
+
+/// Streams the .obj in the memory range [buf, buf + len) to 'visitor'.
+/// Returns empty string when loading .obj success.
+std::string LoadObj(ObjVisitor &visitor,
+                    std::vector<material_t> &materials, // [output]
+                    const char *buf, size_t len, MaterialReader &readMatFn);
 
 /// Loads materials into std::map
 /// Returns an empty string if successful
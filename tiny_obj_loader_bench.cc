@@ -0,0 +1,237 @@
+//
+// Benchmarks of the OBJ loader internals.
+//
+// Usage: tiny_obj_loader_bench [grid size] [file.obj ...]
+//
+// Without files, earth.obj and sun.obj are measured, followed by a generated
+// grid of (grid size)^2 vertices (700 by default, about 80 MB of text).
+// Measured are the vertex deduplication and the parsing of the v, vt and vn
+// lines, each against the code it replaced.
+//
+// The loader is included rather than linked so its static helpers can be
+// measured directly.
+//
+
+#include "tiny_obj_loader.cc"
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+using namespace tinyobj;
+
+namespace {
+
+const int kRuns = 5;
+
+// The ordering of the std::map vertex cache replaced by vertex_index_map.
+struct vertex_index_less {
+  bool operator()(const vertex_index &a, const vertex_index &b) const {
+    if (a.v_idx != b.v_idx)
+      return (a.v_idx < b.v_idx);
+    if (a.vn_idx != b.vn_idx)
+      return (a.vn_idx < b.vn_idx);
+    if (a.vt_idx != b.vt_idx)
+      return (a.vt_idx < b.vt_idx);
+    return false;
+  }
+};
+
+// Returns the best of kRuns runs of 'fn' in milliseconds.
+template <typename Fn> double bestOf(Fn fn) {
+  double best = 1e30;
+  for (int run = 0; run < kRuns; run++) {
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    fn();
+    double ms = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+    best = std::min(best, ms);
+  }
+  return best;
+}
+
+// Assigns a vertex to every corner the way exportFaceGroupToShape did with
+// the std::map cache.
+void dedupWithMap(const std::vector<vertex_index> &corners,
+                  std::vector<unsigned int> &indices) {
+  std::map<vertex_index, unsigned int, vertex_index_less> cache;
+  indices.resize(corners.size());
+  for (size_t i = 0; i < corners.size(); i++) {
+    std::map<vertex_index, unsigned int, vertex_index_less>::iterator it =
+        cache.find(corners[i]);
+    if (it == cache.end()) {
+      unsigned int idx = static_cast<unsigned int>(cache.size());
+      cache[corners[i]] = idx;
+      indices[i] = idx;
+    } else {
+      indices[i] = it->second;
+    }
+  }
+}
+
+// The same with vertex_index_map, as exportFaceGroupToShape does now.
+void dedupWithTable(const std::vector<vertex_index> &corners,
+                    std::vector<unsigned int> &indices,
+                    std::vector<vertex_index> &keys,
+                    std::vector<unsigned int> &values) {
+  vertex_index_map cache(keys, values, corners.size());
+  unsigned int numVertices = 0;
+  indices.resize(corners.size());
+  for (size_t i = 0; i < corners.size(); i++) {
+    size_t slot = cache.find(corners[i]);
+    if (!cache.occupied(slot))
+      cache.insert(slot, corners[i], numVertices++);
+    indices[i] = cache.value(slot);
+  }
+}
+
+// parseFloat as it was before findTokenEnd and tryParseFixedDecimal.
+float parseFloatScalar(const char *&token) {
+  token += strspn(token, " \t");
+  const char *end = token + strcspn(token, " \t\r\n");
+  double val = 0.0;
+  tryParseDouble(token, end, &val);
+  token = end;
+  return static_cast<float>(val);
+}
+
+// Parses the numbers of every v, vt and vn line of 'buf', which ends with
+// kTokenPadding bytes of '\0', and returns their sum.
+template <typename ParseFn>
+double parseVertexLines(const std::string &buf, ParseFn parse) {
+  double sum = 0.0;
+  for (const char *line = buf.c_str(); *line;) {
+    if (line[0] == 'v' && (isSpace(line[1]) || isSpace(line[2]))) {
+      const char *token = line + (isSpace(line[1]) ? 2 : 3);
+      while (!isNewLine(token[0])) {
+        sum += parse(token);
+        token += strspn(token, " \t");
+      }
+    }
+    const char *eol = strchr(line, '\n');
+    line = eol ? eol + 1 : line + strlen(line);
+  }
+  return sum;
+}
+
+void benchFloats(const std::string &name, const char *buf, size_t len) {
+  std::string padded(buf, len);
+  padded.append(kTokenPadding, '\0');
+  double scalarSum = 0.0, fastSum = 0.0;
+  double scalarMs = bestOf(
+      [&]() { scalarSum = parseVertexLines(padded, parseFloatScalar); });
+  double fastMs = bestOf([&]() {
+    fastSum = parseVertexLines(padded, [](const char *&token) {
+      return parseFloat(token);
+    });
+  });
+  double mb = len / 1e6;
+
+  std::cout << name << ": " << mb << " MB, strcspn + tryParseDouble "
+            << mb / scalarMs * 1e3 << " MB/s, "
+#ifdef TINY_OBJ_LOADER_SSE2
+            << "SSE2"
+#else
+            << "scalar"
+#endif
+            << " fast path " << mb / fastMs * 1e3 << " MB/s ("
+            << scalarMs / fastMs << "x)"
+            << (scalarSum == fastSum ? "" : ", SUMS DIFFER") << std::endl;
+}
+
+// A grid of n x n vertices with texcoords and normals, as quads.
+std::string generateGrid(int n) {
+  std::string obj;
+  char line[128];
+  for (int y = 0; y < n; y++)
+    for (int x = 0; x < n; x++) {
+      snprintf(line, sizeof(line), "v %f %f %f\n", x * 0.01f, y * 0.01f,
+               0.001f * ((x * 7 + y * 13) % 17));
+      obj += line;
+    }
+  for (int y = 0; y < n; y++)
+    for (int x = 0; x < n; x++) {
+      snprintf(line, sizeof(line), "vt %f %f\n", x / float(n - 1),
+               y / float(n - 1));
+      obj += line;
+    }
+  for (int i = 0; i < n * n; i++)
+    obj += "vn 0.000000 0.000000 1.000000\n";
+  for (int y = 0; y + 1 < n; y++)
+    for (int x = 0; x + 1 < n; x++) {
+      int a = y * n + x + 1, b = a + 1, c = a + n + 1, d = a + n;
+      snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d\n",
+               a, a, a, b, b, b, c, c, c, d, d, d);
+      obj += line;
+    }
+  return obj;
+}
+
+void benchDedup(const std::string &name, const char *buf, size_t len) {
+  obj_chunk chunk;
+  chunk.begin = buf;
+  chunk.end = buf + len;
+  parseChunk(&chunk);
+
+  std::vector<unsigned int> mapIndices, tableIndices;
+  std::vector<vertex_index> keys;
+  std::vector<unsigned int> values;
+  double mapMs = bestOf([&]() { dedupWithMap(chunk.corners, mapIndices); });
+  double tableMs = bestOf(
+      [&]() { dedupWithTable(chunk.corners, tableIndices, keys, values); });
+  unsigned int numVertices =
+      tableIndices.empty()
+          ? 0
+          : *std::max_element(tableIndices.begin(), tableIndices.end()) + 1;
+
+  std::cout << name << ": " << chunk.corners.size() << " corners, "
+            << numVertices << " vertices, std::map " << mapMs
+            << " ms, open addressing " << tableMs << " ms ("
+            << mapMs / tableMs << "x)"
+            << (mapIndices == tableIndices ? "" : ", INDICES DIFFER")
+            << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int gridSize = 700;
+  std::vector<std::string> files;
+  for (int i = 1; i < argc; i++) {
+    if (i == 1 && atoi(argv[i]) > 1)
+      gridSize = atoi(argv[i]);
+    else
+      files.push_back(argv[i]);
+  }
+  if (files.empty()) {
+    files.push_back("earth.obj");
+    files.push_back("sun.obj");
+  }
+
+  std::vector<obj_file> mapped(files.size());
+  for (size_t i = 0; i < files.size(); i++) {
+    std::string err = mapped[i].map(files[i].c_str());
+    if (!err.empty())
+      std::cerr << err;
+  }
+  char name[64];
+  snprintf(name, sizeof(name), "%dx%d grid", gridSize, gridSize);
+  std::string grid = generateGrid(gridSize);
+
+  std::cout << "Vertex deduplication, best of " << kRuns << " runs"
+            << std::endl;
+  for (size_t i = 0; i < files.size(); i++)
+    if (mapped[i].len)
+      benchDedup(files[i], mapped[i].data, mapped[i].len);
+  benchDedup(name, grid.data(), grid.size());
+
+  std::cout << "Vertex line parsing, best of " << kRuns << " runs"
+            << std::endl;
+  for (size_t i = 0; i < files.size(); i++)
+    if (mapped[i].len)
+      benchFloats(files[i], mapped[i].data, mapped[i].len);
+  benchFloats(name, grid.data(), grid.size());
+  return 0;
+}
@@ -0,0 +1,285 @@
+//
+// Checks of the OBJ loader token parsers against the C library, and of the
+// threaded loader against the serial one.
+//
+// Usage: tiny_obj_loader_test
+//
+// The loader is included rather than linked so its static helpers can be
+// tested directly. Build with -DTINY_OBJ_LOADER_NO_SIMD to test the scalar
+// fallback instead of SSE2.
+//
+
+#include "tiny_obj_loader.cc"
+
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+using namespace tinyobj;
+
+namespace {
+
+int failures = 0;
+
+void fail(const std::string &what) {
+  if (failures++ < 20)
+    std::cerr << "FAIL: " << what << std::endl;
+}
+
+// Whether a and b are at most 'ulps' floats apart.
+bool closeFloats(float a, float b, int ulps) {
+  if (a == b)
+    return true;
+  if ((a < 0) != (b < 0))
+    return false;
+  int ia, ib;
+  memcpy(&ia, &a, sizeof(a));
+  memcpy(&ib, &b, sizeof(b));
+  return std::abs(ia - ib) <= ulps;
+}
+
+// Parses the first token of 'text' with parseFloat and compares it with
+// strtod. Tokens which tryParseFixedDecimal takes must match exactly, the
+// others, parsed by tryParseDouble, within two ulps.
+void checkFloat(const std::string &text) {
+  // With the padding forEachLine gives the last lines of a buffer.
+  std::vector<char> line(text.begin(), text.end());
+  line.resize(text.size() + kTokenPadding, '\0');
+  const char *token = line.data();
+  float f = parseFloat(token);
+
+  const char *start = line.data() + strspn(line.data(), " \t");
+  const char *end = start + strcspn(start, " \t\r\n");
+  double fixed;
+  bool isFixed = tryParseFixedDecimal(start, end, &fixed);
+  char *strtodEnd;
+  float expected = static_cast<float>(strtod(start, &strtodEnd));
+  if (strtodEnd == start)
+    expected = 0.0f;
+
+  if (token != end)
+    fail("\"" + text + "\" ends at offset " +
+         std::to_string(token - line.data()) + " instead of " +
+         std::to_string(end - line.data()));
+  if (!closeFloats(f, expected, isFixed ? 0 : 2)) {
+    char msg[256];
+    snprintf(msg, sizeof(msg), "\"%s\" gives %.9g, strtod %.9g%s",
+             text.c_str(), f, expected, isFixed ? " (fast path)" : "");
+    fail(msg);
+  }
+}
+
+void testFloats() {
+  static const char *cases[] = {
+      "0", "-0", "+0", "1", "-1", "0.5", "-.5", ".5", "+.25", "5.",
+      "-0.013712", "0.000001", "123456789012345", "1234567.89012345",
+      "-999999999999999", "0.999999999999999", "3.14159265358979",
+      // Longer mantissas than the fast path takes.
+      "1234567890123456", "0.1234567890123456789", "-3.1415926535897932",
+      "0000000000000001.5",
+      // Exponents.
+      "1e0", "1e10", "-1.5e-3", "2.5E+2", "+3.1417e+2", "-0.0E-3", "11e2",
+      "6.02214076e23", "1e-30",
+      // Separators.
+      "1.5 2", "1.5\t2", "1.5\r\n", "-2.25\n", "7\r", "0.125"};
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    checkFloat(cases[i]);
+
+  // Random fixed-format decimals, as exporters write them.
+  std::mt19937 rng(1);
+  for (int i = 0; i < 200000; i++) {
+    int numDigits = 1 + rng() % 15;
+    std::string text;
+    if (rng() % 2)
+      text += '-';
+    int point = rng() % (numDigits + 1);
+    for (int d = 0; d < numDigits; d++) {
+      if (d == point && d != 0)
+        text += '.';
+      text += static_cast<char>('0' + rng() % 10);
+    }
+    text += (rng() % 2) ? "\r\n" : " ";
+    checkFloat(text);
+  }
+}
+
+void testTriples() {
+  static const char *cases[] = {"1", "12/7", "3//4", "5/6/7", "-1/-2/-3",
+                                "+8/9", "10/11/12\r\n", "42 43"};
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    const char *token = cases[i];
+    vertex_index vi = parseRawTriple(token);
+
+    int expected[3] = {kNoIndex, kNoIndex, kNoIndex};
+    const char *c = cases[i];
+    for (int k = 0; k < 3; k++) {
+      if (c[0] != '/' && !isSpace(c[0]) && !isNewLine(c[0]))
+        expected[k] = atoi(c);
+      c += strcspn(c, "/ \t\r\n");
+      if (c[0] != '/')
+        break;
+      c++;
+    }
+    if (vi.v_idx != expected[0] || vi.vt_idx != expected[1] ||
+        vi.vn_idx != expected[2] || token != c)
+      fail(std::string("triple \"") + cases[i] + "\"");
+  }
+}
+
+// Lines ending at the end of the buffer, with and without a newline. The
+// buffer is copied to a heap block of its exact size, so memory checkers see
+// reads past it.
+void testBufferEnd() {
+  static const char *cases[] = {"v 1 2 3\nv 4.5 -5 6e1",
+                                "v 1 2 3\nv 4.5 -5 6e1\n",
+                                "v 1 2 3\r\nv 4.5 -5 6e1\r\n",
+                                "v 1 2 3\nv 4.5 -5 60\n\n\n",
+                                "v 1 2 3\nv 4.5 -5 60.00000000000001"};
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    size_t len = strlen(cases[i]);
+    for (size_t offset = 0; offset < 16; offset++) {
+      // Every alignment of the end of the buffer.
+      std::vector<char> block(offset + len);
+      char *buf = block.data() + offset;
+      memcpy(buf, cases[i], len);
+
+      obj_chunk chunk;
+      chunk.begin = buf;
+      chunk.end = buf + len;
+      parseChunk(&chunk);
+      static const float expected[] = {1, 2, 3, 4.5f, -5, 60};
+      if (chunk.v.size() != 6 ||
+          !std::equal(chunk.v.begin(), chunk.v.end(), expected))
+        fail("buffer end case " + std::to_string(i) + " at offset " +
+             std::to_string(offset));
+    }
+  }
+}
+
+// Serves the materials of the generated OBJ from memory.
+class StringMaterialReader : public MaterialReader {
+public:
+  StringMaterialReader(const std::string &mtl) : m_mtl(mtl) {}
+  virtual std::string operator()(const std::string & /*matId*/,
+                                 std::vector<material_t> &materials,
+                                 std::map<std::string, int> &matMap) {
+    std::istringstream stream(m_mtl);
+    return LoadMtl(matMap, materials, stream);
+  }
+
+private:
+  std::string m_mtl;
+};
+
+// An OBJ of 'numGroups' groups of 'groupSize'^2 vertices. The faces use
+// relative indices into the vertices before them, which are in an earlier
+// chunk at the chunk boundaries, and some use absolute ones into the first
+// group. Groups alternate between 'g' and 'o', switch materials in the
+// middle, and half of them end their lines with CRLF.
+std::string generateObj(int numGroups, int groupSize) {
+  std::string obj = "mtllib test.mtl\n";
+  char line[160];
+  for (int g = 0; g < numGroups; g++) {
+    const char *eol = (g % 2) ? "\r\n" : "\n";
+    snprintf(line, sizeof(line), "%s part%d%s", (g % 3) ? "g" : "o", g, eol);
+    obj += line;
+    for (int y = 0; y < groupSize; y++)
+      for (int x = 0; x < groupSize; x++) {
+        snprintf(line, sizeof(line), "v %f %f %f%s", x * 0.01f + g,
+                 y * 0.01f, 0.001f * ((x * 7 + y * 13 + g) % 17), eol);
+        obj += line;
+        snprintf(line, sizeof(line), "vt %f %f%s", x / float(groupSize),
+                 y / float(groupSize), eol);
+        obj += line;
+        snprintf(line, sizeof(line), "vn 0 %f 1%s", 0.01f * (x % 5), eol);
+        obj += line;
+      }
+    int n = groupSize * groupSize;
+    for (int y = 0; y + 1 < groupSize; y++) {
+      if (y == 0 || y == groupSize / 2) {
+        snprintf(line, sizeof(line), "usemtl %s%s",
+                 (y == 0) == (g % 2 == 0) ? "red" : "blue", eol);
+        obj += line;
+      }
+      for (int x = 0; x + 1 < groupSize; x++) {
+        int a = y * groupSize + x - n, b = a + 1, c = b + groupSize,
+            d = a + groupSize;
+        if ((x + y) % 4 == 0)
+          snprintf(line, sizeof(line), "f %d/%d/%d %d//%d %d/%d/%d%s", a, a,
+                   a, b, b, c, c, c, eol);
+        else if ((x + y) % 4 == 1)
+          snprintf(line, sizeof(line), "f %d %d %d %d%s", a, b, c, d, eol);
+        else if ((x + y) % 4 == 2)
+          snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d%s",
+                   a, a, a, b, b, b, c, c, c, d, d, d, eol);
+        else
+          snprintf(line, sizeof(line), "f %d/%d %d/%d %d/%d%s", x + 1, x + 1,
+                   x + 2, x + 2, groupSize + x + 2, groupSize + x + 2, eol);
+        obj += line;
+      }
+    }
+  }
+  return obj;
+}
+
+bool sameShapes(const std::vector<shape_t> &a, const std::vector<shape_t> &b) {
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0; i < a.size(); i++) {
+    const mesh_t &ma = a[i].mesh, &mb = b[i].mesh;
+    if (a[i].name != b[i].name || ma.positions != mb.positions ||
+        ma.normals != mb.normals || ma.texcoords != mb.texcoords ||
+        ma.vertices != mb.vertices || ma.indices != mb.indices ||
+        ma.material_ids != mb.material_ids)
+      return false;
+  }
+  return true;
+}
+
+// The threaded loader must give the serial loader's shapes and materials.
+void testThreads() {
+  std::string obj = generateObj(12, 80);
+  StringMaterialReader mtl("newmtl red\nKd 1 0 0\nnewmtl blue\nKd 0 0 1\n");
+  if (obj.size() < 4 * kMinChunkSize)
+    fail("the generated OBJ has less than four chunks");
+
+  for (int flags = 0; flags <= LOAD_INTERLEAVED; flags += LOAD_INTERLEAVED) {
+    std::vector<shape_t> serial;
+    std::vector<material_t> serialMaterials;
+    std::string err = LoadObj(serial, serialMaterials, obj.data(), obj.size(),
+                              mtl, 1, flags);
+    if (!err.empty() || serial.size() != 12 || serialMaterials.size() != 2) {
+      fail("serial load: " + err);
+      continue;
+    }
+
+    for (unsigned int threads = 2; threads <= 4; threads++) {
+      std::vector<shape_t> shapes;
+      std::vector<material_t> materials;
+      err = LoadObj(shapes, materials, obj.data(), obj.size(), mtl, threads,
+                    flags);
+      bool sameMaterials = materials.size() == serialMaterials.size();
+      for (size_t i = 0; sameMaterials && i < materials.size(); i++)
+        sameMaterials = materials[i].name == serialMaterials[i].name;
+      if (!err.empty() || !sameMaterials || !sameShapes(shapes, serial))
+        fail(std::to_string(threads) + " threads with flags " +
+             std::to_string(flags) + " differ from the serial load " + err);
+    }
+  }
+}
+
+} // namespace
+
+int main() {
+  testFloats();
+  testTriples();
+  testBufferEnd();
+  testThreads();
+  if (failures) {
+    std::cerr << failures << " failures" << std::endl;
+    return 1;
+  }
+  std::cout << "tiny_obj_loader_test: all passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,56 @@
+#include "vertex_format.h"
+
+#include <cfloat>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+void pack_vertices(const float *vertices, size_t numVertices, packed_mesh &mesh)
+{
+	const size_t stride = 8;
+
+	// Quantize the positions within the bounding box.
+	glm::vec3 lower(FLT_MAX), upper(-FLT_MAX);
+	for(size_t i = 0; i < numVertices; ++i){
+		glm::vec3 p(vertices[i*stride], vertices[i*stride + 1], vertices[i*stride + 2]);
+		lower = glm::min(lower, p);
+		upper = glm::max(upper, p);
+	}
+	if(numVertices == 0)
+		lower = upper = glm::vec3(0.0f);
+	glm::vec3 scale = upper - lower;
+	for(int k = 0; k < 3; ++k){
+		mesh.positionOffset[k] = lower[k];
+		mesh.positionScale[k] = scale[k];
+	}
+	// A flat axis would divide by zero, every vertex is at 0 on it anyway.
+	glm::vec3 invScale = glm::vec3(1.0f)/glm::max(scale, glm::vec3(FLT_MIN));
+
+	mesh.vertices.resize(numVertices);
+	for(size_t i = 0; i < numVertices; ++i){
+		const float *v = vertices + i*stride;
+		packed_vertex &out = mesh.vertices[i];
+		glm::vec3 p = (glm::vec3(v[0], v[1], v[2]) - lower)*invScale;
+		for(int k = 0; k < 3; ++k)
+			out.position[k] = glm::packUnorm1x16(p[k]);
+		out.pad = 0;
+		out.texcoord[0] = glm::packHalf1x16(v[3]);
+		out.texcoord[1] = glm::packHalf1x16(v[4]);
+		glm::vec3 n(v[5], v[6], v[7]);
+		float length = glm::length(n);
+		if(length > 0.0f)
+			n /= length;
+		out.normal = glm::packSnorm3x10_1x2(glm::vec4(n, 0.0f));
+	}
+}
+
+bool pack_indices16(const unsigned int *indices, size_t numIndices, size_t numVertices,
+		std::vector<unsigned short> &out)
+{
+	out.clear();
+	if(numVertices > 65536)
+		return false;
+	out.resize(numIndices);
+	for(size_t i = 0; i < numIndices; ++i)
+		out[i] = static_cast<unsigned short>(indices[i]);
+	return true;
+}
@@ -0,0 +1,40 @@
+#ifndef _VERTEX_FORMAT_H
+#define _VERTEX_FORMAT_H
+
+#include <cstddef>
+#include <vector>
+
+/* Compact vertex format, 16 bytes per vertex instead of the 32 bytes of the
+ * interleaved float vertices of tinyobj::LOAD_INTERLEAVED.
+ * - position: GL_UNSIGNED_SHORT x 3, normalized within the bounding box of the
+ *   mesh. The vertex shader maps it back with positionOffset + positionScale*p.
+ * - texcoord: GL_HALF_FLOAT x 2.
+ * - normal: GL_INT_2_10_10_10_REV, normalized.
+ */
+struct packed_vertex {
+	unsigned short position[3];
+	unsigned short pad;	// Keeps texcoord 4-byte aligned
+	unsigned short texcoord[2];
+	unsigned int normal;
+};
+
+struct packed_mesh {
+	std::vector<packed_vertex> vertices;
+	float positionOffset[3];	// Minimum corner of the bounding box
+	float positionScale[3];	// Size of the bounding box
+};
+
+/* Pack interleaved float vertices: position(3), texcoord(2), normal(3).
+ * Parameter:
+ * - vertices, numVertices: numVertices * 8 floats.
+ */
+void pack_vertices(const float *vertices, size_t numVertices, packed_mesh &mesh);
+
+/* Convert 32-bit indices to 16-bit ones if every vertex can be addressed.
+ * Return:
+ * - false if 'numVertices' does not fit in 16 bits, 'out' is left empty.
+ */
+bool pack_indices16(const unsigned int *indices, size_t numIndices, size_t numVertices,
+		std::vector<unsigned short> &out);
+
+#endif // _VERTEX_FORMAT_H